@@ -0,0 +1,391 @@
+/*
+ * Latency and throughput benchmark. Connects to a display where kpmouse is
+ * already running (see bench/run.sh), fires keypad key events through XTest
+ * and observes the resulting pointer motion and button events with XInput2.
+ *
+ * Usage: kpm_bench [-n ITERATIONS] [-o OUTPUT.json]
+ */
+#include "../src/config.h"
+#include "../src/user_config.h"
+#include "../src/latency.h"
+#include "../src/util.h"
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+#include <X11/extensions/XInput2.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Events not observed within this time count as lost */
+#define TIMEOUT_MS 250
+/** Pause between measured actions, so that each one is isolated */
+#define GAP_MS 15
+/** Synthetic autorepeat interval (matches a 30Hz keyboard autorepeat) */
+#define REPEAT_MS 33
+/** How long a movement key is held in the autorepeat scenario */
+#define HOLD_MS 1000
+/** Duration of each throughput storm */
+#define STORM_MS 2000
+
+/** Event types the benchmark waits for */
+#define EV_MOTION  (1 << 0)
+#define EV_BTN_DN  (1 << 1)
+#define EV_BTN_UP  (1 << 2)
+
+typedef struct bench_s {
+  Display* dpy;
+  int xi_opcode;
+  KeyCode move[8];
+  KeyCode button;
+  KeyCode undo;
+  int iterations;
+} bench_t;
+
+/** Latency samples of a scenario */
+typedef struct scenario_s {
+  const char* name;
+  kpm_hist_t hist;
+  long long sum_ns;
+  /** Actions fired and how many of them were never observed */
+  long actions, lost;
+  /** Scenario-specific rate (events/s), negative if not applicable */
+  double rate;
+} scenario_t;
+
+static void sleep_ms(long ms) {
+  struct timespec ts = {ms/1000, (ms%1000)*1000000L};
+  while (nanosleep(&ts, &ts));
+}
+
+static void sleep_until_ns(long long deadline) {
+  struct timespec ts = {deadline/1000000000LL, deadline%1000000000LL};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL));
+}
+
+/** Classify a pending X event into EV_* bits, or 0 if not relevant */
+static int next_event(bench_t* b) {
+  XEvent ev;
+  int type = 0;
+  XNextEvent(b->dpy, &ev);
+  XGenericEventCookie* cookie = &ev.xcookie;
+  if (cookie->type == GenericEvent && cookie->extension == b->xi_opcode
+      && XGetEventData(b->dpy, cookie)) {
+    switch (cookie->evtype) {
+      case XI_Motion:        type = EV_MOTION; break;
+      case XI_ButtonPress:   type = EV_BTN_DN; break;
+      case XI_ButtonRelease: type = EV_BTN_UP; break;
+    }
+    XFreeEventData(b->dpy, cookie);
+  }
+  return type;
+}
+
+/** Discard all events already generated by the server */
+static void drain(bench_t* b) {
+  XSync(b->dpy, False);
+  while (XPending(b->dpy))
+    next_event(b);
+}
+
+/** Count (without blocking) the pending events matching mask */
+static int count_pending(bench_t* b, int mask) {
+  int n = 0;
+  while (XPending(b->dpy))
+    n += (next_event(b) & mask) != 0;
+  return n;
+}
+
+/**
+ * Wait until an event matching mask arrives or timeout_ms expires.
+ * @return arrival time (CLOCK_MONOTONIC ns) or 0 on timeout.
+ */
+static long long wait_event(bench_t* b, int mask, long timeout_ms) {
+  long long deadline = kpm__now_ns() + timeout_ms*1000000LL;
+  struct pollfd pfd = {ConnectionNumber(b->dpy), POLLIN, 0};
+  for (;;) {
+    while (XPending(b->dpy)) {
+      if (next_event(b) & mask)
+        return kpm__now_ns();
+    }
+    long long left = deadline - kpm__now_ns();
+    if (left <= 0)
+      return 0;
+    poll(&pfd, 1, (int)(left/1000000LL) + 1);
+  }
+}
+
+static void key(bench_t* b, KeyCode code, int press) {
+  XTestFakeKeyEvent(b->dpy, code, press ? True : False, CurrentTime);
+  XFlush(b->dpy);
+}
+
+/** Record an action started at start and observed at end (0 if lost) */
+static void record(scenario_t* sc, long long start, long long end) {
+  ++sc->actions;
+  if (end) {
+    kpm_hist_add(&sc->hist, end - start);
+    sc->sum_ns += end - start;
+  } else {
+    ++sc->lost;
+  }
+}
+
+/** Press (and release) code, recording the latency until an event in mask */
+static void timed_key(bench_t* b, scenario_t* sc, KeyCode code, int press,
+                      int mask) {
+  drain(b);
+  long long start = kpm__now_ns();
+  key(b, code, press);
+  record(sc, start, wait_event(b, mask, TIMEOUT_MS));
+}
+
+static void tap(bench_t* b, KeyCode code) {
+  key(b, code, 1);
+  key(b, code, 0);
+}
+
+/** Leave kpmouse in linear mode, with the pointer near the screen center */
+static void enter_linear(bench_t* b) {
+  for (int i = 0; i < KPM_LOG_STEPS; ++i)
+    tap(b, b->move[i%2 ? 6 : 0]); // BR, TL, ...
+  sleep_ms(GAP_MS);
+}
+
+////////////////////////////////////
+// Scenarios
+////////////////////////////////////
+
+/** Single moves, alternating left and right so every move changes position */
+static void bench_move(bench_t* b, scenario_t* sc) {
+  for (int i = 0; i < b->iterations; ++i) {
+    KeyCode code = b->move[i%2 ? 5 : 7];
+    timed_key(b, sc, code, 1, EV_MOTION);
+    key(b, code, 0);
+    sleep_ms(GAP_MS);
+  }
+}
+
+/**
+ * Undo followed by a first log step, alternating top-left and bottom-right.
+ * Undo alone does not move the pointer, so the latency runs from the undo
+ * press to the motion of the step that starts again from the whole monitor.
+ */
+static void bench_undo(bench_t* b, scenario_t* sc) {
+  enter_linear(b);
+  for (int i = 0; i < b->iterations; ++i) {
+    KeyCode code = b->move[i%2 ? 0 : 6];
+    drain(b);
+    long long start = kpm__now_ns();
+    tap(b, b->undo);
+    tap(b, code);
+    record(sc, start, wait_event(b, EV_MOTION, TIMEOUT_MS));
+    sleep_ms(GAP_MS);
+  }
+}
+
+/**
+ * Long press a button, move while it is held, and release with a second
+ * press. Records the button down, motion and button up latencies.
+ */
+static void bench_drag(bench_t* b, scenario_t* sc) {
+  for (int i = 0; i < b->iterations; i += 4) {
+    timed_key(b, sc, b->button, 1, EV_BTN_DN);
+    sleep_ms(KPM_LONG_PRESS_MS + 50);
+    key(b, b->button, 0);
+    for (int j = 0; j < 2; ++j) {
+      KeyCode code = b->move[j%2 ? 5 : 7];
+      timed_key(b, sc, code, 1, EV_MOTION);
+      key(b, code, 0);
+      sleep_ms(GAP_MS);
+    }
+    timed_key(b, sc, b->button, 1, EV_BTN_UP);
+    key(b, b->button, 0);
+    sleep_ms(GAP_MS);
+  }
+}
+
+/**
+ * Hold a movement key in linear mode with a synthetic autorepeat. Records the
+ * latency of the first motion and the motion rate while the key is held.
+ */
+static void bench_autorepeat(bench_t* b, scenario_t* sc) {
+  int rounds = b->iterations/50 > 0 ? b->iterations/50 : 1;
+  long long motions = 0, held_ns = 0;
+  for (int i = 0; i < rounds; ++i) {
+    KeyCode code = b->move[i%2 ? 5 : 7];
+    enter_linear(b);
+    timed_key(b, sc, code, 1, EV_MOTION);
+    long long start = kpm__now_ns(), next = start;
+    while (next - start < HOLD_MS*1000000LL) {
+      next += REPEAT_MS*1000000LL;
+      sleep_until_ns(next);
+      key(b, code, 1);
+      motions += count_pending(b, EV_MOTION);
+    }
+    key(b, code, 0);
+    held_ns += kpm__now_ns() - start;
+    sleep_ms(GAP_MS);
+  }
+  sc->rate = motions / (held_ns/1e9);
+}
+
+/**
+ * Alternating left/right taps at a fixed rate (0 for as fast as possible).
+ * Records how many actions per second were observed as pointer motion.
+ */
+static void bench_storm(bench_t* b, scenario_t* sc, int rate) {
+  long long period = rate ? 1000000000LL/rate : 0;
+  long long start, now, next, last = 0;
+  long sent = 0, seen = 0;
+  enter_linear(b);
+  drain(b);
+  start = next = kpm__now_ns();
+  while ((now = kpm__now_ns()) - start < STORM_MS*1000000LL) {
+    if (period)
+      sleep_until_ns(next += period);
+    tap(b, b->move[sent++ % 2 ? 5 : 7]);
+    int n = count_pending(b, EV_MOTION);
+    if (n) {
+      seen += n;
+      last = kpm__now_ns();
+    }
+  }
+  while ((now = wait_event(b, EV_MOTION, TIMEOUT_MS))) {
+    ++seen;
+    last = now;
+  }
+  sc->actions = sent;
+  sc->lost = sent > seen ? sent - seen : 0;
+  sc->rate = last > start ? seen / ((last - start)/1e9) : 0;
+}
+
+////////////////////////////////////
+// Setup & output
+////////////////////////////////////
+
+static int setup(bench_t* b) {
+  int ev, err, maj = 2, min = 0;
+  if (!XTestQueryExtension(b->dpy, &ev, &err, &maj, &min)) {
+    fprintf(stderr, "XTest not available\n");
+    return 1;
+  }
+  maj = 2;
+  min = 0;
+  if (!XQueryExtension(b->dpy, "XInputExtension", &b->xi_opcode, &ev, &err)
+      || XIQueryVersion(b->dpy, &maj, &min) != Success) {
+    fprintf(stderr, "XInput 2 not available\n");
+    return 1;
+  }
+  unsigned char bits[XIMaskLen(XI_LASTEVENT)];
+  memset(bits, 0, sizeof(bits));
+  XISetMask(bits, XI_Motion);
+  XISetMask(bits, XI_ButtonPress);
+  XISetMask(bits, XI_ButtonRelease);
+  XIEventMask mask = {XIAllMasterDevices, sizeof(bits), bits};
+  XISelectEvents(b->dpy, DefaultRootWindow(b->dpy), &mask, 1);
+
+  for (int i = 0; i < 8; ++i)
+    b->move[i] = XKeysymToKeycode(b->dpy, kpm_move_sym[i]);
+  b->button = XKeysymToKeycode(b->dpy, kpm_button_sym[0]);
+  b->undo = XKeysymToKeycode(b->dpy, KPM_UNDO_SYM);
+  for (int i = 0; i < 8; ++i) {
+    if (!b->move[i]) {
+      fprintf(stderr, "No KeyCode for move KeySym %lx\n", kpm_move_sym[i]);
+      return 1;
+    }
+  }
+  if (!b->button || !b->undo) {
+    fprintf(stderr, "No KeyCode for button or undo KeySym\n");
+    return 1;
+  }
+  return 0;
+}
+
+static void write_scenario(FILE* out, const scenario_t* sc, int last) {
+  const kpm_hist_t* h = &sc->hist;
+  uint64_t n = h->count;
+  fprintf(out, "    \"%s\": {\"actions\": %ld, \"lost\": %ld", sc->name,
+          sc->actions, sc->lost);
+  if (sc->sum_ns && n) {
+    fprintf(out, ", \"mean_us\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, "
+            "\"p999_us\": %.1f, \"max_us\": %.1f", sc->sum_ns/1e3/n,
+            kpm_hist_quantile(h, .5)/1e3, kpm_hist_quantile(h, .99)/1e3,
+            kpm_hist_quantile(h, .999)/1e3, h->max/1e3);
+  }
+  if (sc->rate >= 0)
+    fprintf(out, ", \"per_second\": %.1f", sc->rate);
+  fprintf(out, "}%s\n", last ? "" : ",");
+}
+
+int main(int argc, char** argv) {
+  static const int STORM_RATES[] = {100, 500, 2000, 0};
+  static const char* STORM_NAMES[] = {
+    "storm_100hz", "storm_500hz", "storm_2000hz", "storm_max"
+  };
+  enum {MOVE, UNDO, DRAG, AUTOREPEAT, STORM, N_SCENARIOS = STORM + 4};
+  static scenario_t sc[N_SCENARIOS];
+  const char* out_path = NULL;
+  bench_t b;
+  int opt;
+
+  memset(&b, 0, sizeof(bench_t));
+  b.iterations = 200;
+  while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+    switch (opt) {
+      case 'n': b.iterations = atoi(optarg); break;
+      case 'o': out_path = optarg; break;
+      default:
+        fprintf(stderr, "Usage: %s [-n ITERATIONS] [-o OUTPUT.json]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (!(b.dpy = XOpenDisplay(NULL))) {
+    fprintf(stderr, "Could not open display %s\n", XDisplayName(NULL));
+    return 1;
+  }
+  if (setup(&b))
+    return 1;
+
+  sc[MOVE].name = "move";
+  sc[UNDO].name = "undo";
+  sc[DRAG].name = "drag";
+  sc[AUTOREPEAT].name = "autorepeat";
+  for (int i = 0; i < N_SCENARIOS; ++i)
+    sc[i].rate = -1;
+  bench_move(&b, &sc[MOVE]);
+  bench_undo(&b, &sc[UNDO]);
+  bench_drag(&b, &sc[DRAG]);
+  bench_autorepeat(&b, &sc[AUTOREPEAT]);
+  for (int i = 0; i < 4; ++i) {
+    sc[STORM+i].name = STORM_NAMES[i];
+    bench_storm(&b, &sc[STORM+i], STORM_RATES[i]);
+  }
+
+  FILE* out = out_path ? fopen(out_path, "w") : stdout;
+  if (!out) {
+    perror(out_path);
+    return 1;
+  }
+  fprintf(out, "{\n  \"display\": \"%s\",\n  \"iterations\": %d,\n"
+          "  \"scenarios\": {\n", XDisplayName(NULL), b.iterations);
+  for (int i = 0; i < N_SCENARIOS; ++i)
+    write_scenario(out, &sc[i], i == N_SCENARIOS-1);
+  fprintf(out, "  }\n}\n");
+  if (out != stdout)
+    fclose(out);
+  XCloseDisplay(b.dpy);
+
+  int failed = 0;
+  for (int i = 0; i < N_SCENARIOS; ++i) {
+    if (sc[i].actions && sc[i].lost >= sc[i].actions) {
+      fprintf(stderr, "Scenario %s: no action was observed\n", sc[i].name);
+      failed = 1;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,62 @@
+#!/bin/sh
+# Runs kpmouse against a private Xvfb and benchmarks it with kpm_bench.
+#
+# Usage: bench/run.sh [OUTPUT.json] [kpm_bench options...]
+#
+# Results are written as JSON to OUTPUT.json (default: bench_output.json).
+# kpmouse's own per-stage latency histograms are printed at the end.
+set -e
+
+OUT=${1:-bench_output.json}
+[ $# -gt 0 ] && shift
+XVFB=${XVFB:-Xvfb}
+KPMOUSE=${KPMOUSE:-build/kpmouse}
+KPM_BENCH=${KPM_BENCH:-build/kpm_bench}
+
+TMP=$(mktemp -d)
+XVFB_PID=
+KPM_PID=
+cleanup() {
+  [ -n "$KPM_PID" ] && kill "$KPM_PID" 2>/dev/null || true
+  [ -n "$XVFB_PID" ] && kill "$XVFB_PID" 2>/dev/null || true
+  wait 2>/dev/null || true
+  rm -fr "$TMP"
+}
+trap cleanup EXIT INT TERM
+
+# -displayfd makes Xvfb pick an unused display number and report it
+"$XVFB" -displayfd 3 -screen 0 1920x1080x24 -nolisten tcp -noreset \
+  3>"$TMP/display" 2>"$TMP/xvfb.log" &
+XVFB_PID=$!
+for i in $(seq 100); do
+  [ -s "$TMP/display" ] && break
+  sleep 0.05
+done
+if [ ! -s "$TMP/display" ]; then
+  echo "Xvfb did not start:" >&2
+  cat "$TMP/xvfb.log" >&2
+  exit 1
+fi
+DISPLAY=:$(cat "$TMP/display")
+export DISPLAY
+
+"$KPMOUSE" >/dev/null 2>"$TMP/kpmouse.log" &
+KPM_PID=$!
+for i in $(seq 100); do
+  grep -q "kpmouse ready" "$TMP/kpmouse.log" && break
+  sleep 0.05
+done
+if ! grep -q "kpmouse ready" "$TMP/kpmouse.log"; then
+  echo "kpmouse did not start:" >&2
+  cat "$TMP/kpmouse.log" >&2
+  exit 1
+fi
+
+"$KPM_BENCH" -o "$OUT" "$@"
+cat "$OUT"
+
+kill -USR1 "$KPM_PID"
+sleep 0.2
+echo
+echo "kpmouse latency histograms:"
+sed -n '/^action/,$p' "$TMP/kpmouse.log"
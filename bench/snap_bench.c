@@ -0,0 +1,118 @@
+/*
+ * Microbenchmark of the edge snapping kernels (src/snap.c). Runs every
+ * kernel implementation supported by the CPU over a synthetic screenshot
+ * (random flat rectangles, like a desktop full of windows and widgets) and
+ * checks that all of them compute the same profiles as the scalar one.
+ *
+ * Two shapes are measured: the full frame, and the strips that kpmouse
+ * actually reads when snapping (frame width or height by 2*KPM_SNAP_BAND+1).
+ *
+ * Usage: snap_bench [-n ITERATIONS] [-s WxH]
+ */
+#include "../src/config.h"
+#include "../src/user_config.h"
+#include "../src/snap.h"
+#include "../src/util.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BAND (2*KPM_SNAP_BAND + 1)
+
+/** Fills px with n_rects random rectangles over a gradient (xorshift32) */
+static void fill(uint32_t* px, int w, int h, int n_rects) {
+  uint32_t rnd = 2463534242u;
+#define NEXT() (rnd ^= rnd << 13, rnd ^= rnd >> 17, rnd ^= rnd << 5, rnd)
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x)
+      px[y*w + x] = (x*255/w) << 16 | (y*255/h) << 8 | 0x40;
+  }
+  for (int i = 0; i < n_rects; ++i) {
+    int rw = NEXT() % (w/4) + 1, rh = NEXT() % (h/4) + 1;
+    int rx = NEXT() % (w - rw + 1), ry = NEXT() % (h - rh + 1);
+    uint32_t color = NEXT() & 0x00ffffff;
+    for (int y = ry; y < ry + rh; ++y) {
+      for (int x = rx; x < rx + rw; ++x)
+        px[y*w + x] = color;
+    }
+  }
+#undef NEXT
+}
+
+/** Average nanoseconds per call of kernel over the w x h image at px */
+static double run(void (*kernel)(const uint32_t*, int, int, int, uint32_t*),
+                  const uint32_t* px, int stride, int w, int h,
+                  uint32_t* out, int iterations) {
+  kernel(px, stride, w, h, out); // warm up
+  long long start = kpm__now_ns();
+  for (int i = 0; i < iterations; ++i)
+    kernel(px, stride, w, h, out);
+  return (kpm__now_ns() - start) / (double)iterations;
+}
+
+int main(int argc, char** argv) {
+  int w = 3840, h = 2160, iterations = 50, opt, failed = 0;
+  while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+    switch (opt) {
+      case 'n': iterations = atoi(optarg); break;
+      case 's':
+        if (sscanf(optarg, "%dx%d", &w, &h) != 2 || w < BAND || h < BAND)
+          goto usage;
+        break;
+      default:
+        goto usage;
+    }
+  }
+  if (iterations <= 0)
+    goto usage;
+
+  int n = w > h ? w : h;
+  uint32_t* px = malloc((size_t)w*h*sizeof(uint32_t));
+  uint32_t* ref_cols = malloc(n*sizeof(uint32_t));
+  uint32_t* ref_rows = malloc(n*sizeof(uint32_t));
+  uint32_t* out = malloc(n*sizeof(uint32_t));
+  if (!px || !ref_cols || !ref_rows || !out) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  fill(px, w, h, 200);
+  kpm_sn_set_impl(KPM_SN_SCALAR);
+  kpm_sn_cols(px, w, w, h, ref_cols);
+  kpm_sn_rows(px, w, w, h, ref_rows);
+
+  printf("%dx%d, %d iterations\n", w, h, iterations);
+  printf("%-8s %12s %12s %12s %12s\n", "impl", "cols ms", "rows ms",
+         "hstrip us", "vstrip us");
+  for (int impl = KPM_SN_SCALAR; impl <= KPM_SN_AVX2; ++impl) {
+    if (kpm_sn_set_impl(impl))
+      continue; // not supported by this CPU or build
+    double cols = run(&kpm_sn_cols, px, w, w, h, out, iterations);
+    if (memcmp(out, ref_cols, (w-1)*sizeof(uint32_t))) {
+      fprintf(stderr, "%s: kpm_sn_cols() mismatch\n", kpm_sn_impl_name(impl));
+      failed = 1;
+    }
+    double rows = run(&kpm_sn_rows, px, w, w, h, out, iterations);
+    if (memcmp(out, ref_rows, (h-1)*sizeof(uint32_t))) {
+      fprintf(stderr, "%s: kpm_sn_rows() mismatch\n", kpm_sn_impl_name(impl));
+      failed = 1;
+    }
+    const uint32_t* mid = px + (h/2 - BAND/2)*w;
+    double hstrip = run(&kpm_sn_cols, mid, w, w, BAND, out, iterations*100);
+    double vstrip = run(&kpm_sn_rows, px + w/2 - BAND/2, w, BAND, h, out,
+                        iterations*100);
+    printf("%-8s %12.3f %12.3f %12.2f %12.2f\n", kpm_sn_impl_name(impl),
+           cols/1e6, rows/1e6, hstrip/1e3, vstrip/1e3);
+  }
+
+  free(px);
+  free(ref_cols);
+  free(ref_rows);
+  free(out);
+  return failed;
+
+usage:
+  fprintf(stderr, "Usage: %s [-n ITERATIONS] [-s WxH]\n", argv[0]);
+  return 1;
+}
@@ -0,0 +1,47 @@
+#include "backend.h"
+#include <X11/Xlib.h>
+#include <string.h>
+#include <stdio.h>
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+/** Creates an async backend over the backend name, see kpm_be_new() */
+static kpm_be_t* new_async(const char* name, Display* dpy) {
+  Display* inner_dpy = XOpenDisplay(DisplayString(dpy));
+  if (!inner_dpy) {
+    fprintf(stderr, "Could not open a second connection to %s\n",
+            DisplayString(dpy));
+    return NULL;
+  }
+  kpm_be_t* inner = kpm_be_new(name, inner_dpy);
+  kpm_be_t* fg = inner ? kpm_be_new(name, dpy) : NULL;
+  if (!fg) {
+    kpm_be_destroy(inner);
+    XCloseDisplay(inner_dpy);
+    return NULL;
+  }
+  return kpm_be_async_new(inner, fg, inner_dpy);
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+kpm_be_t* kpm_be_new(const char* name, Display* dpy) {
+  size_t async_len = strlen(KPM_BE_ASYNC_PREFIX);
+  if (!strncmp(name, KPM_BE_ASYNC_PREFIX, async_len))
+    return new_async(name + async_len, dpy);
+  if (!strcmp(name, KPM_BE_XTEST))
+    return kpm_be_xtest_new(dpy);
+  if (!strcmp(name, KPM_BE_XDO))
+    return kpm_be_xdo_new(dpy);
+  if (!strcmp(name, KPM_BE_XI2))
+    return kpm_be_xi2_new(dpy, 0);
+  fprintf(stderr, "Unknown backend \"%s\". Valid backends: "
+          KPM_BE_XTEST ", " KPM_BE_XDO ", " KPM_BE_XI2 ", "
+          KPM_BE_ASYNC_PREFIX KPM_BE_XTEST ", " KPM_BE_ASYNC_PREFIX KPM_BE_XDO
+          "\n", name);
+  return NULL;
+}
@@ -0,0 +1,191 @@
+#ifndef _KPMOUSE_BACKEND_H_
+#define _KPMOUSE_BACKEND_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include "trace.h"
+
+////////////////////////////////////////////
+// Third paty forward declarations
+////////////////////////////////////////////
+
+typedef struct _XDisplay Display; //X11/Xlib.h
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+typedef struct kpm_be_s kpm_be_t;
+
+/**
+ * Operations of an injection backend. All operations return 0 on success or
+ * a non-zero error code. Operations that inject events (move and button) may
+ * buffer them until flush is called.
+ */
+typedef struct kpm_be_ops_s {
+  /** Name used to select the backend (see kpm_be_new()) */
+  const char* name;
+
+  /** Moves the pointer to the absolute position (x, y) of screen */
+  int (*move)(kpm_be_t* be, int x, int y, int screen);
+
+  /** Sends a button down (down != 0) or up event. button is 1-based */
+  int (*button)(kpm_be_t* be, int button, int down);
+
+  /** Queries the pointer position and screen (blocking) */
+  int (*query)(kpm_be_t* be, int* x, int* y, int* screen);
+
+  /** Gets the width and height of screen */
+  int (*viewport)(kpm_be_t* be, int screen, unsigned int* w, unsigned int* h);
+
+  /** Sends all buffered events */
+  int (*flush)(kpm_be_t* be);
+
+  /** Releases all resources and the backend object itself */
+  void (*destroy)(kpm_be_t* be);
+} kpm_be_ops_t;
+
+/**
+ * Base of all backends. Implementations have a kpm_be_t as their first
+ * member.
+ */
+struct kpm_be_s {
+  const kpm_be_ops_t* ops;
+
+  /** X display used by the backend, the ownership stays with the caller */
+  Display* dpy;
+};
+
+/** Name of the XTest over XCB backend */
+#define KPM_BE_XTEST "xtest"
+
+/** Name of the libxdo backend */
+#define KPM_BE_XDO "xdo"
+
+/** Name of the XInput2 backend, which drives a single master pointer */
+#define KPM_BE_XI2 "xi2"
+
+/** Name of the uinput backend */
+#define KPM_BE_UINPUT "uinput"
+
+/** Name of the trace backend */
+#define KPM_BE_TRACE "trace"
+
+/**
+ * Prefix that selects a backend injecting from a thread of its own, e.g.
+ * "async-xtest" (see kpm_be_async_new())
+ */
+#define KPM_BE_ASYNC_PREFIX "async-"
+
+/** Pointer action reported by the trace backend */
+typedef struct kpm_be_act_s {
+  /** 0 for a move, else the 1-based button pressed or released */
+  int button;
+  /** Pointer position (the move target, for moves) */
+  int x, y;
+  /** For buttons, non-zero if the button went down */
+  int down;
+} kpm_be_act_t;
+
+/** Receives every action injected into a trace backend */
+typedef void (*kpm_be_trace_cb_t)(void* data, const kpm_be_act_t* act);
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Creates the backend with the given name (KPM_BE_XTEST, KPM_BE_XDO or
+ * KPM_BE_XI2) on top of the already open dpy. If name is prefixed with
+ * KPM_BE_ASYNC_PREFIX, the backend injects over a second connection to the
+ * same display, from a thread of its own (see kpm_be_async_new()).
+ *
+ * @return the new backend, or NULL if name is unknown or an error occurred.
+ */
+kpm_be_t* kpm_be_new(const char* name, Display* dpy);
+
+/** Creates a backend that injects with XTest directly over XCB */
+kpm_be_t* kpm_be_xtest_new(Display* dpy);
+
+/**
+ * Creates a backend that drives the XInput2 master pointer with the device id
+ * master, or the client pointer if master is 0. Other master pointers (see
+ * mpx.h) are not affected.
+ */
+kpm_be_t* kpm_be_xi2_new(Display* dpy, int master);
+
+/** Creates a backend that injects through libxdo */
+kpm_be_t* kpm_be_xdo_new(Display* dpy);
+
+/**
+ * Creates a backend that writes pointer events to fd, which does not need to
+ * be a X display. If fd is a uinput device (/dev/uinput), a virtual pointer
+ * device is created on it, covering a w x h area. Else fd just receives the
+ * struct input_event records (e.g., fd is a pipe). Events are written with a
+ * single write() on flush.
+ *
+ * If absolute is non-zero, moves are ABS_X/ABS_Y events. Else moves are
+ * REL_X/REL_Y deltas from the last position.
+ *
+ * The ownership of fd is not transfered.
+ */
+kpm_be_t* kpm_be_uinput_new(int fd, unsigned int w, unsigned int h,
+                            int absolute);
+
+/**
+ * Creates a backend that injects nothing and passes every action to cb(data,
+ * act), if cb is not NULL. The pointer starts at the center of a single
+ * w x h screen. Used to run kpmouse without any display (see kpm_replay).
+ */
+kpm_be_t* kpm_be_trace_new(unsigned int w, unsigned int h,
+                           kpm_be_trace_cb_t cb, void* data);
+
+/**
+ * Creates a backend that queues moves and buttons into a lock-free
+ * single-producer/single-consumer ring, injected by inner from a dedicated
+ * thread. Pending moves followed by another move are dropped, only the
+ * newest target is injected. query and viewport are answered by fg, except
+ * that query returns the last queued move while it is not injected yet.
+ * Errors of inner are returned by a later flush.
+ *
+ * Only the thread that creates the backend may use it. inner and fg must not
+ * share a X connection. Takes ownership of inner, fg and inner_dpy (the
+ * connection of inner, may be NULL), even if it fails.
+ *
+ * @return the new backend, or NULL if an error occurred.
+ */
+kpm_be_t* kpm_be_async_new(kpm_be_t* inner, kpm_be_t* fg,
+                           Display* inner_dpy);
+
+static inline int kpm_be_move(kpm_be_t* be, int x, int y, int screen) {
+  kpm_tr(KPM_TR_WARP, screen, x, y, 0);
+  return be->ops->move(be, x, y, screen);
+}
+
+static inline int kpm_be_button(kpm_be_t* be, int button, int down) {
+  kpm_tr(KPM_TR_BUTTON, button, down, 0, 0);
+  return be->ops->button(be, button, down);
+}
+
+static inline int kpm_be_query(kpm_be_t* be, int* x, int* y, int* screen) {
+  return be->ops->query(be, x, y, screen);
+}
+
+static inline int kpm_be_viewport(kpm_be_t* be, int screen,
+                                  unsigned int* w, unsigned int* h) {
+  return be->ops->viewport(be, screen, w, h);
+}
+
+static inline int kpm_be_flush(kpm_be_t* be) {
+  return be->ops->flush(be);
+}
+
+static inline void kpm_be_destroy(kpm_be_t* be) {
+  if (be)
+    be->ops->destroy(be);
+}
+
+#endif /*_KPMOUSE_BACKEND_H_*/
@@ -0,0 +1,241 @@
+#include "backend.h"
+#include "errors.h"
+#include <X11/Xlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/** Capacity of the queue, must be a power of 2 */
+#define QUEUE_SIZE 256
+
+/** An injection waiting in the queue */
+typedef struct {
+  /** 0 for a move, else the 1-based button */
+  int button;
+  /** Move target, or the button state (down != 0) in x */
+  int x, y, screen;
+} cmd_t;
+
+/**
+ * Injects through inner from a thread of its own, so that a busy X server
+ * (or a synchronous libxdo call) never stalls the loop. move and button only
+ * append to a single-producer/single-consumer ring, flush wakes the injector
+ * thread. The injector drains the ring, skips moves superseded by a later
+ * move (not by a button, so clicks land where they were aimed) and flushes
+ * inner once per drain.
+ *
+ * When the ring is full, the loop thread sleeps until the injector made room.
+ *
+ * query and viewport are answered by fg, on the thread of the caller. inner
+ * and fg use distinct X connections, but Xlib still has process-wide state
+ * (e.g. the error handler), so kpmouse calls XInitThreads() when an async
+ * backend is selected.
+ */
+typedef struct {
+  kpm_be_t be;
+  kpm_be_t* inner;
+  kpm_be_t* fg;
+  /** Connection of inner, closed on destroy (may be NULL) */
+  Display* inner_dpy;
+  pthread_t thread;
+  sem_t wake;
+  /** Posted by the injector when it made room for a waiting producer */
+  sem_t space;
+  char running;
+
+  // written by the loop thread, read by the injector
+  uint64_t head __attribute__((aligned(64)));
+  char stop;
+  /** Set by the loop thread while it waits for space in the queue */
+  char full;
+  // only used by the loop thread
+  /** head on the last wakeup of the injector */
+  uint64_t posted;
+  /** head after the last queued move and its target */
+  uint64_t move_end;
+  int x, y, screen;
+
+  // written by the injector, read by the loop thread
+  uint64_t tail __attribute__((aligned(64)));
+  /** First injection error not yet reported by flush */
+  int err;
+
+  cmd_t q[QUEUE_SIZE];
+} be_async_t;
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static void push(be_async_t* ab, const cmd_t* cmd) {
+  uint64_t head = ab->head;
+  while (head - __atomic_load_n(&ab->tail, __ATOMIC_SEQ_CST) == QUEUE_SIZE) {
+    // full: the injector posts space on its next pass, which this wakes
+    __atomic_store_n(&ab->full, 1, __ATOMIC_SEQ_CST);
+    ab->posted = head;
+    sem_post(&ab->wake);
+    while (sem_wait(&ab->space) && errno == EINTR) continue;
+  }
+  ab->q[head & (QUEUE_SIZE-1)] = *cmd;
+  __atomic_store_n(&ab->head, head+1, __ATOMIC_RELEASE);
+}
+
+static void* run_injector(void* data) {
+  be_async_t* ab = data;
+  kpm_be_t* inner = ab->inner;
+  uint64_t tail = ab->tail;
+  for (;;) {
+    while (sem_wait(&ab->wake) && errno == EINTR) continue;
+    char stop = __atomic_load_n(&ab->stop, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n(&ab->head, __ATOMIC_ACQUIRE);
+    int err = KPM_SUCCESS;
+    if (tail != head) {
+      for (; tail != head; ++tail) {
+        const cmd_t* c = &ab->q[tail & (QUEUE_SIZE-1)];
+        if (!c->button && tail+1 != head
+            && !ab->q[(tail+1) & (QUEUE_SIZE-1)].button) {
+          continue; // superseded by the next move
+        }
+        int e = c->button ? inner->ops->button(inner, c->button, c->x)
+                          : inner->ops->move(inner, c->x, c->y, c->screen);
+        err = err ? err : e;
+      }
+      int e = inner->ops->flush(inner);
+      err = err ? err : e;
+      __atomic_store_n(&ab->tail, tail, __ATOMIC_SEQ_CST);
+    }
+    if (__atomic_exchange_n(&ab->full, 0, __ATOMIC_SEQ_CST))
+      sem_post(&ab->space);
+    if (err) {
+      int none = KPM_SUCCESS;
+      __atomic_compare_exchange_n(&ab->err, &none, err, 0, __ATOMIC_RELEASE,
+                                  __ATOMIC_RELAXED);
+    }
+    if (stop)
+      return NULL;
+  }
+}
+
+static int async_move(kpm_be_t* be, int x, int y, int screen) {
+  be_async_t* ab = (be_async_t*)be;
+  cmd_t cmd = {0, x, y, screen};
+  push(ab, &cmd);
+  ab->move_end = ab->head;
+  ab->x = x;
+  ab->y = y;
+  ab->screen = screen;
+  return KPM_SUCCESS;
+}
+
+static int async_button(kpm_be_t* be, int button, int down) {
+  cmd_t cmd = {button, down, 0, 0};
+  push((be_async_t*)be, &cmd);
+  return KPM_SUCCESS;
+}
+
+static int async_query(kpm_be_t* be, int* x, int* y, int* screen) {
+  be_async_t* ab = (be_async_t*)be;
+  if (__atomic_load_n(&ab->tail, __ATOMIC_ACQUIRE) < ab->move_end) {
+    *x = ab->x; // not injected yet, the server would answer a stale position
+    *y = ab->y;
+    *screen = ab->screen;
+    return KPM_SUCCESS;
+  }
+  return kpm_be_query(ab->fg, x, y, screen);
+}
+
+static int async_viewport(kpm_be_t* be, int screen,
+                          unsigned int* w, unsigned int* h) {
+  return kpm_be_viewport(((be_async_t*)be)->fg, screen, w, h);
+}
+
+static int async_flush(kpm_be_t* be) {
+  be_async_t* ab = (be_async_t*)be;
+  if (ab->posted != ab->head) {
+    ab->posted = ab->head;
+    sem_post(&ab->wake);
+  }
+  return __atomic_exchange_n(&ab->err, KPM_SUCCESS, __ATOMIC_ACQUIRE);
+}
+
+static void async_destroy(kpm_be_t* be) {
+  be_async_t* ab = (be_async_t*)be;
+  if (ab->running) {
+    __atomic_store_n(&ab->stop, 1, __ATOMIC_RELEASE);
+    sem_post(&ab->wake);
+    pthread_join(ab->thread, NULL);
+  }
+  sem_destroy(&ab->wake);
+  sem_destroy(&ab->space);
+  kpm_be_destroy(ab->inner);
+  kpm_be_destroy(ab->fg);
+  if (ab->inner_dpy)
+    XCloseDisplay(ab->inner_dpy);
+  free(ab);
+}
+
+static const kpm_be_ops_t async_ops = {
+  KPM_BE_ASYNC_PREFIX,
+  &async_move,
+  &async_button,
+  &async_query,
+  &async_viewport,
+  &async_flush,
+  &async_destroy
+};
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+kpm_be_t* kpm_be_async_new(kpm_be_t* inner, kpm_be_t* fg,
+                           Display* inner_dpy) {
+  be_async_t* ab = NULL;
+  if (posix_memalign((void**)&ab, 64, sizeof(be_async_t)))
+    ab = NULL;
+  if (ab && sem_init(&(ab->wake), 0, 0)) {
+    free(ab);
+    ab = NULL;
+  }
+  if (ab && sem_init(&(ab->space), 0, 0)) {
+    sem_destroy(&(ab->wake));
+    free(ab);
+    ab = NULL;
+  }
+  if (!ab) {
+    kpm_be_destroy(inner);
+    kpm_be_destroy(fg);
+    if (inner_dpy)
+      XCloseDisplay(inner_dpy);
+    return NULL;
+  }
+  ab->be.ops = &async_ops;
+  ab->be.dpy = fg->dpy;
+  ab->inner = inner;
+  ab->fg = fg;
+  ab->inner_dpy = inner_dpy;
+  ab->running = 0;
+  ab->head = ab->tail = ab->posted = ab->move_end = 0;
+  ab->stop = ab->full = 0;
+  ab->err = KPM_SUCCESS;
+
+  // signals other than faults are for the loop thread (and its signalfd)
+  sigset_t all, old;
+  sigfillset(&all);
+  sigdelset(&all, SIGSEGV);
+  sigdelset(&all, SIGBUS);
+  sigdelset(&all, SIGFPE);
+  sigdelset(&all, SIGILL);
+  sigdelset(&all, SIGABRT);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  ab->running = !pthread_create(&ab->thread, NULL, &run_injector, ab);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (!ab->running) {
+    async_destroy(&ab->be);
+    return NULL;
+  }
+  return &ab->be;
+}
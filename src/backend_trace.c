@@ -0,0 +1,87 @@
+#include "backend.h"
+#include "errors.h"
+#include <stdlib.h>
+
+typedef struct {
+  kpm_be_t be;
+  unsigned int w, h;
+  /** Last position moved to */
+  int x, y;
+  kpm_be_trace_cb_t cb;
+  void* data;
+} be_trace_t;
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static int trace_move(kpm_be_t* be, int x, int y, int screen) {
+  be_trace_t* tb = (be_trace_t*)be;
+  tb->x = x;
+  tb->y = y;
+  if (tb->cb) {
+    kpm_be_act_t act = {0, x, y, 0};
+    tb->cb(tb->data, &act);
+  }
+  return KPM_SUCCESS;
+}
+
+static int trace_button(kpm_be_t* be, int button, int down) {
+  be_trace_t* tb = (be_trace_t*)be;
+  if (tb->cb) {
+    kpm_be_act_t act = {button, tb->x, tb->y, down};
+    tb->cb(tb->data, &act);
+  }
+  return KPM_SUCCESS;
+}
+
+static int trace_query(kpm_be_t* be, int* x, int* y, int* screen) {
+  *x = ((be_trace_t*)be)->x;
+  *y = ((be_trace_t*)be)->y;
+  *screen = 0;
+  return KPM_SUCCESS;
+}
+
+static int trace_viewport(kpm_be_t* be, int screen,
+                          unsigned int* w, unsigned int* h) {
+  *w = ((be_trace_t*)be)->w;
+  *h = ((be_trace_t*)be)->h;
+  return KPM_SUCCESS;
+}
+
+static int trace_flush(kpm_be_t* be) {
+  return KPM_SUCCESS;
+}
+
+static void trace_destroy(kpm_be_t* be) {
+  free(be);
+}
+
+static const kpm_be_ops_t trace_ops = {
+  KPM_BE_TRACE,
+  &trace_move,
+  &trace_button,
+  &trace_query,
+  &trace_viewport,
+  &trace_flush,
+  &trace_destroy
+};
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+kpm_be_t* kpm_be_trace_new(unsigned int w, unsigned int h,
+                           kpm_be_trace_cb_t cb, void* data) {
+  be_trace_t* tb = calloc(1, sizeof(be_trace_t));
+  if (!tb)
+    return NULL;
+  tb->be.ops = &trace_ops;
+  tb->w = w;
+  tb->h = h;
+  tb->x = w/2;
+  tb->y = h/2;
+  tb->cb = cb;
+  tb->data = data;
+  return &tb->be;
+}
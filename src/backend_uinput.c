@@ -0,0 +1,175 @@
+#include "backend.h"
+#include "errors.h"
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+/** How many input events are buffered before a write() is forced */
+#define BUF_EVENTS 64
+
+typedef struct {
+  kpm_be_t be;
+  int fd;
+  char absolute;
+  /** Non-zero if a virtual device was created with UI_DEV_CREATE */
+  char created;
+  unsigned int w, h;
+  /** Last position sent */
+  int x, y;
+  struct input_event buf[BUF_EVENTS];
+  int n_buf;
+} be_uinput_t;
+
+static const int BUTTONS[] = {BTN_LEFT, BTN_MIDDLE, BTN_RIGHT};
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static int uinput_flush(kpm_be_t* be) {
+  be_uinput_t* ub = (be_uinput_t*)be;
+  const char* data = (const char*)ub->buf;
+  size_t size = ub->n_buf*sizeof(struct input_event);
+  ub->n_buf = 0;
+  while (size) {
+    ssize_t n = write(ub->fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("write(uinput)");
+      return KPM_ERR_UINPUT;
+    }
+    data += n;
+    size -= n;
+  }
+  return KPM_SUCCESS;
+}
+
+/** Buffers an event, writing the buffer if full */
+static int push(be_uinput_t* ub, int type, int code, int value) {
+  if (ub->n_buf == BUF_EVENTS)
+    KPM_RET(uinput_flush, &ub->be);
+  struct input_event* ev = &ub->buf[ub->n_buf++];
+  memset(ev, 0, sizeof(struct input_event));
+  ev->type = type;
+  ev->code = code;
+  ev->value = value;
+  return KPM_SUCCESS;
+}
+
+static int uinput_move(kpm_be_t* be, int x, int y, int screen) {
+  be_uinput_t* ub = (be_uinput_t*)be;
+  if (ub->absolute) {
+    KPM_RET(push, ub, EV_ABS, ABS_X, x);
+    KPM_RET(push, ub, EV_ABS, ABS_Y, y);
+  } else {
+    KPM_RET(push, ub, EV_REL, REL_X, x - ub->x);
+    KPM_RET(push, ub, EV_REL, REL_Y, y - ub->y);
+  }
+  ub->x = x;
+  ub->y = y;
+  return push(ub, EV_SYN, SYN_REPORT, 0);
+}
+
+static int uinput_button(kpm_be_t* be, int button, int down) {
+  if (button < 1 || button > 3)
+    return KPM_ERR_UINPUT;
+  KPM_RET(push, (be_uinput_t*)be, EV_KEY, BUTTONS[button-1], down ? 1 : 0);
+  return push((be_uinput_t*)be, EV_SYN, SYN_REPORT, 0);
+}
+
+static int uinput_query(kpm_be_t* be, int* x, int* y, int* screen) {
+  *x = ((be_uinput_t*)be)->x;
+  *y = ((be_uinput_t*)be)->y;
+  *screen = 0;
+  return KPM_SUCCESS;
+}
+
+static int uinput_viewport(kpm_be_t* be, int screen,
+                           unsigned int* w, unsigned int* h) {
+  *w = ((be_uinput_t*)be)->w;
+  *h = ((be_uinput_t*)be)->h;
+  return KPM_SUCCESS;
+}
+
+static void uinput_destroy(kpm_be_t* be) {
+  be_uinput_t* ub = (be_uinput_t*)be;
+  KPM_CHK(uinput_flush, be);
+  if (ub->created)
+    ioctl(ub->fd, UI_DEV_DESTROY);
+  free(ub);
+}
+
+static const kpm_be_ops_t uinput_ops = {
+  KPM_BE_UINPUT,
+  &uinput_move,
+  &uinput_button,
+  &uinput_query,
+  &uinput_viewport,
+  &uinput_flush,
+  &uinput_destroy
+};
+
+/** Sets up the virtual pointer, if ub->fd is an uinput device */
+static int create_device(be_uinput_t* ub) {
+  int fd = ub->fd;
+  if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0) {
+    if (errno == ENOTTY || errno == EINVAL)
+      return KPM_SUCCESS; // not an uinput device, just write events to it
+    perror("ioctl(UI_SET_EVBIT)");
+    return KPM_ERR_UINPUT;
+  }
+  for (int i = 0; i < 3; ++i)
+    KPM_RET2(KPM_ERR_UINPUT, ioctl, fd, UI_SET_KEYBIT, BUTTONS[i]);
+  if (ub->absolute) {
+    KPM_RET2(KPM_ERR_UINPUT, ioctl, fd, UI_SET_EVBIT, EV_ABS);
+    unsigned int max[2] = {ub->w-1, ub->h-1};
+    for (int axis = ABS_X; axis <= ABS_Y; ++axis) {
+      struct uinput_abs_setup abs;
+      memset(&abs, 0, sizeof(abs));
+      abs.code = axis;
+      abs.absinfo.maximum = max[axis-ABS_X];
+      KPM_RET2(KPM_ERR_UINPUT, ioctl, fd, UI_SET_ABSBIT, axis);
+      KPM_RET2(KPM_ERR_UINPUT, ioctl, fd, UI_ABS_SETUP, &abs);
+    }
+  } else {
+    KPM_RET2(KPM_ERR_UINPUT, ioctl, fd, UI_SET_EVBIT, EV_REL);
+    KPM_RET2(KPM_ERR_UINPUT, ioctl, fd, UI_SET_RELBIT, REL_X);
+    KPM_RET2(KPM_ERR_UINPUT, ioctl, fd, UI_SET_RELBIT, REL_Y);
+  }
+  struct uinput_setup setup;
+  memset(&setup, 0, sizeof(setup));
+  setup.id.bustype = BUS_VIRTUAL;
+  strncpy(setup.name, "kpmouse", UINPUT_MAX_NAME_SIZE-1);
+  KPM_RET2(KPM_ERR_UINPUT, ioctl, fd, UI_DEV_SETUP, &setup);
+  KPM_RET2(KPM_ERR_UINPUT, ioctl, fd, UI_DEV_CREATE);
+  ub->created = 1;
+  return KPM_SUCCESS;
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+kpm_be_t* kpm_be_uinput_new(int fd, unsigned int w, unsigned int h,
+                            int absolute) {
+  be_uinput_t* ub = calloc(1, sizeof(be_uinput_t));
+  if (!ub)
+    return NULL;
+  ub->be.ops = &uinput_ops;
+  ub->fd = fd;
+  ub->absolute = absolute;
+  ub->w = w;
+  ub->h = h;
+  ub->x = w/2;
+  ub->y = h/2;
+  if (KPM_CHK(create_device, ub)) {
+    free(ub);
+    return NULL;
+  }
+  return &ub->be;
+}
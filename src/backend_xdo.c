@@ -0,0 +1,72 @@
+#include "backend.h"
+#include "errors.h"
+#include <xdo.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+typedef struct {
+  kpm_be_t be;
+  xdo_t* xdo;
+} be_xdo_t;
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static int xdo_be_move(kpm_be_t* be, int x, int y, int screen) {
+  return xdo_move_mouse(((be_xdo_t*)be)->xdo, x, y, screen);
+}
+
+static int xdo_be_button(kpm_be_t* be, int button, int down) {
+  xdo_t* xdo = ((be_xdo_t*)be)->xdo;
+  if (down)
+    return xdo_mouse_down(xdo, CURRENTWINDOW, button);
+  return xdo_mouse_up(xdo, CURRENTWINDOW, button);
+}
+
+static int xdo_be_query(kpm_be_t* be, int* x, int* y, int* screen) {
+  return xdo_get_mouse_location(((be_xdo_t*)be)->xdo, x, y, screen);
+}
+
+static int xdo_be_viewport(kpm_be_t* be, int screen,
+                           unsigned int* w, unsigned int* h) {
+  return xdo_get_viewport_dimensions(((be_xdo_t*)be)->xdo, w, h, screen);
+}
+
+static int xdo_be_flush(kpm_be_t* be) {
+  return KPM_SUCCESS; // libxdo flushes on every call
+}
+
+static void xdo_be_destroy(kpm_be_t* be) {
+  xdo_free(((be_xdo_t*)be)->xdo);
+  free(be);
+}
+
+static const kpm_be_ops_t xdo_ops = {
+  KPM_BE_XDO,
+  &xdo_be_move,
+  &xdo_be_button,
+  &xdo_be_query,
+  &xdo_be_viewport,
+  &xdo_be_flush,
+  &xdo_be_destroy
+};
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+kpm_be_t* kpm_be_xdo_new(Display* dpy) {
+  be_xdo_t* be = calloc(1, sizeof(be_xdo_t));
+  if (!be)
+    return NULL;
+  be->be.ops = &xdo_ops;
+  be->be.dpy = dpy;
+  be->xdo = xdo_new_with_opened_display(dpy, NULL, 0);
+  if (!be->xdo) {
+    fprintf(stderr, "xdo_new_with_opened_display() failed\n");
+    free(be);
+    return NULL;
+  }
+  return &be->be;
+}
@@ -0,0 +1,118 @@
+#include "backend.h"
+#include "errors.h"
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+#include <X11/extensions/XInput2.h>
+#include <xcb/xtest.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * Drives a single master pointer: moves are XIWarpPointer requests on it and
+ * buttons are XTest requests, which the server sends through the XTest slave
+ * of the client pointer, so the client pointer is switched to master first.
+ * Like the xtest backend, nothing is sent before flush.
+ */
+typedef struct {
+  kpm_be_t be;
+  xcb_connection_t* c;
+  /** XI2 device id of the master pointer */
+  int master;
+} be_xi2_t;
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static int xi2_move(kpm_be_t* be, int x, int y, int screen) {
+  XIWarpPointer(be->dpy, ((be_xi2_t*)be)->master, None,
+                RootWindow(be->dpy, screen), 0, 0, 0, 0, x, y);
+  return KPM_SUCCESS;
+}
+
+static int xi2_button(kpm_be_t* be, int button, int down) {
+  be_xi2_t* xi2 = (be_xi2_t*)be;
+  // Xlib hands its buffer to XCB before the XTest request, keeping the order
+  XISetClientPointer(be->dpy, None, xi2->master);
+  xcb_test_fake_input(xi2->c, down ? XCB_BUTTON_PRESS : XCB_BUTTON_RELEASE,
+                      button, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+  return KPM_SUCCESS;
+}
+
+static int xi2_query(kpm_be_t* be, int* x, int* y, int* screen) {
+  Window root, child;
+  double root_x, root_y, win_x, win_y;
+  XIButtonState buttons;
+  XIModifierState mods;
+  XIGroupState group;
+  if (!XIQueryPointer(be->dpy, ((be_xi2_t*)be)->master,
+                      DefaultRootWindow(be->dpy), &root, &child, &root_x,
+                      &root_y, &win_x, &win_y, &buttons, &mods, &group)) {
+    return KPM_ERR_XCB_CONN;
+  }
+  XFree(buttons.mask);
+  *x = root_x;
+  *y = root_y;
+  *screen = DefaultScreen(be->dpy);
+  for (int i = 0; i < ScreenCount(be->dpy); ++i) {
+    if (RootWindow(be->dpy, i) == root)
+      *screen = i;
+  }
+  return KPM_SUCCESS;
+}
+
+static int xi2_viewport(kpm_be_t* be, int screen,
+                        unsigned int* w, unsigned int* h) {
+  *w = DisplayWidth(be->dpy, screen);
+  *h = DisplayHeight(be->dpy, screen);
+  return KPM_SUCCESS;
+}
+
+static int xi2_flush(kpm_be_t* be) {
+  XFlush(be->dpy); // flushes the XCB requests as well
+  if (xcb_connection_has_error(((be_xi2_t*)be)->c))
+    return KPM_ERR_XCB_CONN;
+  return KPM_SUCCESS;
+}
+
+static void xi2_destroy(kpm_be_t* be) {
+  free(be);
+}
+
+static const kpm_be_ops_t xi2_ops = {
+  KPM_BE_XI2,
+  &xi2_move,
+  &xi2_button,
+  &xi2_query,
+  &xi2_viewport,
+  &xi2_flush,
+  &xi2_destroy
+};
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+kpm_be_t* kpm_be_xi2_new(Display* dpy, int master) {
+  int opcode, ev_base, err_base, major = 2, minor = 0;
+  if (!XQueryExtension(dpy, "XTEST", &opcode, &ev_base, &err_base)
+      || !XQueryExtension(dpy, "XInputExtension", &opcode, &ev_base,
+                          &err_base)
+      || XIQueryVersion(dpy, &major, &minor) != Success) {
+    fprintf(stderr, "X server does not support the XTEST and XInput2 "
+            "extensions\n");
+    return NULL;
+  }
+  if (!master && !XIGetClientPointer(dpy, None, &master)) {
+    fprintf(stderr, "Could not get the client pointer\n");
+    return NULL;
+  }
+  be_xi2_t* be = calloc(1, sizeof(be_xi2_t));
+  if (!be)
+    return NULL;
+  be->be.ops = &xi2_ops;
+  be->be.dpy = dpy;
+  be->c = XGetXCBConnection(dpy);
+  be->master = master;
+  return &be->be;
+}
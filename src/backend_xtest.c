@@ -0,0 +1,99 @@
+#include "backend.h"
+#include "errors.h"
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xtest.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * Injects with XTest requests written directly on the XCB connection of the
+ * display. Requests are unchecked and are only sent by flush, so there is no
+ * round trip per injected event.
+ */
+typedef struct {
+  kpm_be_t be;
+  xcb_connection_t* c;
+} be_xtest_t;
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static int xtest_move(kpm_be_t* be, int x, int y, int screen) {
+  xcb_test_fake_input(((be_xtest_t*)be)->c, XCB_MOTION_NOTIFY, 0,
+                      XCB_CURRENT_TIME, RootWindow(be->dpy, screen), x, y, 0);
+  return KPM_SUCCESS;
+}
+
+static int xtest_button(kpm_be_t* be, int button, int down) {
+  xcb_test_fake_input(((be_xtest_t*)be)->c,
+                      down ? XCB_BUTTON_PRESS : XCB_BUTTON_RELEASE, button,
+                      XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+  return KPM_SUCCESS;
+}
+
+static int xtest_query(kpm_be_t* be, int* x, int* y, int* screen) {
+  xcb_connection_t* c = ((be_xtest_t*)be)->c;
+  xcb_query_pointer_cookie_t cookie;
+  cookie = xcb_query_pointer(c, DefaultRootWindow(be->dpy));
+  xcb_query_pointer_reply_t* reply = xcb_query_pointer_reply(c, cookie, NULL);
+  if (!reply)
+    return KPM_ERR_XCB_CONN;
+  *x = reply->root_x;
+  *y = reply->root_y;
+  *screen = DefaultScreen(be->dpy);
+  for (int i = 0; i < ScreenCount(be->dpy); ++i) {
+    if (RootWindow(be->dpy, i) == reply->root)
+      *screen = i;
+  }
+  free(reply);
+  return KPM_SUCCESS;
+}
+
+static int xtest_viewport(kpm_be_t* be, int screen,
+                          unsigned int* w, unsigned int* h) {
+  *w = DisplayWidth(be->dpy, screen);
+  *h = DisplayHeight(be->dpy, screen);
+  return KPM_SUCCESS;
+}
+
+static int xtest_flush(kpm_be_t* be) {
+  xcb_connection_t* c = ((be_xtest_t*)be)->c;
+  if (xcb_flush(c) <= 0 || xcb_connection_has_error(c))
+    return KPM_ERR_XCB_CONN;
+  return KPM_SUCCESS;
+}
+
+static void xtest_destroy(kpm_be_t* be) {
+  free(be);
+}
+
+static const kpm_be_ops_t xtest_ops = {
+  KPM_BE_XTEST,
+  &xtest_move,
+  &xtest_button,
+  &xtest_query,
+  &xtest_viewport,
+  &xtest_flush,
+  &xtest_destroy
+};
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+kpm_be_t* kpm_be_xtest_new(Display* dpy) {
+  int opcode, ev_base, err_base;
+  if (!XQueryExtension(dpy, "XTEST", &opcode, &ev_base, &err_base)) {
+    fprintf(stderr, "X server does not support the XTEST extension\n");
+    return NULL;
+  }
+  be_xtest_t* be = calloc(1, sizeof(be_xtest_t));
+  if (!be)
+    return NULL;
+  be->be.ops = &xtest_ops;
+  be->be.dpy = dpy;
+  be->c = XGetXCBConnection(dpy);
+  return &be->be;
+}
@@ -0,0 +1,73 @@
+#include "chord.h"
+#include "state.h"
+#include "user_config.h"
+#include <string.h>
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+void kpm_ch_init(kpm_ch_t* ch, unsigned int window_ms) {
+  memset(ch, 0, sizeof(kpm_ch_t));
+  ch->window_ms = window_ms;
+  if (!window_ms)
+    return;
+  for (int i = 0; i < KPM_PAGE_CHORDS; ++i) {
+    kpm_action_t a = KPM_ACT_MOVE + kpm_page_chords[i][0];
+    kpm_action_t b = KPM_ACT_MOVE + kpm_page_chords[i][1];
+    ch->result[a][b] = ch->result[b][a] = KPM_CH_PAGE + kpm_page_chords[i][2];
+    ch->starts[a] = ch->starts[b] = 1;
+  }
+  if (KPM_CHORD_DRAG) {
+    for (int m = KPM_ACT_MOVE; m < KPM_ACT_MOVE + 8; ++m) {
+      for (int b = KPM_ACT_BUTTON; b < KPM_ACT_BUTTON + 3; ++b)
+        ch->result[m][b] = KPM_CH_DRAG;
+      ch->starts[m] = 1;
+    }
+  }
+  if (KPM_MACROS) {
+    for (int m = 0; m < 8; ++m)
+      ch->result[KPM_ACT_UNDO][KPM_ACT_MOVE + m] = KPM_CH_MACRO + m;
+    ch->result[KPM_ACT_UNDO][KPM_ACT_BUTTON + KPM_M] = KPM_CH_RECORD;
+    ch->starts[KPM_ACT_UNDO] = 1;
+  }
+}
+
+int kpm_ch_feed(kpm_ch_t* ch, KeyCode code, kpm_action_t action, int press,
+                long int now_ms) {
+  for (int i = 0; i < 2; ++i) {
+    if (ch->eat[i] && ch->eat[i] == code) {
+      if (!press)
+        ch->eat[i] = 0;
+      return KPM_CH_EAT;
+    }
+  }
+  if (!press) {
+    if (code == ch->first_code)
+      ch->first_code = 0;
+    return KPM_CH_PASS;
+  }
+  if (code == ch->first_code)
+    return KPM_CH_PASS; // autorepeat
+  unsigned char result = ch->result[ch->first][action];
+  if (ch->first_code && result && now_ms - ch->first_ms < ch->window_ms) {
+    ch->chord_code[0] = ch->first_code;
+    ch->chord_code[1] = code;
+    ch->chord_action[0] = ch->first;
+    ch->chord_action[1] = action;
+    if (result != KPM_CH_DRAG) { // a drag goes on with the keys held
+      ch->eat[0] = ch->first_code;
+      ch->eat[1] = code;
+    }
+    ch->first_code = 0;
+    return result;
+  }
+  if (ch->window_ms && ch->starts[action]) {
+    ch->first_code = code;
+    ch->first = action;
+    ch->first_ms = now_ms;
+    return KPM_CH_ARM;
+  }
+  ch->first_code = 0;
+  return KPM_CH_PASS;
+}
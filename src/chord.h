@@ -0,0 +1,76 @@
+#ifndef _KPMOUSE_CHORD_H_
+#define _KPMOUSE_CHORD_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include "keymap.h"
+#include <X11/X.h>
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/* vvvvvvvvvvvvvvvvv Results of kpm_ch_feed() vvvvvvvvvvvvvvvvvvvvvvv */
+#define KPM_CH_PASS 0x00 ///< handle the key event as usual
+#define KPM_CH_ARM  0x01 ///< as usual, but it may be undone by a chord
+#define KPM_CH_EAT  0x02 ///< event of a chord key, ignore it
+#define KPM_CH_PAGE 0x10 ///< + kpm_move_t: page the pointer that way
+#define KPM_CH_DRAG 0x20 ///< drag along the move with the button
+#define KPM_CH_MACRO  0x30 ///< + kpm_move_t: store or play that macro
+#define KPM_CH_RECORD 0x40 ///< start or cancel recording a macro
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/**
+ * Recognizes chords, two keys pressed together, on the stream of key events.
+ * A chord is the press of a second key while the first is held, less than
+ * window_ms after the first press. The first key is not delayed: it is
+ * handled as usual (speculatively) and undone if the chord completes.
+ *
+ * The automaton has a single state, the key that may start a chord, and a
+ * table of the chord of each (first, second) pair of actions.
+ */
+typedef struct kpm_ch_s {
+  /** result[a][b]: chord of pressing b while holding a, or KPM_CH_PASS */
+  unsigned char result[KPM_ACT_N][KPM_ACT_N];
+  /** Non-zero if an action is the first of some chord */
+  char starts[KPM_ACT_N];
+  unsigned int window_ms;
+
+  /** Key that may start a chord (0 if none), its action and press time */
+  KeyCode first_code;
+  kpm_action_t first;
+  long int first_ms;
+
+  /** KeyCodes and actions of the last chord, first key first */
+  KeyCode chord_code[2];
+  kpm_action_t chord_action[2];
+
+  /** Keys of the last chord whose events are eaten until released */
+  KeyCode eat[2];
+} kpm_ch_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Builds the chord table from user_config.h (kpm_page_chords,
+ * KPM_CHORD_DRAG and KPM_MACROS). window_ms of 0 disables all chords.
+ */
+void kpm_ch_init(kpm_ch_t* ch, unsigned int window_ms);
+
+/**
+ * Feeds a key event, with the action bound to the key (KPM_ACT_NONE if it
+ * must not take part in chords), at now_ms.
+ *
+ * @return a KPM_CH_ result. For chords (KPM_CH_PAGE, KPM_CH_DRAG,
+ *         KPM_CH_MACRO and KPM_CH_RECORD), the keys are in ch->chord_code
+ *         and ch->chord_action.
+ */
+int kpm_ch_feed(kpm_ch_t* ch, KeyCode code, kpm_action_t action, int press,
+                long int now_ms);
+
+#endif /*_KPMOUSE_CHORD_H_*/
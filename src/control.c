@@ -0,0 +1,216 @@
+#include "control.h"
+#include "errors.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+/** Length of the argument of an opcode, or -1 if unknown */
+static int arg_len(unsigned char op) {
+  switch (op) {
+    case KPM_CT_NOP:
+    case KPM_CT_UNMOVE:
+    case KPM_CT_RESET:
+      return 0;
+    case KPM_CT_MOVE:
+    case KPM_CT_DOWN:
+    case KPM_CT_UP:
+    case KPM_CT_CLICK:
+      return 1;
+    default:
+      return -1;
+  }
+}
+
+static int apply(kpm_ct_client_t* c, unsigned char op, unsigned char arg) {
+  kpm_el_t* el = c->ct->el;
+  switch (op) {
+    case KPM_CT_NOP:
+      return KPM_SUCCESS;
+    case KPM_CT_MOVE:
+      if (arg >= KPM_NULL_MOVE)
+        return KPM_ERR_CONTROL;
+      return kpm_el_move(el, arg);
+    case KPM_CT_UNMOVE:
+      return kpm_el_unmove(el);
+    case KPM_CT_RESET:
+      return kpm_el_reset(el);
+    default:
+      if (arg >= KPM_NULL_BUTTON)
+        return KPM_ERR_CONTROL;
+      if (op == KPM_CT_UP)
+        return kpm_el_button(el, arg, 0, c);
+      KPM_RET(kpm_el_button, el, arg, 1, c);
+      return op == KPM_CT_CLICK ? kpm_el_button(el, arg, 0, c) : KPM_SUCCESS;
+  }
+}
+
+static void close_client(kpm_ct_client_t* c) {
+  kpm_el_t* el = c->ct->el;
+  if (el->pressed_button != KPM_NULL_BUTTON && el->button_owner == c) {
+    // a client that went away does not leave its button down
+    if (!KPM_CHK(kpm_el_button, el, el->pressed_button, 0, c))
+      KPM_CHK(kpm_el_flush, el);
+  }
+  kpm_lp_del(el->lp, c->fd);
+  close(c->fd);
+  c->fd = -1;
+  c->len = 0;
+}
+
+static int on_client_readable(void* data) {
+  kpm_ct_client_t* c = data;
+  unsigned char replies[KPM_CT_BUF];
+  size_t n_replies = 0;
+  ssize_t n = read(c->fd, c->in + c->len, sizeof(c->in) - c->len);
+  if (n < 0 && (errno == EAGAIN || errno == EINTR))
+    return KPM_SUCCESS;
+  if (n <= 0) {
+    close_client(c); // EOF or error
+    return KPM_SUCCESS;
+  }
+  c->len += n;
+  long used = kpm_ct_apply(c, c->in, c->len, replies, &n_replies);
+  // a single flush for the whole batch, failures are fatal as for keys
+  KPM_RET(kpm_el_flush, c->ct->el);
+  if (n_replies && send(c->fd, replies, n_replies, MSG_DONTWAIT|MSG_NOSIGNAL)
+                   != (ssize_t)n_replies) {
+    used = -1; // not reading its replies, drop it
+  }
+  if (used < 0) {
+    close_client(c);
+    return KPM_SUCCESS;
+  }
+  c->len -= used;
+  memmove(c->in, c->in + used, c->len);
+  return KPM_SUCCESS;
+}
+
+static int on_accept(void* data) {
+  kpm_ct_t* ct = data;
+  int fd = accept(ct->fd, NULL, NULL);
+  if (fd < 0)
+    return KPM_SUCCESS; // the client gave up already
+  kpm_ct_client_t* c = NULL;
+  for (int i = 0; !c && i < KPM_CT_MAX_CLIENTS; ++i)
+    c = ct->clients[i].fd < 0 ? &ct->clients[i] : NULL;
+  if (!c || fcntl(fd, F_SETFL, O_NONBLOCK)
+      || fcntl(fd, F_SETFD, FD_CLOEXEC)
+      || KPM_CHK(kpm_lp_add, ct->el->lp, fd, &on_client_readable, NULL, c)) {
+    close(fd);
+    return KPM_SUCCESS;
+  }
+  c->fd = fd;
+  c->len = 0;
+  return KPM_SUCCESS;
+}
+
+/** Non-zero if some process listens on the socket at addr */
+static int is_listening(const struct sockaddr_un* addr) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return 0;
+  int ok = !connect(fd, (const struct sockaddr*)addr, sizeof(*addr));
+  close(fd);
+  return ok;
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+const char* kpm_ct_path(char* buf, int size) {
+  const char *env = getenv("KPM_SOCKET"), *dir = getenv("XDG_RUNTIME_DIR");
+  if (env)
+    return *env ? env : NULL;
+  if (!dir || !*dir)
+    return NULL;
+  return snprintf(buf, size, "%s/kpmouse.sock", dir) < size ? buf : NULL;
+}
+
+int kpm_ct_init(kpm_ct_t* ct, kpm_el_t* el, const char* path) {
+  struct sockaddr_un addr;
+  memset(ct, 0, sizeof(kpm_ct_t));
+  ct->el = el;
+  ct->fd = -1;
+  for (int i = 0; i < KPM_CT_MAX_CLIENTS; ++i) {
+    ct->clients[i].ct = ct;
+    ct->clients[i].fd = -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Control socket path too long: %s\n", path);
+    return KPM_ERR_CONTROL;
+  }
+  strcpy(addr.sun_path, path);
+  if ((ct->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+      || fcntl(ct->fd, F_SETFL, O_NONBLOCK)
+      || fcntl(ct->fd, F_SETFD, FD_CLOEXEC)) {
+    perror("control socket");
+    goto fail;
+  }
+  if (bind(ct->fd, (struct sockaddr*)&addr, sizeof(addr))) {
+    if (errno != EADDRINUSE || is_listening(&addr)) {
+      perror(path);
+      goto fail;
+    }
+    unlink(path); // stale, left by a process that died
+    if (bind(ct->fd, (struct sockaddr*)&addr, sizeof(addr))) {
+      perror(path);
+      goto fail;
+    }
+  }
+  strcpy(ct->path, path);
+  if (listen(ct->fd, KPM_CT_MAX_CLIENTS)) {
+    perror(path);
+    goto fail;
+  }
+  if (KPM_CHK(kpm_lp_add, el->lp, ct->fd, &on_accept, NULL, ct))
+    goto fail;
+  return KPM_SUCCESS;
+
+fail:
+  kpm_ct_destroy(ct);
+  return KPM_ERR_CONTROL;
+}
+
+void kpm_ct_destroy(kpm_ct_t* ct) {
+  for (int i = 0; i < KPM_CT_MAX_CLIENTS; ++i) {
+    if (ct->clients[i].fd >= 0)
+      close_client(&ct->clients[i]);
+  }
+  if (ct->fd >= 0) {
+    kpm_lp_del(ct->el->lp, ct->fd);
+    close(ct->fd);
+    ct->fd = -1;
+  }
+  if (*ct->path)
+    unlink(ct->path);
+  *ct->path = '\0';
+}
+
+long kpm_ct_apply(kpm_ct_client_t* c, const unsigned char* buf, size_t len,
+                  unsigned char* replies, size_t* n_replies) {
+  size_t i = 0;
+  *n_replies = 0;
+  while (i < len) {
+    int n_arg = arg_len(buf[i]);
+    if (n_arg < 0)
+      return -1;
+    if (i + 1 + n_arg > len)
+      break; // incomplete
+    int err = apply(c, buf[i], n_arg ? buf[i+1] : 0);
+    replies[(*n_replies)++] = err > 255 ? 255 : err;
+    i += 1 + n_arg;
+  }
+  return i;
+}
@@ -0,0 +1,109 @@
+#ifndef _KPMOUSE_CONTROL_H_
+#define _KPMOUSE_CONTROL_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include "event_loop.h"
+#include <stddef.h>
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/** Maximum number of simultaneous control clients */
+#define KPM_CT_MAX_CLIENTS 4
+
+/**
+ * Bytes read from a client per wakeup of the loop. This bounds how much work
+ * a batch does before the loop gets back to the keypad.
+ */
+#define KPM_CT_BUF 512
+
+/*
+ * The protocol is a stream of commands, each one an opcode byte followed by
+ * its argument byte, if any. Clients may pipeline as many commands as they
+ * want: all complete commands received in a read are applied as a batch,
+ * with a single flush at the end.
+ *
+ * kpmouse answers each command with one byte, in order: 0 on success, or
+ * the KPM_ERR_ code of the failure (KPM_ERR_CONTROL for bad commands or
+ * arguments). Clients must read the replies, a client whose replies cannot
+ * be written without blocking is disconnected, as is a client that sends
+ * an unknown opcode.
+ */
+/* vvvvvvvvvvvvvvvvvvvvvv Control protocol opcodes vvvvvvvvvvvvvvvvvvvvvv */
+#define KPM_CT_NOP    0x00 ///< only replies, e.g. to wait for a batch
+#define KPM_CT_MOVE   0x01 ///< arg: kpm_move_t, like kpm_el_move()
+#define KPM_CT_UNMOVE 0x02 ///< like kpm_el_unmove()
+#define KPM_CT_RESET  0x03 ///< like kpm_el_reset()
+#define KPM_CT_DOWN   0x04 ///< arg: kpm_button_t, button down
+#define KPM_CT_UP     0x05 ///< arg: kpm_button_t, button up
+#define KPM_CT_CLICK  0x06 ///< arg: kpm_button_t, button down and up
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+typedef struct kpm_ct_s kpm_ct_t;
+
+/** A connected client */
+typedef struct kpm_ct_client_s {
+  kpm_ct_t* ct;
+  /** Socket, or -1 if this slot is free */
+  int fd;
+  /** Bytes of an incomplete command, kept for the next read */
+  size_t len;
+  unsigned char in[KPM_CT_BUF];
+} kpm_ct_client_t;
+
+/**
+ * Unix domain socket that lets external programs move the pointer and press
+ * buttons through kpm_el_t, served by the loop of the kpm_el_t.
+ */
+struct kpm_ct_s {
+  kpm_el_t* el;
+  /** Listening socket */
+  int fd;
+  /** Path of the socket, unlinked on kpm_ct_destroy() */
+  char path[108];
+  kpm_ct_client_t clients[KPM_CT_MAX_CLIENTS];
+};
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Path of the control socket: the KPM_SOCKET environment variable, or
+ * $XDG_RUNTIME_DIR/kpmouse.sock. The returned pointer is either buf or
+ * getenv() memory.
+ *
+ * @return the path, or NULL if there is no control socket (KPM_SOCKET is
+ *         empty or there is no XDG_RUNTIME_DIR)
+ */
+const char* kpm_ct_path(char* buf, int size);
+
+/**
+ * Listens on a Unix domain socket at path, registered on the loop of el. A
+ * stale socket file (no one listening) is replaced.
+ * @return 0 if successful, or an error code
+ */
+int kpm_ct_init(kpm_ct_t* ct, kpm_el_t* el, const char* path);
+
+/** Disconnects all clients, closes and unlinks the socket */
+void kpm_ct_destroy(kpm_ct_t* ct);
+
+/**
+ * Applies the complete commands in buf[0..len-1] of client c on its kpm_el_t
+ * and writes one reply byte per command to replies (which must hold len
+ * bytes). Buttons are pressed on behalf of c (see kpm_el_button()), and
+ * released when c disconnects. Nothing is flushed.
+ *
+ * @return the number of bytes consumed (an incomplete command at the end is
+ *         not consumed), or -1 if an unknown opcode was found. *n_replies
+ *         is set in both cases.
+ */
+long kpm_ct_apply(kpm_ct_client_t* c, const unsigned char* buf, size_t len,
+                  unsigned char* replies, size_t* n_replies);
+
+#endif /*_KPMOUSE_CONTROL_H_*/
@@ -0,0 +1,167 @@
+#include "displays.h"
+#include "errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+/**
+ * Called by Xlib once the connection of dp is lost. Returning (instead of
+ * exiting, which is the default) leaves the Display in an error state where
+ * requests are no-ops, so the other displays keep being served.
+ */
+static void on_io_error(Display* dpy, void* data) {
+  kpm_dp_t* dp = data;
+  if (!dp->dead)
+    fprintf(stderr, "Lost connection to display %s\n", dp->name);
+  dp->dead = 1;
+}
+
+/** Non-zero if the connection of dp is gone, as seen by Xlib or XCB */
+static int is_dead(kpm_dp_t* dp) {
+  if (!dp->dead && xcb_connection_has_error(XGetXCBConnection(dp->dpy)))
+    on_io_error(dp->dpy, dp);
+  return dp->dead;
+}
+
+static int find(const kpm_dm_t* dm, const char* name) {
+  for (int i = 0; i < dm->n; ++i) {
+    if (!strcmp(dm->dp[i]->name, name))
+      return i;
+  }
+  return -1;
+}
+
+/**
+ * Reads the display names of the file at dm->path into names.
+ * @return number of names, or -1 if the file cannot be read
+ */
+static int read_names(const kpm_dm_t* dm,
+                      char names[KPM_DM_MAX_DISPLAYS][64]) {
+  FILE* in = fopen(dm->path, "r");
+  char line[256];
+  int n = 0;
+  if (!in) {
+    perror(dm->path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), in)) {
+    char* save = NULL;
+    char* name = strtok_r(line, " \t\r\n", &save);
+    if (!name || *name == '#')
+      continue;
+    if (n == KPM_DM_MAX_DISPLAYS) {
+      fprintf(stderr, "%s: more than %d displays, ignoring %s\n", dm->path,
+              KPM_DM_MAX_DISPLAYS, name);
+      continue;
+    }
+    snprintf(names[n++], 64, "%s", name);
+  }
+  fclose(in);
+  return n;
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+int kpm_dm_init(kpm_dm_t* dm, kpm_lp_t* lp, kpm_lat_t* lat,
+                const char* be_name, const char* path) {
+  memset(dm, 0, sizeof(kpm_dm_t));
+  dm->lp = lp;
+  dm->lat = lat;
+  dm->be_name = be_name;
+  if (snprintf(dm->path, sizeof(dm->path), "%s", path)
+      >= (int)sizeof(dm->path)) {
+    return KPM_ERR_DISPLAYS;
+  }
+  return kpm_dm_reload(dm);
+}
+
+void kpm_dm_destroy(kpm_dm_t* dm) {
+  while (dm->n)
+    kpm_dm_detach(dm, dm->n-1);
+}
+
+int kpm_dm_attach(kpm_dm_t* dm, const char* name) {
+  if (dm->n == KPM_DM_MAX_DISPLAYS)
+    return KPM_ERR_DISPLAYS;
+  kpm_dp_t* dp = calloc(1, sizeof(kpm_dp_t));
+  if (!dp)
+    return KPM_ERR_DISPLAYS;
+  snprintf(dp->name, sizeof(dp->name), "%s", name);
+  if (!(dp->dpy = XOpenDisplay(name))) {
+    fprintf(stderr, "Could not open display %s\n", name);
+    free(dp);
+    return KPM_ERR_OPEN_DISPLAY;
+  }
+  XSetIOErrorExitHandler(dp->dpy, &on_io_error, dp);
+  int err = KPM_ERR_BACKEND_NEW;
+  if ((dp->be = kpm_be_new(dm->be_name, dp->dpy))
+      && !(err = KPM_CHK(kpm_st_init, &dp->st, dp->be))) {
+    if (!(err = KPM_CHK(kpm_el_init, &dp->el, &dp->st, dm->lp, dm->lat))) {
+      dm->dp[dm->n++] = dp;
+      fprintf(stderr, "Attached display %s\n", name);
+      return KPM_SUCCESS;
+    }
+    kpm_el_destroy(&dp->el);
+    kpm_st_destroy(&dp->st);
+  }
+  if (dp->be)
+    kpm_be_destroy(dp->be);
+  XCloseDisplay(dp->dpy);
+  free(dp);
+  return err;
+}
+
+void kpm_dm_detach(kpm_dm_t* dm, int i) {
+  kpm_dp_t* dp = dm->dp[i];
+  kpm_el_destroy(&dp->el);
+  kpm_st_destroy(&dp->st);
+  kpm_be_destroy(dp->be);
+  XCloseDisplay(dp->dpy);
+  fprintf(stderr, "Detached display %s\n", dp->name);
+  free(dp);
+  dm->dp[i] = dm->dp[--dm->n];
+}
+
+int kpm_dm_reload(kpm_dm_t* dm) {
+  static char names[KPM_DM_MAX_DISPLAYS][64];
+  int n = read_names(dm, names);
+  if (n < 0)
+    return KPM_ERR_DISPLAYS;
+  for (int i = dm->n-1; i >= 0; --i) {
+    int listed = 0;
+    for (int j = 0; !listed && j < n; ++j)
+      listed = !strcmp(dm->dp[i]->name, names[j]);
+    if (!listed)
+      kpm_dm_detach(dm, i);
+    else
+      KPM_CHK(kpm_el_reload, &dm->dp[i]->el);
+  }
+  for (int j = 0; j < n; ++j) {
+    if (find(dm, names[j]) < 0)
+      KPM_CHK(kpm_dm_attach, dm, names[j]);
+  }
+  return KPM_SUCCESS;
+}
+
+int kpm_dm_run(kpm_dm_t* dm) {
+  for (;;) {
+    int err = kpm_lp_step(dm->lp);
+    for (int i = dm->n-1; i >= 0; --i) {
+      if (!is_dead(dm->dp[i]))
+        continue;
+      if (dm->lp->failed == &dm->dp[i]->el)
+        err = KPM_SUCCESS; // failed because its X server went away
+      kpm_dm_detach(dm, i);
+    }
+    if (err)
+      return err;
+  }
+}
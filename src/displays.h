@@ -0,0 +1,96 @@
+#ifndef _KPMOUSE_DISPLAYS_H_
+#define _KPMOUSE_DISPLAYS_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include "state.h"
+#include "event_loop.h"
+#include "loop.h"
+#include "latency.h"
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/** Maximum number of displays served by a kpm_dm_t */
+#define KPM_DM_MAX_DISPLAYS 100
+
+/**
+ * A display served by a kpm_dm_t: its X connection, backend and kpmouse
+ * state. Has a fixed size and is allocated once per attach.
+ */
+typedef struct kpm_dp_s {
+  /** Display name, as given to XOpenDisplay() */
+  char name[64];
+  Display* dpy;
+  kpm_be_t* be;
+  kpm_st_t st;
+  kpm_el_t el;
+  /** Set by the Xlib I/O error handler once the connection is lost */
+  char dead;
+} kpm_dp_t;
+
+/**
+ * Serves many X displays from a single process and loop, as on terminal
+ * servers: each display gets its own kpm_dp_t, all driven by the same
+ * kpm_lp_t and latency histograms.
+ *
+ * The displays are listed, one name per line, in a file. Displays are
+ * attached and detached to follow it on kpm_dm_reload(), and a display
+ * whose X server goes away is detached without affecting the others.
+ */
+typedef struct kpm_dm_s {
+  kpm_lp_t* lp;
+  kpm_lat_t* lat;
+  /** Backend name given to kpm_be_new() */
+  const char* be_name;
+  /** File with the display names */
+  char path[1024];
+  int n;
+  kpm_dp_t* dp[KPM_DM_MAX_DISPLAYS];
+} kpm_dm_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Attaches the displays listed in the file at path. Displays that cannot be
+ * opened are skipped (and retried on kpm_dm_reload()).
+ * @return 0 if successful, or an error code
+ */
+int kpm_dm_init(kpm_dm_t* dm, kpm_lp_t* lp, kpm_lat_t* lat,
+                const char* be_name, const char* path);
+
+/** Detaches all displays */
+void kpm_dm_destroy(kpm_dm_t* dm);
+
+/**
+ * Opens the display name and starts serving it.
+ * @return 0 if successful, or an error code
+ */
+int kpm_dm_attach(kpm_dm_t* dm, const char* name);
+
+/** Stops serving the display at index i and closes its connection */
+void kpm_dm_detach(kpm_dm_t* dm, int i);
+
+/**
+ * Re-reads the display file: attaches displays added to it (or that failed
+ * before), detaches the ones removed and reloads the key bindings of all
+ * others (see kpm_el_reload()).
+ * @return 0 if successful, or an error code
+ */
+int kpm_dm_reload(kpm_dm_t* dm);
+
+/**
+ * Runs the loop. Displays whose connection is lost are detached and the
+ * loop goes on, other errors (including those of the remaining displays)
+ * stop it.
+ * @return Error code that stopped the loop
+ */
+int kpm_dm_run(kpm_dm_t* dm);
+
+#endif /*_KPMOUSE_DISPLAYS_H_*/
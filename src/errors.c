@@ -1,4 +1,5 @@
 #include "errors.h"
+#include "trace.h"
 #include <stdio.h>
 
 int kpm__report(int is_bool, int overide_err, int err,
@@ -6,11 +7,13 @@ int kpm__report(int is_bool, int overide_err, int err,
                 const char* file, int line, const char* caller) {
   if (is_bool) {
     if (!err) {
+      kpm_tr(KPM_TR_ERROR, 0, line, 0, overide_err);
       fprintf(stderr, "%s(%s) return false at %s:%d (%s)\n",
               fn_name, args, file, line, caller);
       return overide_err;
     }
   } else if (err) {
+    kpm_tr(KPM_TR_ERROR, 0, line, 0, err);
     fprintf(stderr, "%s(%s) failed with code %d at %s:%d (%s)\n",
             fn_name, args, err, file, line, caller);
     return overide_err ? overide_err : err;
@@ -7,17 +7,35 @@
 
 /* vvvvvvvvvvvvvvvvvvvvvvvvvv Error codes vvvvvvvvvvvvvvvvvvvvvvvvvv */
 #define KPM_SUCCESS            0
-#define KPM_ERR_XDO_NEW        1
-#define KPM_ERR_XDO_VIEWPORT   2
+#define KPM_ERR_BACKEND_NEW    1
+#define KPM_ERR_VIEWPORT       2
 #define KPM_ERR_NO_KEYCODE     3
-#define KPM_ERR_XDO_GET_MOUSE  4
-#define KPM_ERR_XDO_MOVE_MOUSE 5
-#define KPM_ERR_XDO_MOUSE_DOWN 6
-#define KPM_ERR_XDO_MOUSE_UP   7
+#define KPM_ERR_GET_MOUSE      4
+#define KPM_ERR_MOVE_MOUSE     5
+#define KPM_ERR_MOUSE_DOWN     6
+#define KPM_ERR_MOUSE_UP       7
 #define KPM_ERR_X_GRAB         8
 #define KPM_ERR_X_SEL_INPUT    9
 #define KPM_ERR_X_NEXT_EVT     10
 #define KPM_ERR_GETTIME        11
+#define KPM_ERR_XI_SELECT      12
+#define KPM_ERR_EPOLL          13
+#define KPM_ERR_TIMERFD        14
+#define KPM_ERR_XCB_CONN       15
+#define KPM_ERR_OPEN_DISPLAY   16
+#define KPM_ERR_UINPUT         17
+#define KPM_ERR_EVDEV          18
+#define KPM_ERR_SIGNALFD       19
+#define KPM_ERR_CONFIG         20
+#define KPM_ERR_OVERLAY        21
+#define KPM_ERR_SNAP           22
+#define KPM_ERR_HISTORY        23
+#define KPM_ERR_CONTROL        24
+#define KPM_ERR_DISPLAYS       25
+#define KPM_ERR_TRACE          26
+#define KPM_ERR_MACRO          27
+#define KPM_ERR_STATUS         28
+#define KPM_ERR_MPX            29
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
 ////////////////////////////////////////////
@@ -25,8 +43,8 @@
 ////////////////////////////////////////////
 
 /**
- * If err != 0 print a log message and return overide_err (or err if
- * overide_err==0). Else return 0.
+ * If err != 0 print a log message, record it in the trace ring (see trace.h)
+ * and return overide_err (or err if overide_err==0). Else return 0.
  *
  * If is_bool is non-zero, then override_err will be returned if err==0
  */
@@ -0,0 +1,112 @@
+#include "evdev.h"
+#include "errors.h"
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+
+/** How many events are read with a single read() */
+#define READ_EVENTS 64
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+/** Records the state of key code and feeds it to the event loop */
+static int feed_key(kpm_ev_t* ev, int code, int press, int64_t input_ns) {
+  if (press)
+    ev->keys[code/8] |= 1 << (code%8);
+  else
+    ev->keys[code/8] &= ~(1 << (code%8));
+  if (ev->el->lat)
+    kpm_lat_begin(ev->el->lat, input_ns);
+  return kpm_el_key(ev->el, code + 8, press, 0);
+}
+
+/** Feeds the keys whose state changed while events were dropped */
+static int resync(kpm_ev_t* ev) {
+  unsigned char keys[sizeof(ev->keys)];
+  memset(keys, 0, sizeof(keys));
+  if (ioctl(ev->fd, EVIOCGKEY(sizeof(keys)), keys) < 0
+      && errno != ENOTTY && errno != EINVAL) {
+    perror("ioctl(EVIOCGKEY)");
+    return KPM_ERR_EVDEV;
+  } // else: not an evdev device, all keys are released
+  for (int code = 0; code < 256-8; ++code) {
+    int was = ev->keys[code/8] >> (code%8) & 1;
+    int is = keys[code/8] >> (code%8) & 1;
+    if (was != is)
+      KPM_RET(feed_key, ev, code, is, 0);
+  }
+  return KPM_SUCCESS;
+}
+
+static int on_readable(void* data) {
+  kpm_ev_t* ev = data;
+  const size_t size = sizeof(struct input_event);
+  unsigned char buf[(READ_EVENTS+1)*sizeof(struct input_event)];
+  memcpy(buf, ev->partial, ev->n_partial);
+  ssize_t n = read(ev->fd, buf + ev->n_partial, READ_EVENTS*size);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EINTR)
+      return KPM_SUCCESS;
+    perror("read(evdev)");
+    return KPM_ERR_EVDEV;
+  } else if (n == 0) {
+    fprintf(stderr, "evdev input closed\n");
+    return KPM_ERR_EVDEV;
+  }
+  size_t len = ev->n_partial + n, n_evs = len/size;
+  ev->n_partial = len%size;
+  memcpy(ev->partial, buf + n_evs*size, ev->n_partial);
+
+  for (size_t i = 0; i < n_evs; ++i) {
+    struct input_event e;
+    memcpy(&e, buf + i*size, size); // buf is not aligned for input_event
+    if (e.type == EV_SYN && e.code == SYN_DROPPED) {
+      ev->dropped = 1;
+    } else if (ev->dropped) {
+      if (e.type == EV_SYN && e.code == SYN_REPORT) {
+        ev->dropped = 0;
+        KPM_RET(resync, ev);
+      }
+    } else if (e.type == EV_KEY && e.code < 256-8) {
+      // value is 0 for release, 1 for press and 2 for autorepeat
+      int64_t ns = ev->monotonic ? e.time.tv_sec*1000000000LL
+                                   + e.time.tv_usec*1000LL : 0;
+      KPM_RET(feed_key, ev, e.code, e.value != 0, ns);
+    }
+  }
+  return KPM_CHK(kpm_el_flush, ev->el);
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+int kpm_ev_init(kpm_ev_t* ev, kpm_el_t* el, int fd) {
+  memset(ev, 0, sizeof(kpm_ev_t));
+  ev->el = el;
+  ev->fd = fd;
+  int clock = CLOCK_MONOTONIC;
+  ev->monotonic = ioctl(fd, EVIOCSCLOCKID, &clock) == 0;
+  if (ioctl(fd, EVIOCGRAB, 1) == 0) {
+    ev->grabbed = 1;
+  } else if (errno != ENOTTY && errno != EINVAL) {
+    perror("ioctl(EVIOCGRAB)");
+    return KPM_ERR_EVDEV;
+  } // else: not an evdev device, just read events from it
+  return kpm_lp_add(el->lp, fd, &on_readable, NULL, ev);
+}
+
+void kpm_ev_destroy(kpm_ev_t* ev) {
+  if (!ev->el)
+    return; // never initialized
+  kpm_lp_del(ev->el->lp, ev->fd);
+  if (ev->grabbed)
+    ioctl(ev->fd, EVIOCGRAB, 0);
+  ev->grabbed = 0;
+}
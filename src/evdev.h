@@ -0,0 +1,63 @@
+#ifndef _KPMOUSE_EVDEV_H_
+#define _KPMOUSE_EVDEV_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include "event_loop.h"
+#include <linux/input.h>
+#include <stddef.h>
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/**
+ * Reads key events from an evdev device (or anything that delivers struct
+ * input_event records, such as a pipe) and feeds them to an event loop that
+ * has no X display.
+ *
+ * A record split across reads (pipes do not keep record boundaries) is
+ * completed by the next read. When the kernel drops events (SYN_DROPPED),
+ * everything up to the next SYN_REPORT is ignored and the pressed keys are
+ * compared with the device state (EVIOCGKEY): a press or release is fed for
+ * each key that changed meanwhile. Without EVIOCGKEY (e.g. a pipe), all
+ * keys are taken as released.
+ */
+typedef struct kpm_ev_s {
+  kpm_el_t* el;
+  int fd;
+  /** Non-zero if the device was grabbed with EVIOCGRAB */
+  char grabbed;
+  /** Non-zero if event timestamps are CLOCK_MONOTONIC (EVIOCSCLOCKID) */
+  char monotonic;
+  /** Non-zero from a SYN_DROPPED until the next SYN_REPORT */
+  char dropped;
+  /** Bytes of an incomplete record, kept for the next read */
+  size_t n_partial;
+  unsigned char partial[sizeof(struct input_event)];
+  /** Bitmap of the keys fed as pressed, by evdev code */
+  unsigned char keys[(KEY_MAX+1)/8];
+} kpm_ev_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Grabs fd for exclusive access (if it is an evdev device) and registers it
+ * on el->lp. The ownership of fd is not transfered.
+ *
+ * @return 0 if successful, or an error code
+ */
+int kpm_ev_init(kpm_ev_t* ev, kpm_el_t* el, int fd);
+
+/**
+ * Unregisters and ungrabs the device. Does not close the fd. Has no effect on
+ * a zero-filled ev.
+ */
+void kpm_ev_destroy(kpm_ev_t* ev);
+
+#endif /*_KPMOUSE_EVDEV_H_*/
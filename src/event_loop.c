@@ -1,45 +1,54 @@
 #include "event_loop.h"
 #include "state.h"
 #include "util.h"
+#include "grab.h"
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
-#include <xdo.h>
+#include <X11/XKBlib.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
-static const int N_MOD_MASKS = 1<<(Mod5MapIndex+1);
-
 ////////////////////////////////////
 // private functions
 ////////////////////////////////////
 
-static kpm_move_t to_move(kpm_el_t* el, KeyCode code) {
-  for (int i = 0; i < 8; ++i)
-    if (el->move_code[i] == code)
-      return i;
+static kpm_move_t to_move(kpm_action_t action) {
+  if (action >= KPM_ACT_MOVE && action < KPM_ACT_MOVE + 8)
+    return action - KPM_ACT_MOVE;
+  if (action == KPM_ACT_CENTER)
+    return KPM_CC;
   return KPM_NULL_MOVE;
 }
 
-static kpm_button_t to_button(kpm_el_t* el, KeyCode code) {
-  for (int i = 0; i < 6; ++i)
-    if (el->button_code[i] == code)
-      return i%3;
+static kpm_button_t to_button(kpm_action_t action) {
+  if (action >= KPM_ACT_BUTTON && action < KPM_ACT_BUTTON + 3)
+    return action - KPM_ACT_BUTTON;
   return KPM_NULL_BUTTON;
 }
 
+/** Adds the pointer position or a button event to the macro recording */
+static void record_step(kpm_el_t* el, int type, kpm_button_t button) {
+  if (!el->mc->recording)
+    return;
+  kpm_mc_step_t step = {type, button, el->st->ptr_x, el->st->ptr_y,
+                        el->st->ptr_screen};
+  kpm_mc_add(el->mc, &step);
+}
+
 static int send_mouse(kpm_el_t* el, kpm_button_t button, char down) {
-#ifndef NDEBUG
-  printf("send_mouse(%d, %s)\n", button, down ? "DOWN" : "UP");
-#endif
+  KPM_RET(kpm_st_anim_finish, el->st); // click at the target, not midway
+  KPM_RET(kpm_st_commit, el->st);
+  record_step(el, KPM_MC_MOVE, 0);
+  record_step(el, down ? KPM_MC_DOWN : KPM_MC_UP, button);
   if (down) {
-
-    return KPM_CHK2(KPM_ERR_XDO_MOUSE_DOWN, xdo_mouse_down,
-                    el->st->xdo, CURRENTWINDOW, button+1);
+    kpm_st_click(el->st, button);
+    return KPM_CHK2(KPM_ERR_MOUSE_DOWN, kpm_be_button,
+                    el->st->be, button+1, 1);
   } else {
-    return KPM_CHK2(KPM_ERR_XDO_MOUSE_DOWN, xdo_mouse_up,
-                    el->st->xdo, CURRENTWINDOW, button+1);
+    return KPM_CHK2(KPM_ERR_MOUSE_UP, kpm_be_button,
+                    el->st->be, button+1, 0);
   }
 }
 
@@ -47,15 +56,17 @@ static int handle_button(kpm_el_t* el, kpm_button_t button, int press) {
   if (press) {
     if (el->pressed_button == KPM_NULL_BUTTON) {
       el->pressed_button = button;
-      KPM_CHK2(KPM_ERR_GETTIME, clock_gettime,
-               CLOCK_MONOTONIC, &el->press_ts);
+      el->button_owner = NULL;
+      el->long_press = 0;
+      kpm_lp_arm(el->lp, &el->long_press_tm, el->long_press_ms);
       KPM_RET(send_mouse, el, button, 1); //send "down"
-    } else if (kpm__ms_elapsed(&el->press_ts) > el->long_press_ms) {
+    } else if (el->long_press) {
       KPM_RET(send_mouse, el, el->pressed_button, 0); // long press, send "up"
       el->pressed_button = KPM_NULL_BUTTON;
     } // else: ignore second button in double press
   } else if (el->pressed_button != KPM_NULL_BUTTON) {
-    if (kpm__ms_elapsed(&el->press_ts) < el->long_press_ms) {
+    if (!el->long_press) {
+      kpm_lp_disarm(el->lp, &el->long_press_tm);
       KPM_RET(send_mouse, el, el->pressed_button, 0); //clicked, send "up"
       el->pressed_button = KPM_NULL_BUTTON;
     } // else: started a long press, do not send up
@@ -63,27 +74,371 @@ static int handle_button(kpm_el_t* el, kpm_button_t button, int press) {
   return KPM_SUCCESS;
 }
 
-static int setup_codes(kpm_el_t* el) {
-  for (int i = 0; i < 8; ++i) {
-    el->move_code[i] = XKeysymToKeycode(el->st->xdo->xdpy, kpm_move_sym[i]);
-    if (!el->move_code[i]) {
-      fprintf(stderr, "No KeyCode for KeySym %lx of move %d\n",
-              kpm_move_sym[i], i);
-      return KPM_ERR_NO_KEYCODE;
+/** Publishes the status of el and its kpm_st_t, if there is a status page */
+static void publish_status(kpm_el_t* el) {
+  const kpm_st_t* st = el->st;
+  kpm_sp_status_t s;
+  if (!el->status)
+    return;
+  memset(&s, 0, sizeof(s)); // compared as bytes, padding included
+  s.mode = !st->log_steps ? KPM_SP_IDLE
+         : (st->log_steps < st->max_log_steps ? KPM_SP_LOG : KPM_SP_LINEAR);
+  s.log_steps = st->log_steps;
+  s.max_log_steps = st->max_log_steps;
+  s.grid = st->grid;
+  s.button = el->pressed_button;
+  s.long_press = el->pressed_button != KPM_NULL_BUTTON && el->long_press;
+  s.gliding = st->gliding;
+  s.recording = el->mc->recording;
+  s.ptr_x = st->ptr_x;
+  s.ptr_y = st->ptr_y;
+  s.ptr_screen = st->ptr_screen;
+  if (s.mode != KPM_SP_IDLE) {
+    s.win_x = st->log_x - (int)st->w/2;
+    s.win_y = st->log_y - (int)st->h/2;
+    s.win_w = st->w;
+    s.win_h = st->h;
+  }
+  if (s.mode != KPM_SP_IDLE && el->ttl_tm.armed)
+    s.expire_ms = el->ttl_tm.deadline;
+  kpm_sp_publish(el->status, &s);
+}
+
+static int on_long_press(void* data) {
+  kpm_el_t* el = data;
+  el->long_press = 1;
+  publish_status(el);
+  return KPM_SUCCESS;
+}
+
+static int on_move_ttl(void* data) {
+  kpm_el_t* el = data;
+  kpm_st_expire(el->st);
+  if (el->overlay)
+    kpm_ov_update(&el->ov, el->st);
+  publish_status(el);
+  return KPM_SUCCESS;
+}
+
+static int on_frame(void* data) {
+  kpm_el_t* el = data;
+  KPM_RET(kpm_st_anim_step, el->st, kpm_lp_now(el->lp));
+  KPM_RET(kpm_el_flush, el);
+  if (el->st->animating)
+    kpm_lp_rearm(el->lp, &el->frame_tm, el->st->frame_ms);
+  return KPM_SUCCESS;
+}
+
+/** What the modifiers held with a movement key turn it into */
+enum {HELD_NONE, HELD_MONITOR, HELD_SNAP};
+
+/**
+ * A modifier mask is held when all its bits are. If both KPM_MONITOR_MOD and
+ * KPM_SNAP_MOD are, the one that includes the other wins, so that Super+Shift
+ * snaps while Super alone jumps to another monitor.
+ */
+static int held_mods(unsigned int mods) {
+  unsigned int monitor = KPM_MONITOR_MOD, snap = KPM_SNAP_MOD;
+  char is_monitor = monitor && (mods & monitor) == monitor;
+  char is_snap = snap && (mods & snap) == snap;
+  if (is_monitor && is_snap)
+    return (snap & monitor) == monitor ? HELD_SNAP : HELD_MONITOR;
+  return is_snap ? HELD_SNAP : is_monitor ? HELD_MONITOR : HELD_NONE;
+}
+
+/** Starts the frame timer if a move started an animation */
+static void schedule_frame(kpm_el_t* el) {
+  if (el->st->animating && !el->frame_tm.armed)
+    kpm_lp_arm(el->lp, &el->frame_tm, el->st->frame_ms);
+}
+
+static int on_glide(void* data) {
+  kpm_el_t* el = data;
+  KPM_RET(kpm_st_glide_step, el->st, kpm_lp_now(el->lp));
+  KPM_RET(kpm_el_flush, el);
+  if (el->st->gliding)
+    kpm_lp_rearm(el->lp, &el->glide_tm, el->st->glide_tick_ms);
+  return KPM_SUCCESS;
+}
+
+/**
+ * Handles movement key events. Autorepeats of a held key in linear mode are
+ * coalesced into a glide, which moves on its own timer until the release.
+ */
+static int handle_move(kpm_el_t* el, kpm_move_t move, KeyCode code,
+                       int press) {
+  long int now = kpm_lp_now(el->lp);
+  if (!press) {
+    if (code == el->held_code) {
+      el->held_code = 0;
+      if (el->st->gliding) {
+        kpm_st_glide_stop(el->st, now);
+        kpm_lp_disarm(el->lp, &el->glide_tm);
+        kpm_lp_arm(el->lp, &el->ttl_tm, el->st->move_ttl_ms);
+      }
     }
+    return KPM_SUCCESS;
+  }
+  if (code == el->held_code) { // autorepeat
+    if (el->st->gliding)
+      return KPM_SUCCESS; // coalesced into the glide
+    if (kpm_st_glide_start(el->st, move, now)) {
+      kpm_lp_disarm(el->lp, &el->ttl_tm);
+      kpm_lp_arm(el->lp, &el->glide_tm, el->st->glide_tick_ms);
+      return KPM_SUCCESS;
+    }
+  } else if (el->st->gliding) { // another key pressed while gliding
+    kpm_st_glide_stop(el->st, now);
+    kpm_lp_disarm(el->lp, &el->glide_tm);
+  }
+  el->held_code = code;
+  kpm_lp_arm(el->lp, &el->ttl_tm, el->st->move_ttl_ms);
+  KPM_RET(kpm_st_move, el->st, move, now);
+  schedule_frame(el);
+  return KPM_SUCCESS;
+}
+
+/**
+ * Stops any glide and forgets the held movement key before a move that does
+ * not come from handle_move(). The move will expire after the TTL.
+ */
+static void take_over(kpm_el_t* el, long int now) {
+  kpm_st_glide_stop(el->st, now);
+  kpm_lp_disarm(el->lp, &el->glide_tm);
+  el->held_code = 0;
+  kpm_lp_arm(el->lp, &el->ttl_tm, el->st->move_ttl_ms);
+}
+
+static void lat_dispatch(kpm_el_t* el, int action) {
+  if (el->lat)
+    kpm_lat_dispatch(el->lat, action);
+}
+
+static void lat_computed(kpm_el_t* el) {
+  if (el->lat)
+    kpm_lat_computed(el->lat);
+}
+
+/** Injects a macro step, without flushing */
+static int play_step(kpm_el_t* el, const kpm_mc_step_t* step) {
+  if (step->type == KPM_MC_MOVE) {
+    KPM_RET(kpm_st_goto, el->st, step->x, step->y, step->screen);
+  } else if (step->type == KPM_MC_DOWN) {
+    KPM_RET(kpm_st_commit, el->st);
+    KPM_RET2(KPM_ERR_MOUSE_DOWN, kpm_be_button, el->st->be, step->button+1, 1);
+  } else {
+    KPM_RET(kpm_st_commit, el->st);
+    KPM_RET2(KPM_ERR_MOUSE_UP, kpm_be_button, el->st->be, step->button+1, 0);
+  }
+  record_step(el, step->type, step->button); // macros can record macros
+  return KPM_SUCCESS;
+}
+
+static int on_macro_step(void* data) {
+  kpm_el_t* el = data;
+  if (!el->playing || el->play_next >= el->playing->n) {
+    el->playing = NULL; // its slot was stored over
+    return KPM_SUCCESS;
   }
-  for (int i = 0; i < 6; ++i) {
-    el->button_code[i] = XKeysymToKeycode(el->st->xdo->xdpy, kpm_button_sym[i]);
-    if (!el->button_code[i]) {
-      fprintf(stderr, "No KeyCode for KeySym %lx of mouse button %d\n",
-              kpm_move_sym[i], i);
-      return KPM_ERR_NO_KEYCODE;
+  KPM_RET(play_step, el, &el->playing->steps[el->play_next]);
+  KPM_RET(kpm_el_flush, el);
+  if (++el->play_next < el->playing->n)
+    kpm_lp_rearm(el->lp, &el->macro_tm, KPM_MACRO_PACE_MS);
+  else
+    el->playing = NULL;
+  return KPM_SUCCESS;
+}
+
+/**
+ * Plays a macro. Without pacing, all steps are injected now and sent by the
+ * next flush, in a single batch: moves between buttons collapse into the
+ * last one (see kpm_st_commit()).
+ */
+static int play_macro(kpm_el_t* el, const kpm_mc_macro_t* macro) {
+  kpm_lp_disarm(el->lp, &el->macro_tm);
+  el->playing = NULL;
+  kpm_lp_disarm(el->lp, &el->ttl_tm); // the macro terminates the movement
+  if (!KPM_MACRO_PACE_MS) {
+    for (int i = 0; i < macro->n; ++i)
+      KPM_RET(play_step, el, &macro->steps[i]);
+    return KPM_SUCCESS;
+  }
+  if (macro->n) {
+    el->playing = macro;
+    el->play_next = 0;
+    return on_macro_step(el);
+  }
+  return KPM_SUCCESS;
+}
+
+/** Starts or cancels a recording, stores it or plays a macro */
+static int handle_macro(kpm_el_t* el, int chord) {
+  kpm_mc_t* mc = el->mc;
+  if (chord == KPM_CH_RECORD) {
+    if (mc->recording) {
+      mc->recording = 0;
+      fprintf(stderr, "Macro recording cancelled\n");
+    } else {
+      kpm_mc_record(mc);
     }
+    return KPM_SUCCESS;
+  }
+  int slot = chord - KPM_CH_MACRO;
+  if (mc->recording) {
+    KPM_CHK(kpm_mc_store, mc, slot); // kept in memory even if not saved
+    return KPM_SUCCESS;
   }
-  el->undo_code = XKeysymToKeycode(el->st->xdo->xdpy, KPM_UNDO_SYM);
-  if (!el->undo_code) {
-    fprintf(stderr, "No KeyCode for KeySym %x of undo key\n", KPM_UNDO_SYM);
-    return KPM_ERR_NO_KEYCODE;
+  return play_macro(el, &mc->slot[slot]);
+}
+
+/**
+ * Does a chord completed by kpm_ch_feed(). The first key of the chord was
+ * handled as usual, which is taken back first.
+ */
+static int handle_chord(kpm_el_t* el, int chord) {
+  long int now = kpm_lp_now(el->lp);
+  const kpm_ch_t* ch = &el->ch;
+  kpm_tr(KPM_TR_CHORD, chord, ch->chord_code[0], ch->chord_code[1], 0);
+  lat_dispatch(el, KPM_LAT_MOVE);
+  take_over(el, now);
+  KPM_RET(kpm_st_restore, el->st, now);
+  if (chord >= KPM_CH_MACRO) {
+    KPM_RET(handle_macro, el, chord);
+  } else if (chord == KPM_CH_DRAG) {
+    KPM_RET(handle_button, el, to_button(ch->chord_action[1]), 1);
+    KPM_RET(kpm_st_move, el->st, to_move(ch->chord_action[0]), now);
+    el->held_code = ch->chord_code[0]; // holding it glides, dragging on
+  } else {
+    KPM_RET(kpm_st_page, el->st, chord - KPM_CH_PAGE, now);
+  }
+  schedule_frame(el);
+  lat_computed(el);
+  return KPM_SUCCESS;
+}
+
+/**
+ * Grabs the KeyCodes that gained an action and ungrabs those that lost it,
+ * comparing old (the previous dispatch table) with el->km.action.
+ */
+static int apply_grabs(kpm_el_t* el, const kpm_action_t* old) {
+  KeyCode grab[256], ungrab[256];
+  int n_grab = 0, n_ungrab = 0, err = KPM_SUCCESS;
+  if (!el->st->dpy)
+    return KPM_SUCCESS;
+  for (int code = 0; code < 256; ++code) {
+    char was = old[code] != KPM_ACT_NONE;
+    char is = el->km.action[code] != KPM_ACT_NONE;
+    if (was && !is)
+      ungrab[n_ungrab++] = code;
+    else if (is && !was)
+      grab[n_grab++] = code;
+  }
+  if (el->device) {
+    if (n_ungrab) {
+      err = KPM_CHK(kpm_grab_device_keys, el->st->dpy, el->device, ungrab,
+                    n_ungrab, 0);
+    }
+    if (n_grab) {
+      err = KPM_CHK(kpm_grab_device_keys, el->st->dpy, el->device, grab,
+                    n_grab, 1);
+    }
+    return err;
+  }
+  if (n_ungrab)
+    err = KPM_CHK(kpm_grab_keys, el->st->dpy, ungrab, n_ungrab, 0);
+  if (n_grab)
+    err = KPM_CHK(kpm_grab_keys, el->st->dpy, grab, n_grab, 1);
+  return err;
+}
+
+/** Rebuilds the dispatch table for the current keyboard mapping */
+static int rebuild_keymap(kpm_el_t* el) {
+  kpm_action_t old[256];
+  memcpy(old, el->km.action, sizeof(old));
+  el->km_dirty = 0;
+  kpm_km_build(&el->km, el->st->dpy);
+  return apply_grabs(el, old);
+}
+
+/**
+ * Marks the dispatch table for rebuilding on core or XKB keyboard mapping
+ * changes. Returns non-zero if ev was such a change.
+ */
+static int handle_mapping(kpm_el_t* el, XEvent* ev) {
+  if (ev->type == MappingNotify) {
+    if (ev->xmapping.request == MappingPointer)
+      return 1;
+    XRefreshKeyboardMapping(&ev->xmapping);
+  } else if (el->xkb_event_base < 0 || ev->type != el->xkb_event_base) {
+    return 0;
+  } else {
+    XkbEvent* xkb = (XkbEvent*)ev;
+    if (xkb->any.xkb_type == XkbMapNotify)
+      XkbRefreshKeyboardMapping(&xkb->map);
+    else if (xkb->any.xkb_type != XkbNewKeyboardNotify)
+      return 1;
+  }
+  el->km_dirty = 1; // rebuilt once, after the whole batch of events
+  return 1;
+}
+
+/** Processes all events that can be read without blocking */
+static int on_x_readable(void* data) {
+  kpm_el_t* el = data;
+  Display* dpy = el->st->dpy;
+  while (XPending(dpy)) {
+    XEvent ev = {0};
+    KPM_RET2(KPM_ERR_X_NEXT_EVT, XNextEvent, dpy, &ev);
+    if (el->lat && (ev.type == KeyPress || ev.type == KeyRelease))
+      kpm_lat_begin(el->lat, kpm__x_time_ns(ev.xkey.time));
+    KPM_RET(kpm_el_event, el, &ev);
+  }
+  return KPM_CHK(kpm_el_flush, el); // a single flush for all events
+}
+
+/** Xlib may have read events into its queue while waiting for a reply */
+static int x_pending(void* data) {
+  return XQLength(((kpm_el_t*)data)->st->dpy) > 0;
+}
+
+/** Selects XKB keyboard replacement and mapping change events */
+static void select_xkb_events(kpm_el_t* el) {
+  int opcode, err_base, major = XkbMajorVersion, minor = XkbMinorVersion;
+  unsigned int mask = XkbNewKeyboardNotifyMask|XkbMapNotifyMask;
+  if (!XkbQueryExtension(el->st->dpy, &opcode, &el->xkb_event_base,
+                         &err_base, &major, &minor)) {
+    el->xkb_event_base = -1;
+    return;
+  }
+  XkbSelectEvents(el->st->dpy, XkbUseCoreKbd, mask, mask);
+}
+
+/** Sets up key grabs and event delivery on the X display of el->st */
+static int init_x(kpm_el_t* el) {
+  Display* dpy = el->st->dpy;
+  select_xkb_events(el);
+  int n_screens = el->device ? 0 : ScreenCount(dpy); // device grabs select
+  for (int screen = 0; screen < n_screens; ++screen) {
+    Window root = RootWindow(dpy, screen);
+    KPM_BRET(KPM_ERR_X_SEL_INPUT, XSelectInput, dpy,
+             root, KeyPressMask|KeyReleaseMask);
+  }
+  Bool detectable = False;
+  XkbSetDetectableAutoRepeat(dpy, True, &detectable);
+  if (!detectable) {
+    fprintf(stderr, "XKB detectable autorepeat not supported, holding a "
+            "movement key will step on every autorepeat.\n");
+  }
+  if (KPM_SNAP_MOD && !KPM_CHK(kpm_sn_init, &el->sn, dpy))
+    el->snap = 1;
+  const char* overlay = getenv("KPM_OVERLAY");
+  if ((overlay ? atoi(overlay) : KPM_OVERLAY)
+      && !KPM_CHK(kpm_ov_init, &el->ov, dpy)) {
+    el->overlay = 1;
+  }
+  if (!el->device) {
+    KPM_RET(kpm_lp_add, el->lp, ConnectionNumber(dpy),
+            &on_x_readable, &x_pending, el);
   }
   return KPM_SUCCESS;
 }
@@ -92,96 +447,237 @@ static int setup_codes(kpm_el_t* el) {
 // public functions
 ////////////////////////////////////
 
-int kpm_el_init(kpm_el_t* el, kpm_st_t* st) {
+int kpm_el_init(kpm_el_t* el, kpm_st_t* st, kpm_lp_t* lp, kpm_lat_t* lat) {
+  return kpm_el_init_device(el, st, lp, lat, 0);
+}
+
+int kpm_el_init_device(kpm_el_t* el, kpm_st_t* st, kpm_lp_t* lp,
+                       kpm_lat_t* lat, int device) {
   memset(el, 0, sizeof(kpm_el_t));
   el->st = st;
+  el->lp = lp;
+  el->lat = lat;
+  el->device = device;
   el->pressed_button = KPM_NULL_BUTTON;
   el->long_press_ms = KPM_LONG_PRESS_MS;
-  setup_codes(el);
-  int n_screens = ScreenCount(st->xdo->xdpy);
-  for (int screen = 0; screen < n_screens; ++screen) {
-    Window root          = RootWindow(st->xdo->xdpy, screen);
-    Bool   owner_events  = False;
-    int    pointer_mode  = GrabModeAsync;
-    int    keyboard_mode = GrabModeAsync;
-
-    for (int modMask = 0; modMask < N_MOD_MASKS; ++modMask) {
-      if (modMask & Mod2Mask)
-        continue; // skip masks with NumLock
-      KPM_BRET(KPM_ERR_X_GRAB, XGrabKey, st->xdo->xdpy,
-               el->undo_code, modMask, root,
-               owner_events, pointer_mode, keyboard_mode);
-      for (int i = 0; i < 8; ++i) {
-        KPM_BRET(KPM_ERR_X_GRAB, XGrabKey, st->xdo->xdpy,
-                 el->move_code[i], modMask, root,
-                 owner_events, pointer_mode, keyboard_mode);
-      }
-      for (int i = 0; i < 6; ++i) {
-        KPM_BRET(KPM_ERR_X_GRAB, XGrabKey, st->xdo->xdpy,
-                 el->button_code[i], modMask, root,
-                 owner_events, pointer_mode, keyboard_mode);
-      }
-    }
-    KPM_BRET(KPM_ERR_X_SEL_INPUT, XSelectInput, st->xdo->xdpy,
-             root, KeyPressMask|KeyReleaseMask);
+  kpm_tm_init(&el->long_press_tm, &on_long_press, el);
+  kpm_tm_init(&el->ttl_tm, &on_move_ttl, el);
+  kpm_tm_init(&el->frame_tm, &on_frame, el);
+  kpm_tm_init(&el->glide_tm, &on_glide, el);
+  kpm_tm_init(&el->macro_tm, &on_macro_step, el);
+  const char* chord_ms = getenv("KPM_CHORD_MS");
+  kpm_ch_init(&el->ch, chord_ms && *chord_ms ? atoi(chord_ms) : KPM_CHORD_MS);
+  if (!(el->mc = calloc(1, sizeof(kpm_mc_t)))) {
+    fprintf(stderr, "kpm_el_init(): out of memory\n");
+    return KPM_ERR_MACRO;
+  }
+  if (KPM_MACROS) {
+    char dir[1024];
+    kpm_mc_init(el->mc, kpm_mc_dir(dir, sizeof(dir)));
   }
+  el->xkb_event_base = -1;
+  kpm_km_defaults(&el->km, !st->dpy, st->grid);
+  const char* path = kpm_km_path(el->config_path, sizeof(el->config_path));
+  if (path && path != el->config_path)
+    snprintf(el->config_path, sizeof(el->config_path), "%s", path);
+  if (*el->config_path)
+    KPM_RET(kpm_km_load, &el->km, el->config_path);
+  if (st->dpy)
+    KPM_RET(init_x, el);
+  // keys grabbed by other clients are reported, kpmouse runs with the rest
+  KPM_CHK(rebuild_keymap, el);
   return KPM_SUCCESS;
 }
 
 void kpm_el_destroy(kpm_el_t* el) {
-  int n_screens = ScreenCount(el->st->xdo->xdpy);
-  for (int screen = 0; screen < n_screens; ++screen) {
-    Window root = RootWindow(el->st->xdo->xdpy, screen);
-    for (int modMask = 0; modMask < N_MOD_MASKS; ++modMask) {
-      if (modMask & Mod2Mask)
-        continue; //skip masks with NumLock
-      KPM_BCHK(KPM_ERR_X_GRAB, XUngrabKey, el->st->xdo->xdpy,
-               el->undo_code, modMask, root);
-      for (int i = 0; i < 8; ++i) {
-        KPM_BCHK(KPM_ERR_X_GRAB, XUngrabKey, el->st->xdo->xdpy,
-                 el->move_code[i], modMask, root);
-      }
-      for (int i = 0; i < 6; ++i) {
-        KPM_BCHK(KPM_ERR_X_GRAB, XUngrabKey, el->st->xdo->xdpy,
-                 el->button_code[i], modMask, root);
-      }
-    }
+  kpm_lp_disarm(el->lp, &el->long_press_tm);
+  kpm_lp_disarm(el->lp, &el->ttl_tm);
+  kpm_lp_disarm(el->lp, &el->frame_tm);
+  kpm_lp_disarm(el->lp, &el->glide_tm);
+  kpm_lp_disarm(el->lp, &el->macro_tm);
+  free(el->mc);
+  el->mc = NULL;
+  if (el->snap) {
+    kpm_sn_destroy(&el->sn);
+    el->snap = 0;
+  }
+  if (el->overlay) {
+    kpm_ov_destroy(&el->ov);
+    el->overlay = 0;
+  }
+  if (el->st->dpy) {
+    KeyCode codes[256];
+    int n = kpm_km_codes(&el->km, codes);
+    if (!el->device)
+      kpm_lp_del(el->lp, ConnectionNumber(el->st->dpy));
+    if (n && el->device)
+      KPM_CHK(kpm_grab_device_keys, el->st->dpy, el->device, codes, n, 0);
+    else if (n)
+      KPM_CHK(kpm_grab_keys, el->st->dpy, codes, n, 0);
   }
 }
 
-int kpm_el_step(kpm_el_t* el) {
-  XEvent ev = {0};
-  KPM_RET2(KPM_ERR_X_NEXT_EVT, XNextEvent, el->st->xdo->xdpy, &ev);
-  if (ev.type != KeyPress && ev.type != KeyRelease) {
-    fprintf(stderr, "kp_el_step() ignoring unexpected ev.type %d\n", ev.type);
-    return KPM_SUCCESS; //not a fatal error
+int kpm_el_reload(kpm_el_t* el) {
+  kpm_km_t* km = malloc(sizeof(kpm_km_t));
+  if (!km)
+    return KPM_ERR_CONFIG;
+  // a deleted file means the defaults
+  kpm_km_defaults(km, !el->st->dpy, el->st->grid);
+  int err = *el->config_path ? KPM_CHK(kpm_km_load, km, el->config_path) : 0;
+  if (!err) {
+    memcpy(el->km.binds, km->binds, sizeof(km->binds));
+    el->km.n_binds = km->n_binds;
+    err = KPM_CHK(rebuild_keymap, el);
+  }
+  free(km);
+  return err;
+}
+
+int kpm_el_key(kpm_el_t* el, KeyCode code, int press, unsigned int mods) {
+  if (el->record) {
+    fprintf(el->record, "%ld %u %c\n", kpm_lp_now(el->lp), code,
+            press ? 'p' : 'r');
   }
-  if (ev.xkey.keycode == el->undo_code) {
-    if (ev.type == KeyPress)
+  kpm_tr(KPM_TR_KEY, code, press, mods, 0);
+  kpm_action_t action = el->km.action[code];
+  int held = held_mods(mods);
+  int chord = kpm_ch_feed(&el->ch, code, held ? KPM_ACT_NONE : action,
+                          press, kpm_lp_now(el->lp));
+  if (chord == KPM_CH_EAT)
+    return KPM_SUCCESS;
+  else if (chord == KPM_CH_ARM)
+    kpm_st_save(el->st); // the chord would take back this key
+  else if (chord != KPM_CH_PASS)
+    return handle_chord(el, chord);
+  if (action == KPM_ACT_UNDO) {
+    if (press) {
+      lat_dispatch(el, KPM_LAT_UNDO);
+      kpm_lp_disarm(el->lp, &el->ttl_tm);
       KPM_RET(kpm_st_reset, el->st);
-    //else: ignore the release event
+      lat_computed(el);
+    } //else: ignore the release event
     return KPM_SUCCESS; // done
   }
-  kpm_move_t move = to_move(el, ev.xkey.keycode);
-  if (move != KPM_NULL_MOVE) {
-    if (ev.type == KeyPress)
-      KPM_RET(kpm_st_move, el->st, move);
-    //else: ignore the release event
+  kpm_move_t move = to_move(action);
+  if (move != KPM_NULL_MOVE && held == HELD_MONITOR) {
+    if (press) {
+      lat_dispatch(el, KPM_LAT_MOVE);
+      kpm_st_glide_stop(el->st, kpm_lp_now(el->lp));
+      kpm_lp_disarm(el->lp, &el->glide_tm);
+      kpm_lp_disarm(el->lp, &el->ttl_tm);
+      KPM_RET(kpm_st_jump, el->st, move, kpm_lp_now(el->lp));
+      schedule_frame(el);
+      lat_computed(el);
+    } //else: ignore the release event
+  } else if (move != KPM_NULL_MOVE && held == HELD_SNAP) {
+    if (press) {
+      long int now = kpm_lp_now(el->lp);
+      lat_dispatch(el, KPM_LAT_MOVE);
+      take_over(el, now);
+      if (el->overlay)
+        kpm_ov_hide(&el->ov); // else its lines are found as edges
+      KPM_RET(kpm_st_snap, el->st, el->snap ? &el->sn : NULL, move, now);
+      schedule_frame(el);
+      lat_computed(el);
+    } //else: ignore the release event
+  } else if (move != KPM_NULL_MOVE) {
+    if (press)
+      lat_dispatch(el, KPM_LAT_MOVE);
+    KPM_RET(handle_move, el, move, code, press);
+    lat_computed(el);
   } else {
-    kpm_button_t button = to_button(el, ev.xkey.keycode);
+    kpm_button_t button = to_button(action);
     if (button != KPM_NULL_BUTTON) {
-      KPM_RET(handle_button, el, button, ev.type == KeyPress);
+      lat_dispatch(el, KPM_LAT_BUTTON);
+      KPM_RET(handle_button, el, button, press);
+      lat_computed(el);
     } else {
-      const char* ev_type = ev.type==KeyPress ? "press" : "release";
-      fprintf(stderr, "kpm_el_step() ignoring unexpected %s on keycode %d,"
-              "mask %x.\n", ev_type , ev.xkey.keycode, ev.xkey.state);
+      fprintf(stderr, "kpm_el_key() ignoring unexpected %s on keycode %d,"
+              "mask %x.\n", press ? "press" : "release", code, mods);
+    }
+  }
+  return KPM_SUCCESS;
+}
+
+int kpm_el_event(kpm_el_t* el, XEvent* ev) {
+  if (kpm_st_handle_event(el->st, ev)) {
+    if (el->overlay) // the screen may have been resized
+      kpm_ov_resize(&el->ov, &el->st->mn);
+    return KPM_SUCCESS;
+  }
+  if (handle_mapping(el, ev))
+    return KPM_SUCCESS;
+  if (ev->type != KeyPress && ev->type != KeyRelease) {
+    fprintf(stderr, "kpm_el_event() ignoring unexpected ev.type %d\n",
+            ev->type);
+    return KPM_SUCCESS; //not a fatal error
+  }
+  return kpm_el_key(el, ev->xkey.keycode, ev->type == KeyPress,
+                    ev->xkey.state);
+}
+
+int kpm_el_move(kpm_el_t* el, kpm_move_t move) {
+  long int now = kpm_lp_now(el->lp);
+  take_over(el, now);
+  KPM_RET(kpm_st_move, el->st, move, now);
+  schedule_frame(el);
+  return KPM_SUCCESS;
+}
+
+int kpm_el_unmove(kpm_el_t* el) {
+  long int now = kpm_lp_now(el->lp);
+  take_over(el, now);
+  KPM_RET(kpm_st_unmove, el->st, now);
+  schedule_frame(el);
+  return KPM_SUCCESS;
+}
+
+int kpm_el_reset(kpm_el_t* el) {
+  kpm_st_glide_stop(el->st, kpm_lp_now(el->lp));
+  kpm_lp_disarm(el->lp, &el->glide_tm);
+  kpm_lp_disarm(el->lp, &el->ttl_tm);
+  el->held_code = 0;
+  return kpm_st_reset(el->st);
+}
+
+int kpm_el_button(kpm_el_t* el, kpm_button_t button, int down,
+                  const void* owner) {
+  if (down) {
+    if (el->pressed_button != KPM_NULL_BUTTON) {
+      return el->pressed_button == button && el->button_owner == owner
+             ? KPM_SUCCESS : KPM_ERR_MOUSE_DOWN;
     }
+    kpm_lp_disarm(el->lp, &el->long_press_tm);
+    el->pressed_button = button;
+    el->button_owner = owner;
+    el->long_press = 1; // held until released, like a long press
+    return send_mouse(el, button, 1);
   }
+  if (el->pressed_button != button || el->button_owner != owner)
+    return KPM_SUCCESS; // not held by owner, or released by the button key
+  el->pressed_button = KPM_NULL_BUTTON;
+  el->button_owner = NULL;
+  return send_mouse(el, button, 0);
+}
+
+int kpm_el_flush(kpm_el_t* el) {
+  if (el->km_dirty)
+    KPM_CHK(rebuild_keymap, el); // failed grabs are not fatal at runtime
+  KPM_RET(kpm_st_commit, el->st);
+  record_step(el, KPM_MC_MOVE, 0);
+  KPM_RET(kpm_be_flush, el->st->be);
+  if (el->lat)
+    kpm_lat_flushed(el->lat);
+  if (el->overlay)
+    kpm_ov_update(&el->ov, el->st);
+  publish_status(el);
   return KPM_SUCCESS;
 }
 
+int kpm_el_step(kpm_el_t* el) {
+  return kpm_lp_step(el->lp);
+}
+
 int kpm_el_run(kpm_el_t* el) {
-  int err;
-  while (!(err = kpm_el_step(el))) ;
-  return err;
+  return kpm_lp_run(el->lp);
 }
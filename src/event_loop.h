@@ -7,7 +7,14 @@
 
 #include "config.h"
 #include "state.h"
-#include <time.h>
+#include "loop.h"
+#include "latency.h"
+#include "keymap.h"
+#include "overlay.h"
+#include "chord.h"
+#include "macro.h"
+#include "status.h"
+#include <stdio.h>
 #include <X11/X.h>
 
 ////////////////////////////////////////////
@@ -16,23 +23,110 @@
 
 typedef struct kpm_st_s kpm_st_t;
 
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
 typedef struct kpm_el_s {
   kpm_st_t* st;
+
+  /** Loop that watches the X connection and runs the timers below */
+  kpm_lp_t* lp;
+
+  /** Latency histograms, or NULL if latency is not measured */
+  kpm_lat_t* lat;
+
+  /**
+   * XInput2 slave keyboard whose keys are grabbed, or 0 to grab the keys of
+   * all keyboards with core grabs. With a device, the X connection is not
+   * watched: its owner passes the events on (see mpx.h).
+   */
+  int device;
+
+  /**
+   * If not NULL, every key event is recorded here as a "<ms> <code> <p|r>"
+   * line, which tools/kpm_replay.c can replay.
+   */
+  FILE* record;
+
+  /**
+   * If not NULL, the status (mode, pressed button, TTL...) is published here
+   * after every batch of events and timer that changes it.
+   */
+  kpm_sp_t* status;
+
   kpm_button_t pressed_button;
-  struct timespec press_ts;
+  /**
+   * Who pressed pressed_button: NULL for mouse button keys, else the owner
+   * passed to kpm_el_button() (e.g. a control socket client)
+   */
+  const void* button_owner;
   unsigned int long_press_ms;
 
-  /** move_code[m] is the KeyCode that should trigger the kpm_move_t m */
-  KeyCode move_code[8];
+  /**
+   * Non-zero once pressed_button has been held for long_press_ms. Set by
+   * long_press_tm, right on time, instead of when the next key event arrives.
+   */
+  char long_press;
+
+  /** Fires long_press_ms after a mouse button key press */
+  kpm_tm_t long_press_tm;
+
+  /** Fires kpm_st_t.move_ttl_ms after the last move, expiring it */
+  kpm_tm_t ttl_tm;
+
+  /** Fires every kpm_st_t.frame_ms while kpm_st_t.animating */
+  kpm_tm_t frame_tm;
+
+  /** Fires every kpm_st_t.glide_tick_ms while kpm_st_t.gliding */
+  kpm_tm_t glide_tm;
 
   /**
-   * button_code[0:2] is the KeyCode that should trigger the left, middle or
-   * right mouse button
+   * KeyCode of the movement key currently held down, or 0. With XKB
+   * detectable autorepeat, a KeyPress of held_code is an autorepeat.
    */
-  KeyCode button_code[6];
+  KeyCode held_code;
+
+  /** Key bindings and the KeyCode->action dispatch table */
+  kpm_km_t km;
+
+  /** Config file with the key bindings (see kpm_km_path()), or empty */
+  char config_path[1024];
+
+  /** Non-zero if the keyboard mapping changed and km must be rebuilt */
+  char km_dirty;
+
+  /** XKB event code, or -1 if XKB is not available */
+  int xkb_event_base;
+
+  /** Non-zero if ov is initialized and must follow the movement window */
+  char overlay;
+
+  /** Movement window overlay (see KPM_OVERLAY) */
+  kpm_ov_t ov;
 
-  /** KeyCode for KPM_UNDO_SYM */
-  KeyCode undo_code;
+  /** Non-zero if sn is initialized (see KPM_SNAP_MOD) */
+  char snap;
+
+  /** Edge snapping buffers */
+  kpm_sn_t sn;
+
+  /** Chord recognizer, see KPM_CHORD_MS */
+  kpm_ch_t ch;
+
+  /**
+   * Recorded macros and the recording in progress (see KPM_MACROS).
+   * Allocated by kpm_el_init(), as it is larger than the rest of kpm_el_t.
+   */
+  kpm_mc_t* mc;
+
+  /** Macro being played step by step (see KPM_MACRO_PACE_MS), or NULL */
+  const kpm_mc_macro_t* playing;
+  /** Index of the next step of playing */
+  int play_next;
+
+  /** Fires every KPM_MACRO_PACE_MS while playing */
+  kpm_tm_t macro_tm;
 } kpm_el_t;
 
 ////////////////////////////////////////////
@@ -40,10 +134,28 @@ typedef struct kpm_el_s {
 ////////////////////////////////////////////
 
 /**
- * Create a event loop ans setup events from X11 to listen for
- * @returns new kpm_el_t object, or NULL if an error occurred
+ * Create a event loop ans setup events from X11 to listen for. The X
+ * connection and timers are registered on lp, whose ownership is not
+ * transfered. If lat is not NULL, the latency of every action is recorded
+ * on it.
+ *
+ * Key bindings are loaded from the config file (see kpm_km_load()), or
+ * taken from user_config.c if there is none. If st has no X display
+ * (st->dpy == NULL), no X setup is done, the evdev bindings are used and key
+ * events must be fed with kpm_el_key() (see evdev.h).
+ * @returns 0 if successful, or an error code
  */
-int kpm_el_init(kpm_el_t* el, kpm_st_t* st);
+int kpm_el_init(kpm_el_t* el, kpm_st_t* st, kpm_lp_t* lp, kpm_lat_t* lat);
+
+/**
+ * Same as kpm_el_init(), but only grabs the keys of the XInput2 slave
+ * keyboard device (see kpm_el_t.device) and does not watch the X connection.
+ * The caller reads the events: key events of device go to kpm_el_key(), all
+ * others to kpm_el_event(), and kpm_el_flush() ends each batch.
+ * @returns 0 if successful, or an error code
+ */
+int kpm_el_init_device(kpm_el_t* el, kpm_st_t* st, kpm_lp_t* lp,
+                       kpm_lat_t* lat, int device);
 
 /**
  * Release resources held by the event loop object.
@@ -52,8 +164,61 @@ int kpm_el_init(kpm_el_t* el, kpm_st_t* st);
 void kpm_el_destroy(kpm_el_t* el);
 
 /**
- * Wait and process a single event.
- * @returns 0 if event was processed without errors, error code otherwise
+ * Reloads the key bindings from the config file, rebuilds the dispatch table
+ * and grabs (or ungrabs) only the KeyCodes whose binding state changed. On
+ * errors, the current bindings are kept.
+ * @returns 0 if successful, or an error code
+ */
+int kpm_el_reload(kpm_el_t* el);
+
+/**
+ * Handle a press (press != 0) or release of a KeyCode, with the given
+ * modifier mask. Events are injected, but not flushed.
+ * @returns 0 if successful, or an error code
+ */
+int kpm_el_key(kpm_el_t* el, KeyCode code, int press, unsigned int mods);
+
+/**
+ * Handle a core key event or any other X event: keyboard mapping changes,
+ * pointer motion, RandR changes... Events are injected, but not flushed.
+ * @returns 0 if successful, or an error code
+ */
+int kpm_el_event(kpm_el_t* el, XEvent* ev);
+
+/**
+ * Do a move, undo a move or reset the movement, as requested by a control
+ * client (see control.h) rather than by a key. Any glide is stopped. Events
+ * are injected, but not flushed.
+ * @returns 0 if successful, or an error code
+ */
+int kpm_el_move(kpm_el_t* el, kpm_move_t move);
+int kpm_el_unmove(kpm_el_t* el);
+int kpm_el_reset(kpm_el_t* el);
+
+/**
+ * Presses (down != 0) or releases a button on behalf of owner (not NULL),
+ * right away, without the click/long press handling of mouse button keys.
+ * The button becomes el->pressed_button as if long pressed, so the button
+ * key releases it, and only one button can be held at a time. A release is
+ * ignored unless owner holds button. Not flushed.
+ *
+ * @returns 0 if successful, KPM_ERR_MOUSE_DOWN if another button (or owner)
+ *          holds a button already, or another error code
+ */
+int kpm_el_button(kpm_el_t* el, kpm_button_t button, int down,
+                  const void* owner);
+
+/**
+ * Injects the net pointer motion of the events handled since the last flush
+ * (see kpm_st_commit()), flushes the backend and completes the latency
+ * records. Rebuilds the dispatch table if the keyboard mapping changed.
+ * @returns 0 if successful, or an error code
+ */
+int kpm_el_flush(kpm_el_t* el);
+
+/**
+ * Wait until there are X events or an expired timer and process them.
+ * @returns 0 if events were processed without errors, error code otherwise
  */
 int kpm_el_step(kpm_el_t* el);
 
@@ -0,0 +1,161 @@
+#include "grab.h"
+#include "errors.h"
+#include <X11/Xlib-xcb.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XInput2.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int N_MOD_MASKS = 1<<(Mod5MapIndex+1);
+
+/** One XCB request issued by kpm_grab_keys() */
+typedef struct {
+  xcb_void_cookie_t cookie;
+  KeyCode code;
+  unsigned short mask;
+  unsigned char screen;
+} grab_req_t;
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static void report(Display* dpy, const grab_req_t* req,
+                   xcb_generic_error_t* err, int grab) {
+  char text[128] = {0};
+  XGetErrorText(dpy, err->error_code, text, sizeof(text));
+  fprintf(stderr, "Failed to %s KeyCode %d with modifier mask 0x%x on "
+          "screen %d (code %d): %s\n", grab ? "grab" : "ungrab",
+          req->code, req->mask, req->screen, err->error_code, text);
+}
+
+/**
+ * Reports the KeyCodes of screen that another client had already grabbed,
+ * conflicts[code] being the number of modifier masks that failed. X does not
+ * tell which client holds a passive grab.
+ */
+static void report_conflicts(Display* dpy, const int* conflicts, int screen,
+                             int device) {
+  for (int code = 0; code < 256; ++code) {
+    if (!conflicts[code])
+      continue;
+    const char* name = XKeysymToString(XkbKeycodeToKeysym(dpy, code, 0, 0));
+    fprintf(stderr, "KeyCode %d (%s) is already grabbed by another client "
+            "(e.g. the window manager or a hotkey daemon) with %d of %d "
+            "modifier masks on screen %d", code, name ? name : "no KeySym",
+            conflicts[code], N_MOD_MASKS/2, screen);
+    if (device)
+      fprintf(stderr, " for device %d", device);
+    fprintf(stderr, ", kpmouse will not see it with those.\n");
+  }
+}
+
+/** Fills mods with all modifier masks without NumLock, returns their count */
+static int device_mods(XIGrabModifiers* mods) {
+  int n_mods = 0;
+  for (int mask = 0; mask < N_MOD_MASKS; ++mask) {
+    if (mask & Mod2Mask)
+      continue; // skip masks with NumLock
+    mods[n_mods].modifiers = mask;
+    mods[n_mods++].status = 0;
+  }
+  return n_mods;
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+int kpm_grab_keys(Display* dpy, const KeyCode* codes, int n_codes, int grab) {
+  xcb_connection_t* c = XGetXCBConnection(dpy);
+  int n_screens = ScreenCount(dpy);
+  grab_req_t* reqs = malloc(sizeof(grab_req_t)*n_screens*N_MOD_MASKS*n_codes);
+  if (!reqs) {
+    fprintf(stderr, "kpm_grab_keys(): out of memory\n");
+    return KPM_ERR_X_GRAB;
+  }
+
+  // Write all requests without waiting for any reply
+  grab_req_t* end = reqs;
+  for (int screen = 0; screen < n_screens; ++screen) {
+    Window root = RootWindow(dpy, screen);
+    for (int mask = 0; mask < N_MOD_MASKS; ++mask) {
+      if (mask & Mod2Mask)
+        continue; // skip masks with NumLock
+      for (int i = 0; i < n_codes; ++i) {
+        if (!codes[i])
+          continue; // unbound key
+        end->code = codes[i];
+        end->mask = mask;
+        end->screen = screen;
+        if (grab) {
+          end->cookie = xcb_grab_key_checked(c, 0, root, mask, codes[i],
+                                             XCB_GRAB_MODE_ASYNC,
+                                             XCB_GRAB_MODE_ASYNC);
+        } else {
+          end->cookie = xcb_ungrab_key_checked(c, codes[i], root, mask);
+        }
+        ++end;
+      }
+    }
+  }
+  xcb_flush(c);
+
+  // Only the first check sends a sync request, which goes after all the
+  // requests above. Thus, collecting all errors costs a single round trip.
+  int err = KPM_SUCCESS, screen = -1, conflicts[256];
+  for (grab_req_t* req = reqs; req != end; ++req) {
+    if (req->screen != screen) { // requests are ordered by screen
+      if (screen >= 0)
+        report_conflicts(dpy, conflicts, screen, 0);
+      memset(conflicts, 0, sizeof(conflicts));
+      screen = req->screen;
+    }
+    xcb_generic_error_t* x_err = xcb_request_check(c, req->cookie);
+    if (x_err) {
+      if (grab && x_err->error_code == BadAccess)
+        ++conflicts[req->code];
+      else
+        report(dpy, req, x_err, grab);
+      free(x_err);
+      err = KPM_ERR_X_GRAB;
+    }
+  }
+  if (screen >= 0)
+    report_conflicts(dpy, conflicts, screen, 0);
+  free(reqs);
+  return err;
+}
+
+int kpm_grab_device_keys(Display* dpy, int device, const KeyCode* codes,
+                         int n_codes, int grab) {
+  XIGrabModifiers mods[1<<(Mod5MapIndex+1)];
+  unsigned char bits[XIMaskLen(XI_LASTEVENT)] = {0};
+  XIEventMask mask = {device, sizeof(bits), bits};
+  int n_mods = device_mods(mods), err = KPM_SUCCESS;
+  XISetMask(bits, XI_KeyPress);
+  XISetMask(bits, XI_KeyRelease);
+  for (int screen = 0; screen < ScreenCount(dpy); ++screen) {
+    Window root = RootWindow(dpy, screen);
+    int conflicts[256] = {0};
+    for (int i = 0; i < n_codes; ++i) {
+      if (!codes[i])
+        continue; // unbound key
+      if (!grab) {
+        XIUngrabKeycode(dpy, device, codes[i], root, n_mods, mods);
+        continue;
+      }
+      // Unlike core grabs, the reply lists the masks that failed
+      int n_failed = XIGrabKeycode(dpy, device, codes[i], root, GrabModeAsync,
+                                   GrabModeAsync, False, &mask, n_mods, mods);
+      if (n_failed) {
+        conflicts[codes[i]] = n_failed;
+        err = KPM_ERR_X_GRAB;
+        device_mods(mods); // overwritten by the failed ones
+      }
+    }
+    report_conflicts(dpy, conflicts, screen, device);
+  }
+  return err;
+}
@@ -0,0 +1,45 @@
+#ifndef _KPMOUSE_GRAB_H_
+#define _KPMOUSE_GRAB_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include <X11/Xlib.h>
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Grabs (if grab is non-zero) or ungrabs each of the n_codes KeyCodes in codes
+ * on the root window of every screen, combined with every modifier mask that
+ * does not include NumLock (Mod2Mask). KeyCodes equal to 0 (unbound) are
+ * skipped.
+ *
+ * All requests are written in a single batch through XCB checked requests and
+ * their errors are collected afterwards, costing a single round trip. Each
+ * KeyCode already grabbed by another client is reported on stderr once per
+ * screen, with its KeySym and how many modifier masks are taken. Other
+ * errors are reported for every KeyCode/mask pair. The KeyCodes and masks
+ * that could be grabbed stay grabbed.
+ *
+ * @return 0 if all requests succeeded, KPM_ERR_X_GRAB if any failed.
+ */
+int kpm_grab_keys(Display* dpy, const KeyCode* codes, int n_codes, int grab);
+
+/**
+ * Same as kpm_grab_keys(), but with XInput2 passive grabs on a single device,
+ * the slave keyboard device. Only that keyboard is grabbed, the same keys of
+ * other keyboards go on to the focused window. Grabs deliver XI_KeyPress and
+ * XI_KeyRelease events (not core events) whose sourceid is device.
+ *
+ * Costs one round trip per KeyCode and screen.
+ *
+ * @return 0 if all grabs succeeded, KPM_ERR_X_GRAB if any failed.
+ */
+int kpm_grab_device_keys(Display* dpy, int device, const KeyCode* codes,
+                         int n_codes, int grab);
+
+#endif /*_KPMOUSE_GRAB_H_*/
@@ -0,0 +1,203 @@
+#include "history.h"
+#include "user_config.h"
+#include "errors.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+/** Index of the first cell of level in kpm_hs_file_t.count */
+static inline int level_offset(int level) {
+  return ((1 << 2*level) - 1)/3;
+}
+
+static inline int cell(int level, int cx, int cy) {
+  return level_offset(level) + (cy << level) + cx;
+}
+
+/** Clicks of all buttons in a cell */
+static unsigned int total(const kpm_hs_file_t* f, int screen, int idx) {
+  unsigned int sum = 0;
+  for (int b = 0; b < KPM_HS_BUTTONS; ++b)
+    sum += f->count[screen][b][idx];
+  return sum;
+}
+
+/** Converts a screen coordinate into a leaf cell coordinate (scaled) */
+static inline long long to_leaf(long long v, unsigned int size) {
+  return v*KPM_HS_SIDE/size;
+}
+
+/** Halves all counts of a quadtree, keeping parents the sum of children */
+static void decay(uint16_t* count) {
+  const int leaf = KPM_HS_LEVELS-1;
+  for (int i = level_offset(leaf); i < KPM_HS_CELLS; ++i)
+    count[i] /= 2;
+  for (int l = leaf-1; l >= 0; --l) {
+    for (int cy = 0; cy < 1 << l; ++cy) {
+      for (int cx = 0; cx < 1 << l; ++cx) {
+        count[cell(l, cx, cy)] = count[cell(l+1, 2*cx,   2*cy)]
+                               + count[cell(l+1, 2*cx+1, 2*cy)]
+                               + count[cell(l+1, 2*cx,   2*cy+1)]
+                               + count[cell(l+1, 2*cx+1, 2*cy+1)];
+      }
+    }
+  }
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+const char* kpm_hs_path(char* buf, int size) {
+  const char *env = getenv("KPM_HISTORY"), *dir;
+  int n;
+  if (env)
+    return *env ? env : NULL;
+  if ((dir = getenv("XDG_DATA_HOME")) && *dir)
+    n = snprintf(buf, size, "%s/kpmouse/clicks", dir);
+  else if ((dir = getenv("HOME")))
+    n = snprintf(buf, size, "%s/.local/share/kpmouse/clicks", dir);
+  else
+    return NULL;
+  return n < size ? buf : NULL;
+}
+
+int kpm_hs_init(kpm_hs_t* hs, const char* path) {
+  struct stat st;
+  memset(hs, 0, sizeof(kpm_hs_t));
+  int fd = open(path, O_RDWR|O_CREAT, 0600);
+  if (fd < 0 && errno == ENOENT) {
+    kpm__make_parents(path);
+    fd = open(path, O_RDWR|O_CREAT, 0600);
+  }
+  if (fd < 0) {
+    perror(path);
+    return KPM_ERR_HISTORY;
+  }
+  if (fstat(fd, &st) || (st.st_size != sizeof(kpm_hs_file_t)
+                         && ftruncate(fd, sizeof(kpm_hs_file_t)))) {
+    perror(path);
+    close(fd);
+    return KPM_ERR_HISTORY;
+  }
+  void* addr = mmap(NULL, sizeof(kpm_hs_file_t), PROT_READ|PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  close(fd); // the mapping keeps the file
+  if (addr == MAP_FAILED) {
+    perror(path);
+    return KPM_ERR_HISTORY;
+  }
+  hs->file = addr;
+  kpm_hs_file_t* f = hs->file;
+  if (memcmp(f->magic, KPM_HS_MAGIC, sizeof(f->magic))
+      || f->levels != KPM_HS_LEVELS || f->screens != KPM_HS_SCREENS
+      || f->buttons != KPM_HS_BUTTONS) {
+    memset(f, 0, sizeof(kpm_hs_file_t));
+    memcpy(f->magic, KPM_HS_MAGIC, sizeof(f->magic));
+    f->levels = KPM_HS_LEVELS;
+    f->screens = KPM_HS_SCREENS;
+    f->buttons = KPM_HS_BUTTONS;
+  }
+  return KPM_SUCCESS;
+}
+
+void kpm_hs_destroy(kpm_hs_t* hs) {
+  if (hs->file)
+    munmap(hs->file, sizeof(kpm_hs_file_t));
+  hs->file = NULL;
+}
+
+void kpm_hs_add(kpm_hs_t* hs, int screen, int button, int x, int y,
+                unsigned int w, unsigned int h) {
+  if (screen < 0 || screen >= KPM_HS_SCREENS || button < 0
+      || button >= KPM_HS_BUTTONS || x < 0 || y < 0 || !w || !h
+      || (unsigned int)x >= w || (unsigned int)y >= h) {
+    return;
+  }
+  uint16_t* count = hs->file->count[screen][button];
+  if (count[0] >= KPM_HISTORY_MAX_CLICKS)
+    decay(count);
+  int lx = to_leaf(x, w), ly = to_leaf(y, h);
+  for (int l = 0; l < KPM_HS_LEVELS; ++l) {
+    int shift = KPM_HS_LEVELS-1 - l;
+    ++count[cell(l, lx >> shift, ly >> shift)];
+  }
+}
+
+int kpm_hs_predict(const kpm_hs_t* hs, int screen, unsigned int w,
+                   unsigned int h, int left, int top, unsigned int rect_w,
+                   unsigned int rect_h, unsigned int min_clicks,
+                   int* x, int* y) {
+  const kpm_hs_file_t* f = hs->file;
+  if (screen < 0 || screen >= KPM_HS_SCREENS || !w || !h)
+    return 0;
+  // rectangle in leaf cells: [l, r) x [t, b)
+  long long l = to_leaf(left, w), t = to_leaf(top, h);
+  long long r = (((long long)left + rect_w)*KPM_HS_SIDE + w-1)/w;
+  long long b = (((long long)top + rect_h)*KPM_HS_SIDE + h-1)/h;
+  l = l < 0 ? 0 : l;
+  t = t < 0 ? 0 : t;
+  r = r > KPM_HS_SIDE ? KPM_HS_SIDE : r;
+  b = b > KPM_HS_SIDE ? KPM_HS_SIDE : b;
+  if (l >= r || t >= b)
+    return 0;
+
+  // start at the coarsest level with cells no larger than the rectangle
+  int level = 0, size = KPM_HS_SIDE;
+  while (level < KPM_HS_LEVELS-1 && (size > r-l || size > b-t)) {
+    ++level;
+    size /= 2;
+  }
+  int best_x = -1, best_y = -1;
+  unsigned int best = 0;
+  for (int cy = t/size; cy <= (b-1)/size; ++cy) {
+    for (int cx = l/size; cx <= (r-1)/size; ++cx) {
+      unsigned int n = total(f, screen, cell(level, cx, cy));
+      if (n > best) {
+        best = n;
+        best_x = cx;
+        best_y = cy;
+      }
+    }
+  }
+  // descend into the child with the most clicks overlapping the rectangle
+  while (best && ++level < KPM_HS_LEVELS) {
+    int parent_x = best_x, parent_y = best_y;
+    size /= 2;
+    best = 0;
+    for (int cy = 2*parent_y; cy < 2*parent_y + 2; ++cy) {
+      for (int cx = 2*parent_x; cx < 2*parent_x + 2; ++cx) {
+        if ((cx+1)*size <= l || cx*size >= r
+            || (cy+1)*size <= t || cy*size >= b) {
+          continue;
+        }
+        unsigned int n = total(f, screen, cell(level, cx, cy));
+        if (n > best) {
+          best = n;
+          best_x = cx;
+          best_y = cy;
+        }
+      }
+    }
+  }
+  if (!best || best < min_clicks)
+    return 0;
+  // center of the leaf, kept inside the rectangle
+  long long px = ((2LL*best_x + 1)*w)/(2*KPM_HS_SIDE);
+  long long py = ((2LL*best_y + 1)*h)/(2*KPM_HS_SIDE);
+  long long right = left + (long long)rect_w - 1;
+  long long bottom = top + (long long)rect_h - 1;
+  *x = px < left ? left : (px > right ? right : px);
+  *y = py < top ? top : (py > bottom ? bottom : py);
+  return 1;
+}
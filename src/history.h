@@ -0,0 +1,92 @@
+#ifndef _KPMOUSE_HISTORY_H_
+#define _KPMOUSE_HISTORY_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include <stdint.h>
+#include <stddef.h>
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/** Quadtree depth: the finest level splits each screen in 128x128 cells */
+#define KPM_HS_LEVELS  8
+#define KPM_HS_SIDE    (1 << (KPM_HS_LEVELS-1))
+/** Cells of all levels: 1 + 4 + 16 + ... + 4^(KPM_HS_LEVELS-1) */
+#define KPM_HS_CELLS   (((1 << 2*KPM_HS_LEVELS) - 1)/3)
+/** X screens and mouse buttons with a click history */
+#define KPM_HS_SCREENS 4
+#define KPM_HS_BUTTONS 3
+
+#define KPM_HS_MAGIC   "kpmhst1"
+
+/**
+ * Layout of the history file. For each screen and button, a complete
+ * quadtree of click counts is stored level by level (as a mipmap pyramid):
+ * level l has 2^l x 2^l cells, each counting the clicks in its quarter of
+ * the parent cell. Cell coordinates are relative to the screen size, so the
+ * history survives resolution changes.
+ *
+ * The file has a fixed size (about 512KiB). When the clicks of a screen and
+ * button reach KPM_HISTORY_MAX_CLICKS, all its counts are halved, which also
+ * makes old habits fade.
+ */
+typedef struct kpm_hs_file_s {
+  char magic[8];
+  uint32_t levels, screens, buttons, reserved;
+  uint16_t count[KPM_HS_SCREENS][KPM_HS_BUTTONS][KPM_HS_CELLS];
+} kpm_hs_file_t;
+
+/** Click history mapped from a file (see kpm_hs_path()) */
+typedef struct kpm_hs_s {
+  kpm_hs_file_t* file;
+} kpm_hs_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Path of the history file: the KPM_HISTORY environment variable, or
+ * $XDG_DATA_HOME/kpmouse/clicks, or ~/.local/share/kpmouse/clicks. The
+ * returned pointer is either buf or getenv() memory.
+ *
+ * @return the path, or NULL if there is no history file (or it is empty)
+ */
+const char* kpm_hs_path(char* buf, int size);
+
+/**
+ * Maps (creating if needed) the history file at path. A file with another
+ * layout is reset.
+ * @return 0 if successful, or an error code
+ */
+int kpm_hs_init(kpm_hs_t* hs, const char* path);
+
+/** Unmaps the history file. Counts are written back by the kernel */
+void kpm_hs_destroy(kpm_hs_t* hs);
+
+/**
+ * Counts a click of button (0-based) at (x, y) of a screen with size w by h.
+ */
+void kpm_hs_add(kpm_hs_t* hs, int screen, int button, int x, int y,
+                unsigned int w, unsigned int h);
+
+/**
+ * Finds the densest spot of past clicks (of any button) inside the
+ * rectangle at (left, top) with size rect_w by rect_h, on a screen with size
+ * w by h. The search descends the quadtree, always into the child with the
+ * most clicks that overlaps the rectangle, thus it takes O(KPM_HS_LEVELS).
+ *
+ * @return non-zero, with the center of the spot in *x and *y, if the spot has
+ *         at least min_clicks clicks; else 0
+ */
+int kpm_hs_predict(const kpm_hs_t* hs, int screen, unsigned int w,
+                   unsigned int h, int left, int top, unsigned int rect_w,
+                   unsigned int rect_h, unsigned int min_clicks,
+                   int* x, int* y);
+
+#endif /*_KPMOUSE_HISTORY_H_*/
@@ -0,0 +1,176 @@
+#include "keymap.h"
+#include "user_config.h"
+#include "errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+
+static const char* ACTION_NAMES[KPM_ACT_N] = {
+  NULL,
+  "move-tl", "move-cu", "move-tr", "move-cd",
+  "move-bl", "move-cl", "move-br", "move-cr",
+  "button-left", "button-middle", "button-right",
+  "undo", "center"
+};
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static kpm_action_t parse_action(const char* name) {
+  for (int i = 1; i < KPM_ACT_N; ++i) {
+    if (!strcmp(ACTION_NAMES[i], name))
+      return i;
+  }
+  return KPM_ACT_NONE;
+}
+
+/** Parses a KeySym name or keycode:N into bind. Returns 0 if invalid */
+static int parse_key(const char* tok, kpm_km_bind_t* bind) {
+  if (!strncmp(tok, "keycode:", 8)) {
+    char* end;
+    long code = strtol(tok+8, &end, 10);
+    if (*end || end == tok+8 || code < 8 || code > 255)
+      return 0;
+    bind->sym = NoSymbol;
+    bind->code = code;
+    return 1;
+  }
+  bind->sym = XStringToKeysym(tok);
+  bind->code = 0;
+  return bind->sym != NoSymbol;
+}
+
+static void add_bind(kpm_km_t* km, KeySym sym, KeyCode code,
+                     kpm_action_t action) {
+  if (km->n_binds < KPM_KM_MAX_BINDS) {
+    kpm_km_bind_t bind = {sym, code, action};
+    km->binds[km->n_binds++] = bind;
+  }
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+void kpm_km_defaults(kpm_km_t* km, int evdev, int grid) {
+  memset(km, 0, sizeof(kpm_km_t));
+  for (int i = 0; i < 8; ++i) {
+    if (evdev)
+      add_bind(km, NoSymbol, kpm_move_evdev[i] + 8, KPM_ACT_MOVE + i);
+    else
+      add_bind(km, kpm_move_sym[i], 0, KPM_ACT_MOVE + i);
+  }
+  if (grid == 3 && evdev)
+    add_bind(km, NoSymbol, KPM_CENTER_EVDEV + 8, KPM_ACT_CENTER);
+  else if (grid == 3)
+    add_bind(km, KPM_CENTER_SYM, 0, KPM_ACT_CENTER);
+  for (int i = 0; i < 6; ++i) {
+    unsigned short code = kpm_button_evdev[i];
+    KeySym sym = kpm_button_sym[i];
+    if (grid == 3 && code == KPM_CENTER_EVDEV)
+      code = KPM_GRID_BUTTON_EVDEV; // the center cell took its key
+    if (grid == 3 && sym == KPM_CENTER_SYM)
+      sym = KPM_GRID_BUTTON_SYM;
+    if (evdev && code)
+      add_bind(km, NoSymbol, code + 8, KPM_ACT_BUTTON + i%3);
+    else if (!evdev && sym)
+      add_bind(km, sym, 0, KPM_ACT_BUTTON + i%3);
+  }
+  if (evdev)
+    add_bind(km, NoSymbol, KPM_UNDO_EVDEV + 8, KPM_ACT_UNDO);
+  else
+    add_bind(km, KPM_UNDO_SYM, 0, KPM_ACT_UNDO);
+}
+
+const char* kpm_km_path(char* buf, int size) {
+  const char *env = getenv("KPM_CONFIG"), *dir;
+  int n;
+  if (env)
+    return env;
+  if ((dir = getenv("XDG_CONFIG_HOME")) && *dir)
+    n = snprintf(buf, size, "%s/kpmouse/keys.conf", dir);
+  else if ((dir = getenv("HOME")))
+    n = snprintf(buf, size, "%s/.config/kpmouse/keys.conf", dir);
+  else
+    return NULL;
+  return n < size ? buf : NULL;
+}
+
+int kpm_km_load(kpm_km_t* km, const char* path) {
+  FILE* in = fopen(path, "r");
+  if (!in) {
+    if (errno == ENOENT)
+      return KPM_SUCCESS;
+    perror(path);
+    return KPM_ERR_CONFIG;
+  }
+  kpm_km_t* tmp = calloc(1, sizeof(kpm_km_t));
+  if (!tmp) {
+    fclose(in);
+    return KPM_ERR_CONFIG;
+  }
+  char line[256];
+  int line_no = 0, err = KPM_SUCCESS;
+  while (!err && fgets(line, sizeof(line), in)) {
+    ++line_no;
+    char* save = NULL;
+    char* tok = strtok_r(line, " \t\r\n", &save);
+    if (!tok || *tok == '#')
+      continue;
+    kpm_action_t action = parse_action(tok);
+    if (action == KPM_ACT_NONE) {
+      fprintf(stderr, "%s:%d: unknown action \"%s\"\n", path, line_no, tok);
+      err = KPM_ERR_CONFIG;
+    }
+    while (!err && (tok = strtok_r(NULL, " \t\r\n", &save)) && *tok != '#') {
+      kpm_km_bind_t bind = {NoSymbol, 0, action};
+      if (!parse_key(tok, &bind)) {
+        fprintf(stderr, "%s:%d: bad key \"%s\"\n", path, line_no, tok);
+        err = KPM_ERR_CONFIG;
+      } else if (tmp->n_binds == KPM_KM_MAX_BINDS) {
+        fprintf(stderr, "%s:%d: too many bindings\n", path, line_no);
+        err = KPM_ERR_CONFIG;
+      } else {
+        tmp->binds[tmp->n_binds++] = bind;
+      }
+    }
+  }
+  fclose(in);
+  if (!err) {
+    memcpy(km->binds, tmp->binds, sizeof(km->binds));
+    km->n_binds = tmp->n_binds;
+  }
+  free(tmp);
+  return err;
+}
+
+void kpm_km_build(kpm_km_t* km, Display* dpy) {
+  memset(km->action, KPM_ACT_NONE, sizeof(km->action));
+  for (int i = 0; i < km->n_binds; ++i) {
+    const kpm_km_bind_t* bind = &km->binds[i];
+    KeyCode code = bind->code;
+    if (bind->sym != NoSymbol) {
+      if (!dpy)
+        continue; // KeySyms need a keyboard mapping
+      if (!(code = XKeysymToKeycode(dpy, bind->sym))) {
+        fprintf(stderr, "No KeyCode for KeySym %lx (%s), not binding it\n",
+                bind->sym, ACTION_NAMES[bind->action]);
+        continue;
+      }
+    }
+    km->action[code] = bind->action;
+  }
+}
+
+int kpm_km_codes(const kpm_km_t* km, KeyCode* codes) {
+  int n = 0;
+  for (int code = 0; code < 256; ++code) {
+    if (km->action[code] != KPM_ACT_NONE)
+      codes[n++] = code;
+  }
+  return n;
+}
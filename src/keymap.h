@@ -0,0 +1,105 @@
+#ifndef _KPMOUSE_KEYMAP_H_
+#define _KPMOUSE_KEYMAP_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include <X11/X.h>
+
+////////////////////////////////////////////
+// Third paty forward declarations
+////////////////////////////////////////////
+
+typedef struct _XDisplay Display; //X11/Xlib.h
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/**
+ * Action bound to a KeyCode. Moves are KPM_ACT_MOVE + kpm_move_t and buttons
+ * are KPM_ACT_BUTTON + kpm_button_t.
+ */
+typedef unsigned char kpm_action_t;
+
+/* vvvvvvvvvvvvvvvv Constants values for kpm_action_t vvvvvvvvvvvvvvv */
+#define KPM_ACT_NONE   0  ///< KeyCode not handled by kpmouse
+#define KPM_ACT_MOVE   1  ///< first of 8 moves
+#define KPM_ACT_BUTTON 9  ///< first of 3 mouse buttons
+#define KPM_ACT_UNDO   12 ///< KPM_UNDO_SYM
+#define KPM_ACT_CENTER 13 ///< move to the center cell (KPM_CC)
+#define KPM_ACT_N      14
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/** Maximum number of bindings in a kpm_km_t */
+#define KPM_KM_MAX_BINDS 64
+
+/** A binding as written in the config file, before KeySym resolution */
+typedef struct kpm_km_bind_s {
+  /** KeySym to bind, or NoSymbol if code is given instead */
+  KeySym sym;
+  KeyCode code;
+  kpm_action_t action;
+} kpm_km_bind_t;
+
+/**
+ * Key bindings and the KeyCode->action table compiled from them. The table
+ * must be rebuilt (kpm_km_build()) whenever the keyboard mapping changes.
+ */
+typedef struct kpm_km_s {
+  kpm_km_bind_t binds[KPM_KM_MAX_BINDS];
+  int n_binds;
+  /** action[code] is the action bound to the KeyCode code */
+  kpm_action_t action[256];
+} kpm_km_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Sets the bindings of user_config.c: the KeySym tables or, if evdev is
+ * non-zero, the evdev tables (bound as evdev code + 8). With a 3x3 grid
+ * (grid == 3), KPM_CENTER_SYM moves to the center cell and its button moves
+ * to KPM_GRID_BUTTON_SYM. The table is cleared.
+ */
+void kpm_km_defaults(kpm_km_t* km, int evdev, int grid);
+
+/**
+ * Path of the config file: $KPM_CONFIG, else $XDG_CONFIG_HOME/kpmouse/keys.conf
+ * or ~/.config/kpmouse/keys.conf. Returns NULL if no path can be made.
+ */
+const char* kpm_km_path(char* buf, int size);
+
+/**
+ * Replaces the bindings of km with those of the config file at path. Each
+ * line binds an action to KeySyms (names as in X11/keysymdef.h, without XK_)
+ * or to KeyCodes (keycode:N):
+ *
+ *     move-tl KP_Home
+ *     button-left KP_Divide KP_Begin
+ *     undo keycode:90
+ *
+ * If the file does not exist, km is left as is and 0 is returned. The table
+ * is not rebuilt.
+ *
+ * @return 0 if successful, or an error code (km is unchanged on errors)
+ */
+int kpm_km_load(kpm_km_t* km, const char* path);
+
+/**
+ * Rebuilds km->action from the bindings, resolving KeySyms with the current
+ * keyboard mapping of dpy. If dpy is NULL, KeySym bindings are ignored.
+ * KeySyms without a KeyCode are reported and skipped.
+ */
+void kpm_km_build(kpm_km_t* km, Display* dpy);
+
+/**
+ * Stores into codes (room for 256) the KeyCodes with an action.
+ * @return how many KeyCodes were stored
+ */
+int kpm_km_codes(const kpm_km_t* km, KeyCode* codes);
+
+#endif /*_KPMOUSE_KEYMAP_H_*/
@@ -0,0 +1,130 @@
+#include "latency.h"
+#include "util.h"
+#include <string.h>
+
+static const char* STAGE_NAMES[KPM_LAT_N_STAGES] = {
+  "queue", "dispatch", "compute", "inject", "total"
+};
+static const char* ACTION_NAMES[KPM_LAT_N_ACTIONS] = {
+  "move", "button", "undo"
+};
+
+/** Input timestamps further than this in the past are bogus */
+#define MAX_QUEUE_NS (10*1000000000LL)
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static int bucket_of(uint64_t value) {
+  if (value >> KPM_HIST_MAX_BITS)
+    return KPM_HIST_BUCKETS - 1;
+  if (value < (1 << KPM_HIST_SUB_BITS))
+    return value;
+  int e = 63 - __builtin_clzll(value);
+  int shift = e - KPM_HIST_SUB_BITS;
+  return ((shift + 1) << KPM_HIST_SUB_BITS)
+       + ((value >> shift) & ((1 << KPM_HIST_SUB_BITS) - 1));
+}
+
+/** Smallest value that falls into bucket b */
+static uint64_t bucket_low(int b) {
+  if (b < (1 << KPM_HIST_SUB_BITS))
+    return b;
+  int shift = (b >> KPM_HIST_SUB_BITS) - 1;
+  uint64_t sub = b & ((1 << KPM_HIST_SUB_BITS) - 1);
+  return ((1ULL << KPM_HIST_SUB_BITS) | sub) << shift;
+}
+
+static void record(kpm_lat_t* lat, const kpm_lat_rec_t* rec, int64_t flush) {
+  if (rec->action < 0 || rec->action >= KPM_LAT_N_ACTIONS)
+    return;
+  kpm_hist_t* hist = lat->hist[rec->action];
+  if (rec->input && rec->dequeue - rec->input < MAX_QUEUE_NS) {
+    kpm_hist_add(&hist[KPM_LAT_QUEUE], rec->dequeue - rec->input);
+    kpm_hist_add(&hist[KPM_LAT_TOTAL], flush - rec->input);
+  }
+  kpm_hist_add(&hist[KPM_LAT_DISPATCH], rec->dispatch - rec->dequeue);
+  kpm_hist_add(&hist[KPM_LAT_COMPUTE], rec->compute - rec->dispatch);
+  kpm_hist_add(&hist[KPM_LAT_INJECT], flush - rec->compute);
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+void kpm_lat_init(kpm_lat_t* lat) {
+  memset(lat, 0, sizeof(kpm_lat_t));
+  lat->cur.action = -1;
+}
+
+void kpm_hist_add(kpm_hist_t* hist, uint64_t value) {
+  if ((int64_t)value < 0)
+    value = 0; // clock went backwards
+  ++hist->buckets[bucket_of(value)];
+  ++hist->count;
+  if (value > hist->max)
+    hist->max = value;
+}
+
+uint64_t kpm_hist_quantile(const kpm_hist_t* hist, double q) {
+  uint64_t target = (uint64_t)(q*hist->count + 0.5), seen = 0;
+  if (target == 0)
+    target = 1;
+  for (int b = 0; b < KPM_HIST_BUCKETS; ++b) {
+    seen += hist->buckets[b];
+    if (seen >= target) {
+      uint64_t high = b+1 < KPM_HIST_BUCKETS ? bucket_low(b+1) - 1 : hist->max;
+      return high < hist->max ? high : hist->max;
+    }
+  }
+  return hist->max;
+}
+
+void kpm_lat_begin(kpm_lat_t* lat, int64_t input_ns) {
+  lat->cur.input = input_ns;
+  lat->cur.dequeue = kpm__now_ns();
+  lat->cur.action = -1;
+}
+
+void kpm_lat_dispatch(kpm_lat_t* lat, int action) {
+  lat->cur.dispatch = kpm__now_ns();
+  lat->cur.action = action >= 0 && action < KPM_LAT_N_ACTIONS ? action : -1;
+}
+
+void kpm_lat_computed(kpm_lat_t* lat) {
+  if (lat->cur.action < 0)
+    return; // no kpm_lat_begin()/kpm_lat_dispatch()
+  lat->cur.compute = kpm__now_ns();
+  if (lat->n_batch == KPM_LAT_BATCH)
+    kpm_lat_flushed(lat); // too many actions, assume flushed now
+  lat->batch[lat->n_batch++] = lat->cur;
+  lat->cur.action = -1;
+}
+
+void kpm_lat_flushed(kpm_lat_t* lat) {
+  if (!lat->n_batch)
+    return;
+  int64_t now = kpm__now_ns();
+  for (int i = 0; i < lat->n_batch; ++i)
+    record(lat, &lat->batch[i], now);
+  lat->n_batch = 0;
+}
+
+void kpm_lat_dump(const kpm_lat_t* lat, FILE* out) {
+  fprintf(out, "%-7s %-9s %9s %10s %10s %10s %10s\n", "action", "stage",
+          "count", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+  for (int a = 0; a < KPM_LAT_N_ACTIONS; ++a) {
+    for (int s = 0; s < KPM_LAT_N_STAGES; ++s) {
+      const kpm_hist_t* h = &lat->hist[a][s];
+      if (!h->count)
+        continue;
+      fprintf(out, "%-7s %-9s %9llu %10.1f %10.1f %10.1f %10.1f\n",
+              ACTION_NAMES[a], STAGE_NAMES[s], (unsigned long long)h->count,
+              kpm_hist_quantile(h, 0.5)/1000.0,
+              kpm_hist_quantile(h, 0.99)/1000.0,
+              kpm_hist_quantile(h, 0.999)/1000.0, h->max/1000.0);
+    }
+  }
+  fflush(out);
+}
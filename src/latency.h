@@ -0,0 +1,116 @@
+#ifndef _KPMOUSE_LATENCY_H_
+#define _KPMOUSE_LATENCY_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/**
+ * Each power of two is split into 2^KPM_HIST_SUB_BITS buckets, thus any
+ * recorded value is off by at most 1/2^KPM_HIST_SUB_BITS (6.25%).
+ */
+#define KPM_HIST_SUB_BITS 4
+
+/** Values (nanoseconds) above 2^KPM_HIST_MAX_BITS are clamped */
+#define KPM_HIST_MAX_BITS 40
+
+#define KPM_HIST_BUCKETS \
+  ((KPM_HIST_MAX_BITS - KPM_HIST_SUB_BITS + 1) << KPM_HIST_SUB_BITS)
+
+/** Fixed-memory histogram with logarithmic buckets and linear sub-buckets */
+typedef struct kpm_hist_s {
+  uint64_t count;
+  uint64_t max;
+  uint32_t buckets[KPM_HIST_BUCKETS];
+} kpm_hist_t;
+
+/* vvvvvvvvvvvvvvvvvvvvvvv Latency stages vvvvvvvvvvvvvvvvvvvvvvvvvvvv */
+#define KPM_LAT_QUEUE    0 ///< input event timestamp to dequeue
+#define KPM_LAT_DISPATCH 1 ///< dequeue to action identified
+#define KPM_LAT_COMPUTE  2 ///< state update (injection requests included)
+#define KPM_LAT_INJECT   3 ///< until the injection flush completed
+#define KPM_LAT_TOTAL    4 ///< input event timestamp to flush completed
+#define KPM_LAT_N_STAGES 5
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* vvvvvvvvvvvvvvvvvvvvvvv Action types vvvvvvvvvvvvvvvvvvvvvvvvvvvvvv */
+#define KPM_LAT_MOVE      0
+#define KPM_LAT_BUTTON    1
+#define KPM_LAT_UNDO      2
+#define KPM_LAT_N_ACTIONS 3
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/** Maximum number of actions measured between two flushes */
+#define KPM_LAT_BATCH 64
+
+/** Timestamps of an action, in CLOCK_MONOTONIC nanoseconds */
+typedef struct kpm_lat_rec_s {
+  /** Input event timestamp, or 0 if unknown */
+  int64_t input;
+  int64_t dequeue, dispatch, compute;
+  /** KPM_LAT_MOVE, KPM_LAT_BUTTON or KPM_LAT_UNDO, or -1 if not dispatched */
+  signed char action;
+} kpm_lat_rec_t;
+
+/**
+ * Per-stage latency histograms of each action type. Actions are recorded in
+ * three calls: kpm_lat_begin() when the input event is dequeued,
+ * kpm_lat_dispatch() when its action is known and kpm_lat_computed() when the
+ * state has been updated. kpm_lat_flushed() completes all actions since the
+ * previous flush.
+ */
+typedef struct kpm_lat_s {
+  kpm_hist_t hist[KPM_LAT_N_ACTIONS][KPM_LAT_N_STAGES];
+  /** Action currently being handled */
+  kpm_lat_rec_t cur;
+  /** Actions computed, but not yet flushed */
+  kpm_lat_rec_t batch[KPM_LAT_BATCH];
+  int n_batch;
+} kpm_lat_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/** Zero all histograms */
+void kpm_lat_init(kpm_lat_t* lat);
+
+/** Add a value to the histogram */
+void kpm_hist_add(kpm_hist_t* hist, uint64_t value);
+
+/**
+ * Value below which a fraction q (0 <= q <= 1) of the recorded values lie.
+ * The result is the upper limit of the bucket holding that value.
+ */
+uint64_t kpm_hist_quantile(const kpm_hist_t* hist, double q);
+
+/**
+ * An input event with timestamp input_ns (CLOCK_MONOTONIC nanoseconds, or 0
+ * if unknown) was dequeued.
+ */
+void kpm_lat_begin(kpm_lat_t* lat, int64_t input_ns);
+
+/**
+ * The current input event triggered an action of the given type (one of the
+ * KPM_LAT_ action types, others are not recorded)
+ */
+void kpm_lat_dispatch(kpm_lat_t* lat, int action);
+
+/** The state was updated for the current action */
+void kpm_lat_computed(kpm_lat_t* lat);
+
+/** Injected events were flushed: record all computed actions */
+void kpm_lat_flushed(kpm_lat_t* lat);
+
+/** Write p50/p99/p999/max of every non-empty histogram to out */
+void kpm_lat_dump(const kpm_lat_t* lat, FILE* out);
+
+#endif /*_KPMOUSE_LATENCY_H_*/
@@ -0,0 +1,225 @@
+#include "loop.h"
+#include "errors.h"
+#include "util.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+/** epoll_event.data.u32 of the timer_fd */
+#define TIMER_SRC KPM_LP_MAX_SRCS
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+/** Programs timer_fd for the earliest armed timer, if not already done */
+static int update_timer_fd(kpm_lp_t* lp) {
+  long int deadline = lp->timers ? lp->timers->deadline : -1;
+  if (deadline == lp->timer_fd_deadline)
+    return KPM_SUCCESS;
+  struct itimerspec spec = {{0, 0}, {0, 0}};
+  if (deadline >= 0) {
+    spec.it_value.tv_sec = deadline/1000;
+    spec.it_value.tv_nsec = (deadline%1000)*1000000L + 1; // 0 disarms
+  }
+  KPM_RET2(KPM_ERR_TIMERFD, timerfd_settime,
+           lp->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+  lp->timer_fd_deadline = deadline;
+  return KPM_SUCCESS;
+}
+
+/** Calls cb(data), recording data as lp->failed if it fails */
+static int call(kpm_lp_t* lp, kpm_lp_cb_t cb, void* data) {
+  int err = cb(data);
+  if (err)
+    lp->failed = data;
+  return err;
+}
+
+/** Calls the callbacks of all timers whose deadline is not after now */
+static int run_timers(kpm_lp_t* lp, long int now) {
+  while (lp->timers && lp->timers->deadline <= now) {
+    kpm_tm_t* tm = lp->timers;
+    lp->timers = tm->next;
+    tm->armed = 0;
+    if (lp->virtual_clock)
+      lp->now_ms = tm->deadline;
+    KPM_RET(call, lp, tm->cb, tm->data);
+  }
+  return KPM_SUCCESS;
+}
+
+/** Calls the callbacks of all timers whose deadline has passed */
+static int expire_timers(kpm_lp_t* lp) {
+  unsigned long long expirations;
+  if (read(lp->timer_fd, &expirations, sizeof(expirations)) < 0
+      && errno != EAGAIN) {
+    perror("read(timer_fd)");
+    return KPM_ERR_TIMERFD;
+  }
+  lp->timer_fd_deadline = -1; // one-shot timerfd, it is now disarmed
+  return run_timers(lp, kpm__now_ms());
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+int kpm_lp_init(kpm_lp_t* lp) {
+  memset(lp, 0, sizeof(kpm_lp_t));
+  for (int i = 0; i < KPM_LP_MAX_SRCS; ++i)
+    lp->srcs[i].fd = -1;
+  lp->timer_fd_deadline = -1;
+  lp->timer_fd = -1;
+  if ((lp->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    perror("epoll_create1()");
+    return KPM_ERR_EPOLL;
+  }
+  lp->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+  if (lp->timer_fd < 0) {
+    perror("timerfd_create()");
+    return KPM_ERR_TIMERFD;
+  }
+  struct epoll_event ev = {EPOLLIN, {.u32 = TIMER_SRC}};
+  KPM_RET2(KPM_ERR_EPOLL, epoll_ctl,
+           lp->epoll_fd, EPOLL_CTL_ADD, lp->timer_fd, &ev);
+  return KPM_SUCCESS;
+}
+
+void kpm_lp_init_virtual(kpm_lp_t* lp, long int now_ms) {
+  memset(lp, 0, sizeof(kpm_lp_t));
+  for (int i = 0; i < KPM_LP_MAX_SRCS; ++i)
+    lp->srcs[i].fd = -1;
+  lp->timer_fd_deadline = -1;
+  lp->timer_fd = lp->epoll_fd = -1;
+  lp->virtual_clock = 1;
+  lp->now_ms = now_ms;
+}
+
+void kpm_lp_destroy(kpm_lp_t* lp) {
+  if (lp->timer_fd >= 0)
+    close(lp->timer_fd);
+  if (lp->epoll_fd >= 0)
+    close(lp->epoll_fd);
+  lp->timer_fd = lp->epoll_fd = -1;
+}
+
+int kpm_lp_add(kpm_lp_t* lp, int fd, kpm_lp_cb_t cb,
+               int (*pending)(void*), void* data) {
+  if (lp->virtual_clock) {
+    fprintf(stderr, "kpm_lp_add(): virtual clock loops have no sources\n");
+    return KPM_ERR_EPOLL;
+  }
+  int i = 0;
+  while (i < KPM_LP_MAX_SRCS && lp->srcs[i].fd >= 0)
+    ++i;
+  if (i == KPM_LP_MAX_SRCS) {
+    fprintf(stderr, "kpm_lp_add(): too many sources\n");
+    return KPM_ERR_EPOLL;
+  }
+  struct epoll_event ev = {EPOLLIN, {.u32 = i}};
+  KPM_RET2(KPM_ERR_EPOLL, epoll_ctl, lp->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  kpm_lp_src_t src = {fd, cb, pending, data};
+  lp->srcs[i] = src;
+  return KPM_SUCCESS;
+}
+
+void kpm_lp_del(kpm_lp_t* lp, int fd) {
+  for (int i = 0; i < KPM_LP_MAX_SRCS; ++i) {
+    if (lp->srcs[i].fd == fd) {
+      KPM_CHK2(KPM_ERR_EPOLL, epoll_ctl, lp->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+      lp->srcs[i].fd = -1;
+    }
+  }
+}
+
+long int kpm_lp_now(const kpm_lp_t* lp) {
+  return lp->virtual_clock ? lp->now_ms : kpm__now_ms();
+}
+
+int kpm_lp_advance(kpm_lp_t* lp, long int now_ms) {
+  lp->failed = NULL;
+  KPM_RET(run_timers, lp, now_ms);
+  if (now_ms > lp->now_ms)
+    lp->now_ms = now_ms;
+  return KPM_SUCCESS;
+}
+
+void kpm_tm_init(kpm_tm_t* tm, kpm_lp_cb_t cb, void* data) {
+  memset(tm, 0, sizeof(kpm_tm_t));
+  tm->cb = cb;
+  tm->data = data;
+}
+
+void kpm_lp_arm(kpm_lp_t* lp, kpm_tm_t* tm, long int delay_ms) {
+  kpm_lp_arm_at(lp, tm, kpm_lp_now(lp) + delay_ms);
+}
+
+void kpm_lp_arm_at(kpm_lp_t* lp, kpm_tm_t* tm, long int deadline_ms) {
+  kpm_lp_disarm(lp, tm);
+  tm->deadline = deadline_ms;
+  tm->armed = 1;
+  kpm_tm_t** it = &lp->timers;
+  while (*it && (*it)->deadline <= tm->deadline)
+    it = &(*it)->next;
+  tm->next = *it;
+  *it = tm;
+}
+
+void kpm_lp_rearm(kpm_lp_t* lp, kpm_tm_t* tm, long int period_ms) {
+  long int now = kpm_lp_now(lp), next = tm->deadline + period_ms;
+  kpm_lp_arm_at(lp, tm, next > now ? next : now + period_ms);
+}
+
+void kpm_lp_disarm(kpm_lp_t* lp, kpm_tm_t* tm) {
+  if (!tm->armed)
+    return;
+  for (kpm_tm_t** it = &lp->timers; *it; it = &(*it)->next) {
+    if (*it == tm) {
+      *it = tm->next;
+      break;
+    }
+  }
+  tm->next = NULL;
+  tm->armed = 0;
+}
+
+int kpm_lp_step(kpm_lp_t* lp) {
+  int timeout = -1;
+  lp->failed = NULL;
+  for (int i = 0; i < KPM_LP_MAX_SRCS; ++i) {
+    kpm_lp_src_t* src = &lp->srcs[i];
+    if (src->fd >= 0 && src->pending && src->pending(src->data)) {
+      KPM_RET(call, lp, src->cb, src->data);
+      timeout = 0; // do not block, only collect what is ready
+    }
+  }
+  KPM_RET(update_timer_fd, lp);
+
+  struct epoll_event evs[KPM_LP_MAX_SRCS+1];
+  int n = epoll_wait(lp->epoll_fd, evs, KPM_LP_MAX_SRCS+1, timeout);
+  if (n < 0) {
+    if (errno == EINTR)
+      return KPM_SUCCESS;
+    perror("epoll_wait()");
+    return KPM_ERR_EPOLL;
+  }
+  for (int i = 0; i < n; ++i) {
+    unsigned int idx = evs[i].data.u32;
+    if (idx == TIMER_SRC) {
+      KPM_RET(expire_timers, lp);
+    } else if (lp->srcs[idx].fd >= 0) {
+      KPM_RET(call, lp, lp->srcs[idx].cb, lp->srcs[idx].data);
+    }
+  }
+  return KPM_SUCCESS;
+}
+
+int kpm_lp_run(kpm_lp_t* lp) {
+  int err;
+  while (!(err = kpm_lp_step(lp))) ;
+  return err;
+}
@@ -0,0 +1,159 @@
+#ifndef _KPMOUSE_LOOP_H_
+#define _KPMOUSE_LOOP_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/**
+ * Maximum number of file descriptors watched by a kpm_lp_t. Enough for one X
+ * connection per display of a kpm_dm_t (see displays.h) plus the signalfd.
+ */
+#define KPM_LP_MAX_SRCS 128
+
+/** Callback of timers and sources. Returns 0 or an error code */
+typedef int (*kpm_lp_cb_t)(void* data);
+
+/**
+ * A one-shot timer. The memory is owned by the caller (usually embedded in
+ * the object that is the timer data) and must outlive the time the timer is
+ * armed on a kpm_lp_t.
+ */
+typedef struct kpm_tm_s {
+  /** Time (see kpm_lp_now()) at which cb will be called */
+  long int deadline;
+  kpm_lp_cb_t cb;
+  void* data;
+  /** Next armed timer in kpm_lp_t.timers */
+  struct kpm_tm_s* next;
+  char armed;
+} kpm_tm_t;
+
+/** A file descriptor watched by the loop */
+typedef struct kpm_lp_src_s {
+  /** File descriptor, or -1 if this slot is free */
+  int fd;
+  /** Called when fd is readable */
+  kpm_lp_cb_t cb;
+  /**
+   * If not NULL, called before the loop blocks. A non-zero return means the
+   * source has data already buffered in user space (e.g., the Xlib event
+   * queue), and cb will be called without waiting for fd to be readable.
+   */
+  int (*pending)(void* data);
+  void* data;
+} kpm_lp_src_t;
+
+/**
+ * Event loop over epoll. Timers are kept in a short list sorted by deadline
+ * and a single timerfd is armed for the earliest one. If there are no armed
+ * timers, the loop only wakes up when a source becomes readable.
+ *
+ * A loop created with kpm_lp_init_virtual() has no file descriptors: its
+ * clock only moves when kpm_lp_advance() is called, which makes everything
+ * driven by its timers deterministic (see tools/kpm_replay.c).
+ */
+typedef struct kpm_lp_s {
+  int epoll_fd;
+  int timer_fd;
+  /** Non-zero if time is given by now_ms instead of CLOCK_MONOTONIC */
+  char virtual_clock;
+  /** Current time of a virtual clock, in milliseconds */
+  long int now_ms;
+  /** Deadline currently programmed on timer_fd, or -1 if disarmed */
+  long int timer_fd_deadline;
+  /** Armed timers, sorted by deadline */
+  kpm_tm_t* timers;
+  kpm_lp_src_t srcs[KPM_LP_MAX_SRCS];
+  /**
+   * data of the source or timer whose callback failed the last
+   * kpm_lp_step() or kpm_lp_advance(), or NULL
+   */
+  void* failed;
+} kpm_lp_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Initializes the loop with no sources and no timers.
+ * @return 0 if successful, or an error code
+ */
+int kpm_lp_init(kpm_lp_t* lp);
+
+/**
+ * Initializes a loop with a virtual clock, starting at now_ms. Sources cannot
+ * be added and kpm_lp_step() must not be called, timers only fire from
+ * kpm_lp_advance().
+ */
+void kpm_lp_init_virtual(kpm_lp_t* lp, long int now_ms);
+
+/** Releases the epoll and timer file descriptors. Sources are not closed. */
+void kpm_lp_destroy(kpm_lp_t* lp);
+
+/**
+ * Watch fd for readability, calling cb(data) when it is readable. See
+ * kpm_lp_src_t.pending for the meaning of pending, which can be NULL.
+ *
+ * @return 0 if successful, or an error code
+ */
+int kpm_lp_add(kpm_lp_t* lp, int fd, kpm_lp_cb_t cb,
+               int (*pending)(void*), void* data);
+
+/** Stop watching fd. */
+void kpm_lp_del(kpm_lp_t* lp, int fd);
+
+/**
+ * Current time of the loop in milliseconds: CLOCK_MONOTONIC, or the virtual
+ * clock (see kpm_lp_init_virtual()). Timer deadlines are in this clock.
+ */
+long int kpm_lp_now(const kpm_lp_t* lp);
+
+/**
+ * Moves a virtual clock forward to now_ms. Expired timers are called in
+ * deadline order, each one seeing its own deadline as the current time.
+ *
+ * @return 0 if successful, or the error code of the first failed callback.
+ */
+int kpm_lp_advance(kpm_lp_t* lp, long int now_ms);
+
+/** Sets tm callback and data. tm is left disarmed. */
+void kpm_tm_init(kpm_tm_t* tm, kpm_lp_cb_t cb, void* data);
+
+/** Arms (or re-arms) tm to fire after delay_ms milliseconds. */
+void kpm_lp_arm(kpm_lp_t* lp, kpm_tm_t* tm, long int delay_ms);
+
+/** Arms (or re-arms) tm to fire at the time deadline_ms (see kpm_lp_now()) */
+void kpm_lp_arm_at(kpm_lp_t* lp, kpm_tm_t* tm, long int deadline_ms);
+
+/**
+ * Re-arms an expired tm period_ms after its last deadline, for periodic
+ * timers. Periods already in the past are skipped rather than fired late.
+ */
+void kpm_lp_rearm(kpm_lp_t* lp, kpm_tm_t* tm, long int period_ms);
+
+/** Disarms tm. Has no effect if tm is not armed. */
+void kpm_lp_disarm(kpm_lp_t* lp, kpm_tm_t* tm);
+
+/**
+ * Wait until at least one source is readable or a timer expires and dispatch
+ * all readable sources and expired timers.
+ *
+ * @return 0 if successful, or the error code of the first failed callback.
+ */
+int kpm_lp_step(kpm_lp_t* lp);
+
+/**
+ * Run kpm_lp_step() until it fails.
+ * @return Error code of the failed kpm_lp_step()
+ */
+int kpm_lp_run(kpm_lp_t* lp);
+
+#endif /*_KPMOUSE_LOOP_H_*/
@@ -0,0 +1,179 @@
+#include "macro.h"
+#include "errors.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* SLOT_NAMES[KPM_MC_SLOTS] = {
+  "tl", "cu", "tr", "cd", "bl", "cl", "br", "cr"
+};
+static const char* BUTTON_NAMES[3] = {"left", "middle", "right"};
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+/** Last move of macro, or NULL if it has none */
+static const kpm_mc_step_t* last_move(const kpm_mc_macro_t* macro) {
+  for (int i = macro->n-1; i >= 0; --i) {
+    if (macro->steps[i].type == KPM_MC_MOVE)
+      return &macro->steps[i];
+  }
+  return NULL;
+}
+
+static int parse_button(const char* name) {
+  for (int b = 0; b < 3; ++b) {
+    if (!strcmp(name, BUTTON_NAMES[b]))
+      return b;
+  }
+  return -1;
+}
+
+static int slot_path(const kpm_mc_t* mc, int slot, char* buf, int size) {
+  return snprintf(buf, size, "%s/%s", mc->dir, SLOT_NAMES[slot]) < size;
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+const char* kpm_mc_dir(char* buf, int size) {
+  const char *env = getenv("KPM_MACROS"), *dir;
+  int n;
+  if (env)
+    return *env ? env : NULL;
+  if ((dir = getenv("XDG_DATA_HOME")) && *dir)
+    n = snprintf(buf, size, "%s/kpmouse/macros", dir);
+  else if ((dir = getenv("HOME")))
+    n = snprintf(buf, size, "%s/.local/share/kpmouse/macros", dir);
+  else
+    return NULL;
+  return n < size ? buf : NULL;
+}
+
+void kpm_mc_init(kpm_mc_t* mc, const char* dir) {
+  char path[1100];
+  memset(mc, 0, sizeof(kpm_mc_t));
+  if (!dir || snprintf(mc->dir, sizeof(mc->dir), "%s", dir)
+                  >= (int)sizeof(mc->dir)) {
+    *mc->dir = '\0';
+    return;
+  }
+  for (int i = 0; i < KPM_MC_SLOTS; ++i) {
+    if (slot_path(mc, i, path, sizeof(path)))
+      kpm_mc_load(&mc->slot[i], path);
+  }
+}
+
+const char* kpm_mc_name(int slot) {
+  return slot >= 0 && slot < KPM_MC_SLOTS ? SLOT_NAMES[slot] : "?";
+}
+
+void kpm_mc_record(kpm_mc_t* mc) {
+  mc->recording = 1;
+  mc->truncated = 0;
+  mc->rec.n = 0;
+}
+
+void kpm_mc_add(kpm_mc_t* mc, const kpm_mc_step_t* step) {
+  kpm_mc_macro_t* rec = &mc->rec;
+  if (!mc->recording)
+    return;
+  if (step->type == KPM_MC_MOVE) {
+    const kpm_mc_step_t* last = last_move(rec);
+    if (last && last->x == step->x && last->y == step->y
+        && last->screen == step->screen) {
+      return; // the pointer is already there
+    }
+    if (rec->n && rec->steps[rec->n-1].type == KPM_MC_MOVE) {
+      rec->steps[rec->n-1] = *step; // only where the pointer ended matters
+      return;
+    }
+  }
+  if (rec->n == KPM_MC_MAX_STEPS) {
+    mc->truncated = 1;
+    return;
+  }
+  rec->steps[rec->n++] = *step;
+}
+
+int kpm_mc_store(kpm_mc_t* mc, int slot) {
+  char path[1100];
+  mc->recording = 0;
+  if (mc->truncated) {
+    fprintf(stderr, "Macro %s truncated to %d steps\n", SLOT_NAMES[slot],
+            KPM_MC_MAX_STEPS);
+  }
+  memcpy(&mc->slot[slot], &mc->rec, sizeof(kpm_mc_macro_t));
+  if (!*mc->dir)
+    return KPM_SUCCESS;
+  if (!slot_path(mc, slot, path, sizeof(path)))
+    return KPM_ERR_MACRO;
+  kpm__make_parents(path);
+  return kpm_mc_save(&mc->slot[slot], path);
+}
+
+int kpm_mc_save(const kpm_mc_macro_t* macro, const char* path) {
+  char tmp[1100];
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+    return KPM_ERR_MACRO;
+  FILE* out = fopen(tmp, "w");
+  if (!out) {
+    perror(tmp);
+    return KPM_ERR_MACRO;
+  }
+  for (int i = 0; i < macro->n; ++i) {
+    const kpm_mc_step_t* s = &macro->steps[i];
+    if (s->type == KPM_MC_MOVE)
+      fprintf(out, "move %d %d %d\n", s->x, s->y, s->screen);
+    else
+      fprintf(out, "%s %s\n", s->type == KPM_MC_DOWN ? "down" : "up",
+              BUTTON_NAMES[s->button]);
+  }
+  if (fclose(out) || rename(tmp, path)) { // readers never see half a file
+    perror(path);
+    remove(tmp);
+    return KPM_ERR_MACRO;
+  }
+  return KPM_SUCCESS;
+}
+
+int kpm_mc_load(kpm_mc_macro_t* macro, const char* path) {
+  char line[256], op[16], name[16];
+  int n_line = 0;
+  macro->n = 0;
+  FILE* in = fopen(path, "r");
+  if (!in)
+    return KPM_ERR_MACRO; // no macro in this slot
+  while (fgets(line, sizeof(line), in)) {
+    kpm_mc_step_t s = {KPM_MC_MOVE, 0, 0, 0, 0};
+    int button = -1;
+    ++n_line;
+    if (sscanf(line, "%15s", op) != 1 || *op == '#')
+      continue;
+    if (!strcmp(op, "move")) {
+      if (sscanf(line, "%*s %d %d %d", &s.x, &s.y, &s.screen) != 3)
+        goto fail;
+    } else if (sscanf(line, "%*s %15s", name) == 1
+               && (button = parse_button(name)) >= 0
+               && (!strcmp(op, "down") || !strcmp(op, "up"))) {
+      s.type = !strcmp(op, "down") ? KPM_MC_DOWN : KPM_MC_UP;
+      s.button = button;
+    } else {
+      goto fail;
+    }
+    if (macro->n == KPM_MC_MAX_STEPS)
+      goto fail;
+    macro->steps[macro->n++] = s;
+  }
+  fclose(in);
+  return KPM_SUCCESS;
+
+fail:
+  fprintf(stderr, "%s:%d: bad macro step\n", path, n_line);
+  fclose(in);
+  macro->n = 0;
+  return KPM_ERR_MACRO;
+}
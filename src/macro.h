@@ -0,0 +1,109 @@
+#ifndef _KPMOUSE_MACRO_H_
+#define _KPMOUSE_MACRO_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/** Maximum number of steps in a macro */
+#define KPM_MC_MAX_STEPS 128
+
+/** Number of macros, one per kpm_move_t (the key that plays it) */
+#define KPM_MC_SLOTS 8
+
+/* vvvvvvvvvvvvvvvvvvvvvvvvv Macro step types vvvvvvvvvvvvvvvvvvvvvvvvv */
+#define KPM_MC_MOVE 0 ///< move the pointer to (x, y) of screen
+#define KPM_MC_DOWN 1 ///< button down
+#define KPM_MC_UP   2 ///< button up
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/** A resolved pointer action: where the pointer went or a button event */
+typedef struct kpm_mc_step_s {
+  unsigned char type;
+  /** kpm_button_t of KPM_MC_DOWN and KPM_MC_UP */
+  unsigned char button;
+  int x, y, screen;
+} kpm_mc_step_t;
+
+typedef struct kpm_mc_macro_s {
+  int n;
+  kpm_mc_step_t steps[KPM_MC_MAX_STEPS];
+} kpm_mc_macro_t;
+
+/**
+ * Macros, recorded from the actions kpmouse injects and stored, one file per
+ * slot, in a directory. Recording keeps only the pointer positions that
+ * matter: consecutive moves collapse into the last one.
+ */
+typedef struct kpm_mc_s {
+  /** Directory with the macro files, or empty if they are not saved */
+  char dir[1024];
+  kpm_mc_macro_t slot[KPM_MC_SLOTS];
+
+  /** Non-zero while recording into rec */
+  char recording;
+  /** Non-zero if steps were dropped because rec was full */
+  char truncated;
+  kpm_mc_macro_t rec;
+} kpm_mc_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Directory of the macro files: the KPM_MACROS environment variable, or
+ * $XDG_DATA_HOME/kpmouse/macros or ~/.local/share/kpmouse/macros. The
+ * returned pointer is either buf or getenv() memory.
+ *
+ * @return the directory, or NULL if macros are not saved (KPM_MACROS is
+ *         empty or there is no HOME)
+ */
+const char* kpm_mc_dir(char* buf, int size);
+
+/**
+ * Loads the macros saved in dir (NULL if they are not saved). Missing or
+ * unreadable files leave their slots empty.
+ */
+void kpm_mc_init(kpm_mc_t* mc, const char* dir);
+
+/** Name of a slot, also the name of its file: "tl", "cu", ... */
+const char* kpm_mc_name(int slot);
+
+/** Starts recording, dropping any recording in progress */
+void kpm_mc_record(kpm_mc_t* mc);
+
+/** Appends a step to the recording, if recording */
+void kpm_mc_add(kpm_mc_t* mc, const kpm_mc_step_t* step);
+
+/**
+ * Ends the recording, storing it into slot and saving it to its file.
+ * @return 0 if successful, or KPM_ERR_MACRO if the file could not be written
+ */
+int kpm_mc_store(kpm_mc_t* mc, int slot);
+
+/**
+ * Writes macro to the file at path, as one step per line:
+ *
+ *     move X Y SCREEN
+ *     down BUTTON
+ *     up BUTTON
+ *
+ * where BUTTON is left, middle or right.
+ * @return 0 if successful, or KPM_ERR_MACRO
+ */
+int kpm_mc_save(const kpm_mc_macro_t* macro, const char* path);
+
+/**
+ * Reads a macro from the file at path, in the format of kpm_mc_save().
+ * @return 0 if successful, or KPM_ERR_MACRO (macro is then empty)
+ */
+int kpm_mc_load(kpm_mc_macro_t* macro, const char* path);
+
+#endif /*_KPMOUSE_MACRO_H_*/
@@ -1,38 +1,276 @@
 #include "state.h"
 #include "event_loop.h"
+#include "evdev.h"
+#include "control.h"
+#include "status.h"
+#include "displays.h"
+#include "mpx.h"
+#include "trace.h"
+#include "util.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/signalfd.h>
 #include <X11/Xlib.h>
 
 
-#define G_ERR_BUF_LEN 1024
-static char g_err_buf[G_ERR_BUF_LEN];
+#define ERR_BUF_LEN 1024
+static int g_signal_fd = -1;
+static kpm_lat_t g_lat;
+/** Displays served in multi-display mode (KPM_DISPLAYS), or NULL */
+static kpm_dm_t* g_dm;
+/** Keypads served in multi-pointer mode (KPM_MPX), or NULL */
+static kpm_mp_t* g_mp;
 
 
+/** Reports X errors. Also called by the injector thread of async backends */
 static int err_handler(Display* dsp, XErrorEvent* evt) {
-  memset(g_err_buf, 0, G_ERR_BUF_LEN);
-  XGetErrorText(dsp, evt->error_code, g_err_buf, G_ERR_BUF_LEN);
+  char text[ERR_BUF_LEN] = {0};
+  XGetErrorText(dsp, evt->error_code, text, ERR_BUF_LEN);
   fprintf(stderr, "Failed X11 operation (code %u): %s. request=%u.%u,"
-          "serial=%lu, resource=%lu\n", evt->error_code, g_err_buf,
+          "serial=%lu, resource=%lu\n", evt->error_code, text,
           evt->request_code, evt->minor_code, evt->serial, evt->resourceid);
   return 0;
 }
 
+/**
+ * Makes Xlib thread-safe if the backend injects from a thread of its own
+ * (see kpm_be_async_new()). Must come before any other Xlib call.
+ */
+static void init_threads(void) {
+  const char* be_name = getenv("KPM_BACKEND");
+  if (!be_name)
+    be_name = KPM_DEFAULT_BACKEND;
+  if (!strncmp(be_name, KPM_BE_ASYNC_PREFIX, strlen(KPM_BE_ASYNC_PREFIX))
+      && !XInitThreads()) {
+    fprintf(stderr, "XInitThreads() failed, %s backend may crash\n",
+            be_name);
+  }
+}
+
+
+/** Handles signals delivered through the signalfd */
+static int on_signal(void* data) {
+  kpm_el_t* el = data;
+  struct signalfd_siginfo info;
+  if (read(g_signal_fd, &info, sizeof(info)) != sizeof(info))
+    return KPM_SUCCESS;
+  if (info.ssi_signo == SIGUSR1) {
+    kpm_lat_dump(&g_lat, stderr);
+  } else if (info.ssi_signo == SIGUSR2) {
+    if (!KPM_CHK(kpm_tr_dump))
+      fprintf(stderr, "Trace dumped to %s\n", kpm_tr_path());
+  } else if (info.ssi_signo == SIGHUP && g_dm) {
+    if (!KPM_CHK(kpm_dm_reload, g_dm))
+      fprintf(stderr, "Reloaded displays and key bindings\n");
+  } else if (info.ssi_signo == SIGHUP && g_mp) {
+    if (!KPM_CHK(kpm_mp_reload, g_mp))
+      fprintf(stderr, "Reloaded key bindings of all keypads\n");
+  } else if (info.ssi_signo == SIGHUP) {
+    if (!KPM_CHK(kpm_el_reload, el))
+      fprintf(stderr, "Reloaded key bindings\n");
+  }
+  return KPM_SUCCESS;
+}
+
+/** Routes SIGUSR1, SIGUSR2 and SIGHUP into the loop, through a signalfd */
+static int setup_signals(kpm_lp_t* lp, kpm_el_t* el) {
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  sigaddset(&set, SIGUSR2);
+  sigaddset(&set, SIGHUP);
+  KPM_RET2(KPM_ERR_SIGNALFD, sigprocmask, SIG_BLOCK, &set, NULL);
+  if ((g_signal_fd = signalfd(-1, &set, SFD_NONBLOCK|SFD_CLOEXEC)) < 0) {
+    perror("signalfd()");
+    return KPM_ERR_SIGNALFD;
+  }
+  return kpm_lp_add(lp, g_signal_fd, &on_signal, NULL, el);
+}
+
+/**
+ * Opens the evdev keypad named by KPM_EVDEV and the uinput device (KPM_UINPUT,
+ * /dev/uinput by default) and creates an uinput backend over them.
+ */
+static kpm_be_t* open_evdev(const char* evdev_path, int* evdev_fd,
+                            int* uinput_fd) {
+  const char* uinput_path = getenv("KPM_UINPUT");
+  if (!uinput_path)
+    uinput_path = "/dev/uinput";
+  if ((*evdev_fd = open(evdev_path, O_RDONLY|O_NONBLOCK|O_CLOEXEC)) < 0) {
+    perror(evdev_path);
+    return NULL;
+  }
+  if ((*uinput_fd = open(uinput_path, O_WRONLY|O_CLOEXEC)) < 0) {
+    perror(uinput_path);
+    return NULL;
+  }
+  return kpm_be_uinput_new(*uinput_fd, KPM_UINPUT_WIDTH, KPM_UINPUT_HEIGHT,
+                           KPM_UINPUT_ABSOLUTE);
+}
+
+/**
+ * Serves all displays listed in the file at path from this process (see
+ * displays.h). SIGHUP re-reads the file.
+ */
+static int run_displays(const char* path, const struct timespec* start_ts) {
+  static kpm_dm_t dm;
+  kpm_lp_t lp;
+  const char* be_name = getenv("KPM_BACKEND");
+  int err;
+
+  kpm_lat_init(&g_lat);
+  KPM_RET(kpm_lp_init, &lp);
+  KPM_RET(setup_signals, &lp, NULL);
+  g_dm = &dm;
+  if (!(err = KPM_CHK(kpm_dm_init, &dm, &lp, &g_lat,
+                      be_name ? be_name : KPM_DEFAULT_BACKEND, path))) {
+    fprintf(stderr, "kpmouse ready after %ld us (%d displays)\n",
+            kpm__us_elapsed(start_ts), dm.n);
+    err = KPM_CHK(kpm_dm_run, &dm);
+  }
+  kpm_dm_destroy(&dm);
+  g_dm = NULL;
+  kpm_lp_destroy(&lp);
+  close(g_signal_fd);
+  return err;
+}
+
+/**
+ * Drives a master pointer per keypad listed in the file at path, all from
+ * this process (see mpx.h). SIGHUP reloads the key bindings.
+ */
+static int run_mpx(const char* path, const struct timespec* start_ts) {
+  static kpm_mp_t mp;
+  kpm_lp_t lp;
+  int err;
+
+  Display* dpy = XOpenDisplay(NULL);
+  if (!dpy) {
+    fprintf(stderr, "Could not open display %s\n", XDisplayName(NULL));
+    return KPM_ERR_OPEN_DISPLAY;
+  }
+  kpm_lat_init(&g_lat);
+  KPM_RET(kpm_lp_init, &lp);
+  KPM_RET(setup_signals, &lp, NULL);
+  g_mp = &mp;
+  if (!(err = KPM_CHK(kpm_mp_init, &mp, dpy, &lp, &g_lat, path))) {
+    fprintf(stderr, "kpmouse ready after %ld us (%d keypads)\n",
+            kpm__us_elapsed(start_ts), mp.n);
+    err = KPM_CHK(kpm_lp_run, &lp);
+  }
+  kpm_mp_destroy(&mp);
+  g_mp = NULL;
+  kpm_lp_destroy(&lp);
+  close(g_signal_fd);
+  XCloseDisplay(dpy);
+  return err;
+}
 
 int main(int argc, char** argv) {
   kpm_st_t st;
   kpm_el_t el;
-  int err;
+  kpm_lp_t lp;
+  kpm_ev_t ev;
+  kpm_hs_t hs = {NULL};
+  kpm_ct_t ct;
+  kpm_sp_t sp;
+  struct timespec start_ts;
+  Display* dpy = NULL;
+  kpm_be_t* be;
+  int evdev_fd = -1, uinput_fd = -1;
+  int control = 0, status = 0, err;
 
+  clock_gettime(CLOCK_MONOTONIC, &start_ts);
+  kpm_tr_init();
+  init_threads();
   XSetErrorHandler(&err_handler);
+  memset(&ev, 0, sizeof(kpm_ev_t));
+
+  const char* displays_path = getenv("KPM_DISPLAYS");
+  if (displays_path)
+    return run_displays(displays_path, &start_ts);
+  const char* mpx_path = getenv("KPM_MPX");
+  if (mpx_path)
+    return run_mpx(mpx_path, &start_ts);
+
+  const char* evdev_path = getenv("KPM_EVDEV");
+  if (evdev_path) {
+    if (!(be = open_evdev(evdev_path, &evdev_fd, &uinput_fd)))
+      return KPM_ERR_BACKEND_NEW;
+  } else {
+    if (!(dpy = XOpenDisplay(NULL))) {
+      fprintf(stderr, "Could not open display %s\n", XDisplayName(NULL));
+      return KPM_ERR_OPEN_DISPLAY;
+    }
+    const char* be_name = getenv("KPM_BACKEND");
+    be = kpm_be_new(be_name ? be_name : KPM_DEFAULT_BACKEND, dpy);
+    if (!be)
+      return KPM_ERR_BACKEND_NEW;
+  }
 
-  KPM_RET(kpm_st_init, &st);
-  if (!(err = KPM_CHK(kpm_el_init, &el, &st)))
+  FILE* record = NULL;
+  const char* record_path = getenv("KPM_RECORD");
+  if (record_path && !(record = fopen(record_path, "w"))) {
+    perror(record_path);
+    return 1;
+  }
+  if (record)
+    setvbuf(record, NULL, _IOLBF, 0); // survive being killed
+
+  kpm_lat_init(&g_lat);
+  KPM_RET(kpm_lp_init, &lp);
+  KPM_RET(setup_signals, &lp, &el);
+  KPM_RET(kpm_st_init, &st, be);
+  char history_buf[1024];
+  const char* history_path = kpm_hs_path(history_buf, sizeof(history_buf));
+  if (KPM_HISTORY && history_path && !KPM_CHK(kpm_hs_init, &hs, history_path))
+    st.hs = &hs;
+  if (!(err = KPM_CHK(kpm_el_init, &el, &st, &lp, &g_lat))
+      && !(evdev_path && (err = KPM_CHK(kpm_ev_init, &ev, &el, evdev_fd)))) {
+    el.record = record;
+    char control_buf[108];
+    const char* control_path = kpm_ct_path(control_buf, sizeof(control_buf));
+    if (KPM_CONTROL && control_path
+        && !KPM_CHK(kpm_ct_init, &ct, &el, control_path)) {
+      control = 1;
+    }
+    char status_buf[1024];
+    const char* status_path = kpm_sp_path(status_buf, sizeof(status_buf));
+    if (KPM_STATUS && status_path && !KPM_CHK(kpm_sp_init, &sp, status_path)) {
+      el.status = &sp;
+      status = 1;
+      KPM_CHK(kpm_el_flush, &el); // publishes the initial status
+    }
+    fprintf(stderr, "kpmouse ready after %ld us (%s backend)\n",
+            kpm__us_elapsed(&start_ts), be->ops->name);
     err = KPM_CHK(kpm_el_run, &el);
+  }
+  if (control)
+    kpm_ct_destroy(&ct);
+  if (status) {
+    el.status = NULL;
+    kpm_sp_destroy(&sp);
+  }
+  if (evdev_path)
+    kpm_ev_destroy(&ev);
   kpm_el_destroy(&el);
   kpm_st_destroy(&st);
+  kpm_hs_destroy(&hs);
+  kpm_lp_destroy(&lp);
+  close(g_signal_fd);
+  kpm_be_destroy(be);
+  if (dpy)
+    XCloseDisplay(dpy);
+  if (evdev_fd >= 0)
+    close(evdev_fd);
+  if (uinput_fd >= 0)
+    close(uinput_fd);
+  if (record)
+    fclose(record);
 
   return err;
 }
-
-
@@ -0,0 +1,203 @@
+#include "monitors.h"
+#include "errors.h"
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static kpm_mon_t* add_mon(kpm_mn_t* mn, int screen) {
+  if (mn->n == KPM_MAX_MONITORS) {
+    fprintf(stderr, "Too many monitors, ignoring monitor %d of screen %d\n",
+            mn->n, screen);
+    return NULL;
+  }
+  kpm_mon_t* mon = &mn->mon[mn->n++];
+  memset(mon, 0, sizeof(kpm_mon_t));
+  mon->screen = screen;
+  return mon;
+}
+
+/** Adds the RandR monitors of screen and returns how many */
+static int add_rr_monitors(kpm_mn_t* mn, int screen) {
+  int n_infos = 0, n = 0;
+  XRRMonitorInfo* infos = XRRGetMonitors(mn->dpy, RootWindow(mn->dpy, screen),
+                                         True, &n_infos);
+  for (int i = 0; i < n_infos; ++i) {
+    kpm_mon_t* mon;
+    if (infos[i].width <= 0 || infos[i].height <= 0)
+      continue;
+    if (!(mon = add_mon(mn, screen)))
+      break;
+    mon->x = infos[i].x;
+    mon->y = infos[i].y;
+    mon->w = infos[i].width;
+    mon->h = infos[i].height;
+    ++n;
+  }
+  if (infos)
+    XRRFreeMonitors(infos);
+  return n;
+}
+
+/** Highest refresh rate (Hz) of the active CRTCs of screen, or 0 */
+static unsigned int refresh_rate(kpm_mn_t* mn, int screen) {
+  unsigned int best = 0;
+  XRRScreenResources* res =
+    XRRGetScreenResourcesCurrent(mn->dpy, RootWindow(mn->dpy, screen));
+  for (int i = 0; res && i < res->ncrtc; ++i) {
+    XRRCrtcInfo* crtc = XRRGetCrtcInfo(mn->dpy, res, res->crtcs[i]);
+    for (int j = 0; crtc && crtc->mode != None && j < res->nmode; ++j) {
+      const XRRModeInfo* mode = &res->modes[j];
+      double lines = mode->vTotal;
+      if (mode->id != crtc->mode)
+        continue;
+      if (mode->modeFlags & RR_DoubleScan)
+        lines *= 2;
+      if (mode->modeFlags & RR_Interlace)
+        lines /= 2;
+      if (!mode->hTotal || !mode->vTotal)
+        break;
+      unsigned int hz = mode->dotClock / (mode->hTotal * lines) + 0.5;
+      best = hz > best ? hz : best;
+      break;
+    }
+    if (crtc)
+      XRRFreeCrtcInfo(crtc);
+  }
+  if (res)
+    XRRFreeScreenResources(res);
+  return best;
+}
+
+/** Distance from v to the interval [lo, lo+len) */
+static long long dist1(int v, int lo, unsigned int len) {
+  long long hi = (long long)lo + len - 1;
+  return v < lo ? lo - v : (v > hi ? v - hi : 0);
+}
+
+/** Squared distance from (x, y) to the rectangle of mon */
+static long long dist2(const kpm_mon_t* mon, int x, int y) {
+  long long dx = dist1(x, mon->x, mon->w), dy = dist1(y, mon->y, mon->h);
+  return dx*dx + dy*dy;
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+int kpm_mn_init(kpm_mn_t* mn, kpm_be_t* be) {
+  int err_base, major = 1, minor = 5;
+  memset(mn, 0, sizeof(kpm_mn_t));
+  mn->be = be;
+  mn->dpy = be->dpy;
+  mn->rr_event_base = -1;
+  if (mn->dpy && XRRQueryExtension(mn->dpy, &mn->rr_event_base, &err_base)
+      && XRRQueryVersion(mn->dpy, &major, &minor)
+      && (major > 1 || minor >= 5)) {
+    for (int screen = 0; screen < ScreenCount(mn->dpy); ++screen) {
+      XRRSelectInput(mn->dpy, RootWindow(mn->dpy, screen),
+                     RRScreenChangeNotifyMask);
+    }
+  } else {
+    if (mn->dpy) {
+      fprintf(stderr, "RandR 1.5 not available, each X screen will be "
+              "a single monitor.\n");
+    }
+    mn->rr_event_base = -1;
+  }
+  return kpm_mn_refresh(mn);
+}
+
+int kpm_mn_refresh(kpm_mn_t* mn) {
+  int n_screens = mn->dpy ? ScreenCount(mn->dpy) : 1;
+  // built aside, so that a failure leaves the previous cache in place
+  kpm_mn_t next = *mn;
+  next.n = 0;
+  next.n_screens = 0;
+  next.refresh_hz = 0;
+  for (int screen = 0; screen < n_screens; ++screen) {
+    unsigned int w, h;
+    KPM_RET2(KPM_ERR_VIEWPORT, kpm_be_viewport, next.be, screen, &w, &h);
+    if (screen < KPM_MN_MAX_SCREENS) {
+      next.screen_w[screen] = w;
+      next.screen_h[screen] = h;
+      next.n_screens = screen + 1;
+    }
+    if (next.rr_event_base >= 0) {
+      unsigned int hz = refresh_rate(&next, screen);
+      next.refresh_hz = hz > next.refresh_hz ? hz : next.refresh_hz;
+      if (add_rr_monitors(&next, screen))
+        continue;
+    }
+    kpm_mon_t* mon = add_mon(&next, screen);
+    if (mon) {
+      mon->w = w;
+      mon->h = h;
+    }
+  }
+  *mn = next;
+  return KPM_SUCCESS;
+}
+
+int kpm_mn_handle_event(kpm_mn_t* mn, XEvent* ev) {
+  if (mn->rr_event_base < 0
+      || ev->type != mn->rr_event_base + RRScreenChangeNotify)
+    return 0;
+  XRRUpdateConfiguration(ev);
+  KPM_CHK(kpm_mn_refresh, mn);
+  return 1;
+}
+
+int kpm_mn_screen_size(const kpm_mn_t* mn, int screen,
+                       unsigned int* w, unsigned int* h) {
+  if (screen < 0 || screen >= mn->n_screens)
+    return KPM_ERR_VIEWPORT;
+  *w = mn->screen_w[screen];
+  *h = mn->screen_h[screen];
+  return KPM_SUCCESS;
+}
+
+const kpm_mon_t* kpm_mn_at(const kpm_mn_t* mn, int screen, int x, int y) {
+  const kpm_mon_t* best = &mn->mon[0];
+  long long best_d = LLONG_MAX;
+  for (int i = 0; i < mn->n; ++i) {
+    const kpm_mon_t* mon = &mn->mon[i];
+    if (mon->screen != screen)
+      continue;
+    long long d = dist2(mon, x, y);
+    if (d < best_d) {
+      best = mon;
+      best_d = d;
+      if (!d)
+        break;
+    }
+  }
+  return best;
+}
+
+const kpm_mon_t* kpm_mn_next(const kpm_mn_t* mn, const kpm_mon_t* from,
+                             int dir_x, int dir_y) {
+  const kpm_mon_t* best = NULL;
+  long long best_d = LLONG_MAX;
+  long long cx = from->x + from->w/2, cy = from->y + from->h/2;
+  for (int i = 0; i < mn->n; ++i) {
+    const kpm_mon_t* mon = &mn->mon[i];
+    if (mon == from || mon->screen != from->screen)
+      continue;
+    long long dx = mon->x + mon->w/2 - cx, dy = mon->y + mon->h/2 - cy;
+    // must be ahead on every axis of the direction
+    if ((dir_x && dx*dir_x <= 0) || (dir_y && dy*dir_y <= 0))
+      continue;
+    long long d = dx*dx + dy*dy;
+    if (d < best_d) {
+      best = mon;
+      best_d = d;
+    }
+  }
+  return best;
+}
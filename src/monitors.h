@@ -0,0 +1,102 @@
+#ifndef _KPMOUSE_MONITORS_H_
+#define _KPMOUSE_MONITORS_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include "backend.h"
+
+////////////////////////////////////////////
+// Third paty forward declarations
+////////////////////////////////////////////
+
+typedef union _XEvent XEvent; //X11/Xlib.h
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/** Maximum number of monitors (over all X screens) kept by kpm_mn_t */
+#define KPM_MAX_MONITORS 16
+
+/** Maximum number of X screens whose size is kept by kpm_mn_t */
+#define KPM_MN_MAX_SCREENS 8
+
+/** A monitor: a rectangle on the root window of an X screen */
+typedef struct kpm_mon_s {
+  int x, y;
+  unsigned int w, h;
+  int screen;
+} kpm_mon_t;
+
+/**
+ * Cache of the monitor and screen geometry, taken from RandR 1.5 monitors
+ * (and the backend viewport) and refreshed only when a RRScreenChangeNotify
+ * arrives. Without RandR (or without X), each screen is a single monitor
+ * with the size reported by the backend.
+ */
+typedef struct kpm_mn_s {
+  kpm_be_t* be;
+  /** X display of be, or NULL */
+  Display* dpy;
+  /** First RandR event code, or -1 if RandR 1.5 is not available */
+  int rr_event_base;
+  int n;
+  kpm_mon_t mon[KPM_MAX_MONITORS];
+  /** Number of X screens whose size is in screen_w and screen_h */
+  int n_screens;
+  /** Size of each X screen, as reported by the backend */
+  unsigned int screen_w[KPM_MN_MAX_SCREENS], screen_h[KPM_MN_MAX_SCREENS];
+  /** Highest refresh rate (Hz) of the active CRTCs, or 0 if unknown */
+  unsigned int refresh_hz;
+} kpm_mn_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Fills the cache and, if RandR is available, asks for RRScreenChangeNotify
+ * events on all root windows. The ownership of be is not transfered.
+ *
+ * @return 0 if successful, or an error code
+ */
+int kpm_mn_init(kpm_mn_t* mn, kpm_be_t* be);
+
+/**
+ * Reloads the geometry and refresh rate of all monitors (a few round trips
+ * per X screen). On failure, the cache is left as it was.
+ * @return 0 if successful, or an error code
+ */
+int kpm_mn_refresh(kpm_mn_t* mn);
+
+/**
+ * Feed an X event to the cache, which is refreshed on RRScreenChangeNotify.
+ * @return non-zero if the event was consumed, 0 otherwise.
+ */
+int kpm_mn_handle_event(kpm_mn_t* mn, XEvent* ev);
+
+/**
+ * Size of screen, from the cache (no requests).
+ * @return 0 if successful, or KPM_ERR_VIEWPORT if screen is unknown
+ */
+int kpm_mn_screen_size(const kpm_mn_t* mn, int screen,
+                       unsigned int* w, unsigned int* h);
+
+/**
+ * The monitor of screen that contains (x, y) or, if (x, y) falls between
+ * monitors, the nearest one.
+ */
+const kpm_mon_t* kpm_mn_at(const kpm_mn_t* mn, int screen, int x, int y);
+
+/**
+ * The nearest monitor whose center is in the direction (dir_x, dir_y) (each
+ * -1, 0 or 1) from the center of from, on the same screen. Returns NULL if
+ * there is no monitor in that direction.
+ */
+const kpm_mon_t* kpm_mn_next(const kpm_mn_t* mn, const kpm_mon_t* from,
+                             int dir_x, int dir_y);
+
+#endif /*_KPMOUSE_MONITORS_H_*/
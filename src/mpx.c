@@ -0,0 +1,253 @@
+#include "mpx.h"
+#include "errors.h"
+#include "grab.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+/** Device id of the device called name with the given use, or -1 */
+static int find_device(Display* dpy, const char* name, int use) {
+  int n_devs = 0, device = -1;
+  XIDeviceInfo* devs = XIQueryDevice(dpy, XIAllDevices, &n_devs);
+  for (int i = 0; device < 0 && i < n_devs; ++i) {
+    if (devs[i].use == use && !strcmp(devs[i].name, name))
+      device = devs[i].deviceid;
+  }
+  if (devs)
+    XIFreeDeviceInfo(devs);
+  return device;
+}
+
+/**
+ * Creates the master pointer "kpmouse-<index>" for pad, or takes it over if
+ * a previous kpmouse left it behind.
+ */
+static int add_master(kpm_mp_t* mp, kpm_pad_t* pad, int index) {
+  char name[32], pointer[48];
+  snprintf(name, sizeof(name), "kpmouse-%d", index);
+  snprintf(pointer, sizeof(pointer), "%s pointer", name); // as the server
+  if ((pad->master = find_device(mp->dpy, pointer, XIMasterPointer)) < 0) {
+    XIAddMasterInfo add = {XIAddMaster, name, True, True};
+    XIChangeHierarchy(mp->dpy, (XIAnyHierarchyChangeInfo*)&add, 1);
+    XSync(mp->dpy, False);
+    pad->master = find_device(mp->dpy, pointer, XIMasterPointer);
+  }
+  if (pad->master < 0) {
+    fprintf(stderr, "Could not create the master pointer %s\n", name);
+    return KPM_ERR_MPX;
+  }
+  pad->created = 1;
+  return KPM_SUCCESS;
+}
+
+/** Removes the master pointer of pad, if kpmouse created it */
+static void remove_master(kpm_mp_t* mp, kpm_pad_t* pad) {
+  if (!pad->created)
+    return;
+  // only the XTest slaves are attached to it, which go away with it
+  XIRemoveMasterInfo remove = {XIRemoveMaster, pad->master, XIFloating, 0, 0};
+  XIChangeHierarchy(mp->dpy, (XIAnyHierarchyChangeInfo*)&remove, 1);
+  pad->created = 0;
+}
+
+static void free_pad(kpm_mp_t* mp, kpm_pad_t* pad) {
+  kpm_el_destroy(&pad->el);
+  kpm_st_destroy(&pad->st);
+  kpm_be_destroy(pad->be);
+  remove_master(mp, pad);
+  free(pad);
+}
+
+/** Sets up a keypad for the slave keyboard name */
+static int attach(kpm_mp_t* mp, const char* name) {
+  int device = find_device(mp->dpy, name, XISlaveKeyboard), err;
+  if (device < 0) {
+    fprintf(stderr, "Keypad %s not found, see xinput list\n", name);
+    return KPM_ERR_MPX;
+  }
+  kpm_pad_t* pad = calloc(1, sizeof(kpm_pad_t));
+  if (!pad)
+    return KPM_ERR_MPX;
+  snprintf(pad->name, sizeof(pad->name), "%s", name);
+  pad->device = device;
+  if (!mp->n && !XIGetClientPointer(mp->dpy, None, &pad->master)) {
+    free(pad);
+    return KPM_ERR_MPX;
+  }
+  if (mp->n && (err = KPM_CHK(add_master, mp, pad, mp->n))) {
+    free(pad);
+    return err;
+  }
+  if (!(pad->be = kpm_be_xi2_new(mp->dpy, pad->master))) {
+    remove_master(mp, pad);
+    free(pad);
+    return KPM_ERR_BACKEND_NEW;
+  }
+  if ((err = KPM_CHK(kpm_st_init, &pad->st, pad->be))) {
+    kpm_be_destroy(pad->be);
+    remove_master(mp, pad);
+    free(pad);
+    return err;
+  }
+  pad->st.master = pad->master;
+  if ((err = KPM_CHK(kpm_el_init_device, &pad->el, &pad->st, mp->lp,
+                     mp->lat, device))) {
+    free_pad(mp, pad);
+    return err;
+  }
+  mp->pad[mp->n++] = pad;
+  fprintf(stderr, "Keypad %s (device %d) drives master pointer %d\n", name,
+          device, pad->master);
+  return KPM_SUCCESS;
+}
+
+/**
+ * Sets up a keypad for each slave keyboard listed in the file at path.
+ * @return the number of keypads, or -1 if the file cannot be read
+ */
+static int read_pads(kpm_mp_t* mp, const char* path) {
+  FILE* in = fopen(path, "r");
+  char line[128]; // as kpm_pad_t.name
+  if (!in) {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), in)) {
+    line[strcspn(line, "\r\n")] = 0; // device names have spaces
+    if (!*line || *line == '#')
+      continue;
+    if (mp->n == KPM_MP_MAX_PADS) {
+      fprintf(stderr, "%s: more than %d keypads, ignoring %s\n", path,
+              KPM_MP_MAX_PADS, line);
+      continue;
+    }
+    KPM_CHK(attach, mp, line);
+  }
+  fclose(in);
+  return mp->n;
+}
+
+/**
+ * Re-grabs the keys of keypads that were unplugged and plugged again, which
+ * gives them a new device id.
+ */
+static void follow_pads(kpm_mp_t* mp) {
+  for (int i = 0; i < mp->n; ++i) {
+    kpm_pad_t* pad = mp->pad[i];
+    int device = find_device(mp->dpy, pad->name, XISlaveKeyboard);
+    if (device == pad->device)
+      continue;
+    pad->device = device;
+    if (device < 0) { // its grabs are gone with it
+      fprintf(stderr, "Keypad %s unplugged\n", pad->name);
+      continue;
+    }
+    KeyCode codes[256];
+    int n = kpm_km_codes(&pad->el.km, codes);
+    pad->el.device = device;
+    if (n)
+      KPM_CHK(kpm_grab_device_keys, mp->dpy, device, codes, n, 1);
+    fprintf(stderr, "Keypad %s plugged in (device %d)\n", pad->name, device);
+  }
+}
+
+/** Passes ev to the keypad it comes from or, if it is not a key, to all */
+static int dispatch(kpm_mp_t* mp, XEvent* ev) {
+  XGenericEventCookie* cookie = &ev->xcookie;
+  if (ev->type != GenericEvent || cookie->extension != mp->xi_opcode
+      || !XGetEventData(mp->dpy, cookie)) {
+    for (int i = 0; i < mp->n; ++i)
+      KPM_RET(kpm_el_event, &mp->pad[i]->el, ev);
+    return KPM_SUCCESS;
+  }
+  int err = KPM_SUCCESS; // the data is shared, fetched only once
+  if (cookie->evtype == XI_KeyPress || cookie->evtype == XI_KeyRelease) {
+    XIDeviceEvent* key = cookie->data;
+    for (int i = 0; i < mp->n; ++i) {
+      if (mp->pad[i]->device != key->deviceid)
+        continue;
+      if (mp->lat)
+        kpm_lat_begin(mp->lat, kpm__x_time_ns(key->time));
+      err = kpm_el_key(&mp->pad[i]->el, key->detail,
+                       cookie->evtype == XI_KeyPress, key->mods.effective);
+    }
+  } else {
+    for (int i = 0; !err && i < mp->n; ++i)
+      err = kpm_el_event(&mp->pad[i]->el, ev);
+    if (cookie->evtype == XI_HierarchyChanged)
+      follow_pads(mp);
+  }
+  XFreeEventData(mp->dpy, cookie);
+  return err;
+}
+
+/** Processes all events that can be read without blocking */
+static int on_x_readable(void* data) {
+  kpm_mp_t* mp = data;
+  int err = KPM_SUCCESS;
+  while (XPending(mp->dpy)) {
+    XEvent ev = {0};
+    KPM_RET2(KPM_ERR_X_NEXT_EVT, XNextEvent, mp->dpy, &ev);
+    KPM_RET(dispatch, mp, &ev);
+  }
+  for (int i = 0; i < mp->n; ++i) { // a single flush per keypad
+    int pad_err = KPM_CHK(kpm_el_flush, &mp->pad[i]->el);
+    err = pad_err ? pad_err : err;
+  }
+  return err;
+}
+
+/** Xlib may have read events into its queue while waiting for a reply */
+static int x_pending(void* data) {
+  return XQLength(((kpm_mp_t*)data)->dpy) > 0;
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+int kpm_mp_init(kpm_mp_t* mp, Display* dpy, kpm_lp_t* lp, kpm_lat_t* lat,
+                const char* path) {
+  int ev_base, err_base, major = 2, minor = 0;
+  memset(mp, 0, sizeof(kpm_mp_t));
+  mp->dpy = dpy;
+  mp->lp = lp;
+  mp->lat = lat;
+  if (!XQueryExtension(dpy, "XInputExtension", &mp->xi_opcode, &ev_base,
+                       &err_base)
+      || XIQueryVersion(dpy, &major, &minor) != Success) {
+    fprintf(stderr, "XInput2 is required to drive several pointers\n");
+    return KPM_ERR_MPX;
+  }
+  int n = read_pads(mp, path);
+  if (n <= 0) {
+    fprintf(stderr, "%s: no keypad available\n", path);
+    return KPM_ERR_MPX;
+  }
+  return kpm_lp_add(lp, ConnectionNumber(dpy), &on_x_readable, &x_pending,
+                    mp);
+}
+
+void kpm_mp_destroy(kpm_mp_t* mp) {
+  if (mp->n)
+    kpm_lp_del(mp->lp, ConnectionNumber(mp->dpy));
+  while (mp->n)
+    free_pad(mp, mp->pad[--mp->n]);
+  XSync(mp->dpy, False); // the masters must be gone before the connection
+}
+
+int kpm_mp_reload(kpm_mp_t* mp) {
+  int err = KPM_SUCCESS;
+  for (int i = 0; i < mp->n; ++i) {
+    int pad_err = KPM_CHK(kpm_el_reload, &mp->pad[i]->el);
+    err = pad_err ? pad_err : err;
+  }
+  return err;
+}
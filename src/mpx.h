@@ -0,0 +1,81 @@
+#ifndef _KPMOUSE_MPX_H_
+#define _KPMOUSE_MPX_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include "state.h"
+#include "event_loop.h"
+#include "loop.h"
+#include "latency.h"
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/** Maximum number of keypads driven by a kpm_mp_t */
+#define KPM_MP_MAX_PADS 16
+
+/**
+ * A keypad driving its own master pointer: its XInput2 slave keyboard,
+ * backend and kpmouse state. Has a fixed size and is allocated once.
+ */
+typedef struct kpm_pad_s {
+  /** Name of the slave keyboard, as listed by xinput */
+  char name[128];
+  /** XInput2 device id of the slave keyboard */
+  int device;
+  /** XInput2 device id of the master pointer */
+  int master;
+  /** Non-zero if the master pointer was created by kpmouse */
+  char created;
+  kpm_be_t* be;
+  kpm_st_t st;
+  kpm_el_t el;
+} kpm_pad_t;
+
+/**
+ * Drives several master pointers (MPX) of a single X display, one per
+ * keypad, as when several people share a screen. The keys of each keypad
+ * are grabbed from that keyboard only (see kpm_grab_device_keys()), so each
+ * keypad has its own movement, TTL and pressed button.
+ *
+ * The first keypad drives the client pointer, the usual one. kpmouse creates
+ * a master pointer for each other keypad and removes it on exit. All keypads
+ * share one X connection, read once for all of them from the loop.
+ */
+typedef struct kpm_mp_s {
+  Display* dpy;
+  kpm_lp_t* lp;
+  kpm_lat_t* lat;
+  /** Major opcode of the XInputExtension */
+  int xi_opcode;
+  int n;
+  kpm_pad_t* pad[KPM_MP_MAX_PADS];
+} kpm_mp_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Sets up a keypad for each slave keyboard named in the file at path, one
+ * name per line, on the open dpy. Keypads that are not plugged in are
+ * skipped. The ownership of dpy is not transfered.
+ * @return 0 if successful, or an error code
+ */
+int kpm_mp_init(kpm_mp_t* mp, Display* dpy, kpm_lp_t* lp, kpm_lat_t* lat,
+                const char* path);
+
+/** Releases all keypads and removes the master pointers created for them */
+void kpm_mp_destroy(kpm_mp_t* mp);
+
+/**
+ * Reloads the key bindings of all keypads (see kpm_el_reload()).
+ * @return 0 if successful, or an error code
+ */
+int kpm_mp_reload(kpm_mp_t* mp);
+
+#endif /*_KPMOUSE_MPX_H_*/
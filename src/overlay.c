@@ -0,0 +1,195 @@
+#include "overlay.h"
+#include "user_config.h"
+#include "errors.h"
+#include <stdio.h>
+#include <string.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/shape.h>
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static void add_rect(XRectangle* r, int* n, int x, int y, int w, int h) {
+  XRectangle rect = {x, y, w > 0 ? w : 1, h > 0 ? h : 1};
+  r[(*n)++] = rect;
+}
+
+/** Computes the overlay rectangles for st and returns how many */
+static int make_rects(const kpm_st_t* st, XRectangle* r) {
+  int n = 0, t = KPM_OVERLAY_LINE, m = KPM_OVERLAY_MARK;
+  if (!st->log_steps)
+    return 0;
+  int w = st->w, h = st->h, x0 = st->log_x - w/2, y0 = st->log_y - h/2;
+  add_rect(r, &n, x0, y0, w, t);                      // top
+  add_rect(r, &n, x0, y0 + h - t, w, t);              // bottom
+  add_rect(r, &n, x0, y0, t, h);                      // left
+  add_rect(r, &n, x0 + w - t, y0, t, h);              // right
+  for (int i = 1; i < st->grid; ++i) {               // cross or grid lines
+    add_rect(r, &n, x0 + i*w/st->grid - t/2, y0, t, h);
+    add_rect(r, &n, x0, y0 + i*h/st->grid - t/2, w, t);
+  }
+
+  // targets: cell centers, or linear steps from the pointer
+  int cx = st->log_x, cy = st->log_y;
+  int dx = w*(st->grid-1)/(2*st->grid), dy = h*(st->grid-1)/(2*st->grid);
+  char center = st->grid == 3;
+  if (st->log_steps >= st->max_log_steps) {
+    cx = st->ptr_x;
+    cy = st->ptr_y;
+    dx = st->step_x;
+    dy = st->step_y;
+    center = 0;
+  }
+  for (int i = -1; i <= 1; ++i) {
+    for (int j = -1; j <= 1; ++j) {
+      if (i || j || center)
+        add_rect(r, &n, cx + i*dx - m/2, cy + j*dy - m/2, m, m);
+    }
+  }
+  return n;
+}
+
+/** Non-zero if a compositing manager runs on screen */
+static int is_composited(Display* dpy, int screen) {
+  char name[32];
+  snprintf(name, sizeof(name), "_NET_WM_CM_S%d", screen);
+  return XGetSelectionOwner(dpy, XInternAtom(dpy, name, False)) != None;
+}
+
+static Window create_window(kpm_ov_t* ov, int screen) {
+  Display* dpy = ov->dpy;
+  XSetWindowAttributes attrs;
+  unsigned long mask = CWOverrideRedirect|CWBackPixel|CWBorderPixel;
+  XVisualInfo vi;
+  int depth = DefaultDepth(dpy, screen);
+  Visual* visual = DefaultVisual(dpy, screen);
+  unsigned long argb = KPM_OVERLAY_COLOR;
+  unsigned int a = argb >> 24;
+
+  memset(&attrs, 0, sizeof(attrs));
+  attrs.override_redirect = True;
+  if (is_composited(dpy, screen)
+      && XMatchVisualInfo(dpy, screen, 32, TrueColor, &vi)) {
+    depth = 32;
+    visual = vi.visual;
+    ov->cmap[screen] = XCreateColormap(dpy, RootWindow(dpy, screen),
+                                       visual, AllocNone);
+    attrs.colormap = ov->cmap[screen];
+    mask |= CWColormap;
+    // premultiplied alpha
+    attrs.background_pixel = (a << 24)
+                           | (((argb >> 16 & 0xff)*a/255) << 16)
+                           | (((argb >> 8 & 0xff)*a/255) << 8)
+                           | ((argb & 0xff)*a/255);
+  } else {
+    XColor color = {0};
+    color.red   = (argb >> 16 & 0xff) * 0x101;
+    color.green = (argb >> 8 & 0xff) * 0x101;
+    color.blue  = (argb & 0xff) * 0x101;
+    if (XAllocColor(dpy, DefaultColormap(dpy, screen), &color))
+      attrs.background_pixel = color.pixel;
+    else
+      attrs.background_pixel = WhitePixel(dpy, screen);
+  }
+
+  ov->w[screen] = DisplayWidth(dpy, screen);
+  ov->h[screen] = DisplayHeight(dpy, screen);
+  Window win = XCreateWindow(dpy, RootWindow(dpy, screen), 0, 0,
+                             ov->w[screen], ov->h[screen], 0, depth,
+                             InputOutput, visual, mask, &attrs);
+  XClassHint hint = {"kpmouse-overlay", "kpmouse"};
+  XSetClassHint(dpy, win, &hint);
+  XStoreName(dpy, win, "kpmouse overlay");
+  // empty bounding shape until the first update; never takes input
+  XShapeCombineRectangles(dpy, win, ShapeBounding, 0, 0, NULL, 0,
+                          ShapeSet, Unsorted);
+  XShapeCombineRectangles(dpy, win, ShapeInput, 0, 0, NULL, 0,
+                          ShapeSet, Unsorted);
+  return win;
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+int kpm_ov_init(kpm_ov_t* ov, Display* dpy) {
+  int ev_base, err_base, major = 0, minor = 0;
+  memset(ov, 0, sizeof(kpm_ov_t));
+  ov->dpy = dpy;
+  ov->mapped = -1;
+  if (!XShapeQueryExtension(dpy, &ev_base, &err_base)
+      || !XShapeQueryVersion(dpy, &major, &minor)
+      || (major == 1 && minor < 1)) {
+    fprintf(stderr, "X Shape 1.1 not available, overlay disabled.\n");
+    return KPM_ERR_OVERLAY;
+  }
+  ov->n_screens = ScreenCount(dpy);
+  if (ov->n_screens > KPM_OV_MAX_SCREENS)
+    ov->n_screens = KPM_OV_MAX_SCREENS;
+  for (int screen = 0; screen < ov->n_screens; ++screen)
+    ov->win[screen] = create_window(ov, screen);
+  XFlush(dpy);
+  return KPM_SUCCESS;
+}
+
+void kpm_ov_update(kpm_ov_t* ov, const kpm_st_t* st) {
+  XRectangle rects[KPM_OV_MAX_RECTS];
+  int n = make_rects(st, rects), screen = st->ptr_screen;
+  if (screen < 0 || screen >= ov->n_screens)
+    n = 0;
+  if (!n && ov->mapped < 0)
+    return;
+  if (n && ov->mapped == screen && n == ov->n_rects
+      && !memcmp(rects, ov->rects, n*sizeof(XRectangle)))
+    return; // unchanged
+  if (ov->mapped >= 0 && (!n || ov->mapped != screen)) {
+    XUnmapWindow(ov->dpy, ov->win[ov->mapped]);
+    ov->mapped = -1;
+  }
+  if (n) {
+    XShapeCombineRectangles(ov->dpy, ov->win[screen], ShapeBounding, 0, 0,
+                            rects, n, ShapeSet, Unsorted);
+    if (ov->mapped < 0) {
+      XMapRaised(ov->dpy, ov->win[screen]);
+      ov->mapped = screen;
+    }
+  }
+  memcpy(ov->rects, rects, n*sizeof(XRectangle));
+  ov->n_rects = n;
+  XFlush(ov->dpy);
+}
+
+void kpm_ov_resize(kpm_ov_t* ov, const kpm_mn_t* mn) {
+  int resized = 0;
+  for (int screen = 0; screen < ov->n_screens; ++screen) {
+    unsigned int w, h;
+    if (kpm_mn_screen_size(mn, screen, &w, &h) || !w || !h
+        || (w == ov->w[screen] && h == ov->h[screen]))
+      continue;
+    XResizeWindow(ov->dpy, ov->win[screen], w, h);
+    ov->w[screen] = w;
+    ov->h[screen] = h;
+    resized = 1;
+  }
+  if (resized)
+    XFlush(ov->dpy);
+}
+
+void kpm_ov_hide(kpm_ov_t* ov) {
+  if (ov->mapped >= 0)
+    XUnmapWindow(ov->dpy, ov->win[ov->mapped]);
+  ov->mapped = -1;
+  ov->n_rects = 0;
+}
+
+void kpm_ov_destroy(kpm_ov_t* ov) {
+  for (int screen = 0; screen < ov->n_screens; ++screen) {
+    XDestroyWindow(ov->dpy, ov->win[screen]);
+    if (ov->cmap[screen] != None)
+      XFreeColormap(ov->dpy, ov->cmap[screen]);
+  }
+  ov->n_screens = 0;
+  ov->mapped = -1;
+}
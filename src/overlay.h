@@ -0,0 +1,81 @@
+#ifndef _KPMOUSE_OVERLAY_H_
+#define _KPMOUSE_OVERLAY_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include "state.h"
+#include <X11/Xlib.h>
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/** Maximum number of X screens with an overlay window */
+#define KPM_OV_MAX_SCREENS 8
+
+/** Window border (4), 3x3 grid lines (4) and 9 target markers */
+#define KPM_OV_MAX_RECTS 17
+
+/**
+ * Overlay that shows the current movement window, the cross that splits it
+ * and the 8 targets of the next move. Each X screen has an override-redirect
+ * window covering it, but shaped (X Shape extension) to only the line and
+ * marker rectangles and with an empty input shape, so it never takes clicks.
+ *
+ * Nothing is ever drawn by kpmouse: the server paints the window background
+ * (translucent, on an ARGB visual, if a compositing manager is running) on
+ * the exposed parts of the shape. Thus an update is a single request and
+ * only the rectangles that changed are damaged, regardless of screen size.
+ */
+typedef struct kpm_ov_s {
+  Display* dpy;
+  int n_screens;
+  Window win[KPM_OV_MAX_SCREENS];
+  /** Size of each window: the size of its screen when last checked */
+  unsigned int w[KPM_OV_MAX_SCREENS], h[KPM_OV_MAX_SCREENS];
+  /** Colormap created for an ARGB visual, or None */
+  Colormap cmap[KPM_OV_MAX_SCREENS];
+  /** Screen whose window is mapped, or -1 */
+  int mapped;
+  /** Shape currently set on the mapped window */
+  XRectangle rects[KPM_OV_MAX_RECTS];
+  int n_rects;
+} kpm_ov_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Creates the (unmapped) overlay windows.
+ * @return 0 if successful, or an error code
+ */
+int kpm_ov_init(kpm_ov_t* ov, Display* dpy);
+
+/**
+ * Reshapes the overlay to the current movement window of st. The overlay is
+ * hidden while no movement is active. Does nothing (no requests) if the
+ * shape did not change. Requests are flushed.
+ */
+void kpm_ov_update(kpm_ov_t* ov, const kpm_st_t* st);
+
+/**
+ * Resizes the overlay windows whose screen changed size in the monitor cache
+ * mn (after a RRScreenChangeNotify). Does nothing (no requests) if no screen
+ * changed. Requests are flushed.
+ */
+void kpm_ov_resize(kpm_ov_t* ov, const kpm_mn_t* mn);
+
+/**
+ * Unmaps the overlay, e.g. before reading screen pixels. The next
+ * kpm_ov_update() shows it again. Requests are not flushed.
+ */
+void kpm_ov_hide(kpm_ov_t* ov);
+
+/** Destroys the overlay windows */
+void kpm_ov_destroy(kpm_ov_t* ov);
+
+#endif /*_KPMOUSE_OVERLAY_H_*/
@@ -0,0 +1,397 @@
+#include "snap.h"
+#include "user_config.h"
+#include "errors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xutil.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KPM_SN_X86 1
+#include <immintrin.h>
+#endif
+
+////////////////////////////////////
+// kernels
+////////////////////////////////////
+
+typedef void (*kpm_sn_kernel_t)(const uint32_t*, int, int, int, uint32_t*);
+
+/** Contrast between two pixels: sum of the R, G and B absolute differences */
+static inline uint32_t contrast(uint32_t a, uint32_t b) {
+  int d0 = (int)(a & 0xff) - (int)(b & 0xff);
+  int d1 = (int)(a >> 8 & 0xff) - (int)(b >> 8 & 0xff);
+  int d2 = (int)(a >> 16 & 0xff) - (int)(b >> 16 & 0xff);
+  return (d0 < 0 ? -d0 : d0) + (d1 < 0 ? -d1 : d1) + (d2 < 0 ? -d2 : d2);
+}
+
+static void cols_scalar(const uint32_t* px, int stride, int w, int h,
+                        uint32_t* out) {
+  memset(out, 0, (w-1)*sizeof(uint32_t));
+  for (int y = 0; y < h; ++y, px += stride) {
+    for (int x = 0; x < w-1; ++x)
+      out[x] += contrast(px[x], px[x+1]);
+  }
+}
+
+static void rows_scalar(const uint32_t* px, int stride, int w, int h,
+                        uint32_t* out) {
+  for (int y = 0; y < h-1; ++y, px += stride) {
+    uint32_t sum = 0;
+    for (int x = 0; x < w; ++x)
+      sum += contrast(px[x], px[x+stride]);
+    out[y] = sum;
+  }
+}
+
+#ifdef KPM_SN_X86
+/*
+ * The vector kernels compute the contrast of 4 (SSE2) or 8 (AVX2) pixel
+ * pairs at once: saturated subtractions in both directions give the
+ * absolute byte differences, the (unused) top byte is masked off and the
+ * three bytes left of each pixel are added into 16-bit lanes and then into
+ * its 32-bit lane.
+ */
+
+__attribute__((target("sse2")))
+static inline __m128i contrast_sse2(__m128i a, __m128i b) {
+  const __m128i rgb = _mm_set1_epi32(0x00ffffff);
+  const __m128i even = _mm_set1_epi32(0x00ff00ff);
+  const __m128i ones = _mm_set1_epi16(1);
+  __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+  d = _mm_and_si128(d, rgb);
+  d = _mm_add_epi16(_mm_and_si128(d, even), _mm_srli_epi16(d, 8));
+  return _mm_madd_epi16(d, ones);
+}
+
+__attribute__((target("sse2")))
+static void cols_sse2(const uint32_t* px, int stride, int w, int h,
+                      uint32_t* out) {
+  int n = w-1, x;
+  memset(out, 0, n*sizeof(uint32_t));
+  for (int y = 0; y < h; ++y, px += stride) {
+    for (x = 0; x+4 <= n; x += 4) {
+      __m128i a = _mm_loadu_si128((const __m128i*)(px+x));
+      __m128i b = _mm_loadu_si128((const __m128i*)(px+x+1));
+      __m128i acc = _mm_loadu_si128((const __m128i*)(out+x));
+      acc = _mm_add_epi32(acc, contrast_sse2(a, b));
+      _mm_storeu_si128((__m128i*)(out+x), acc);
+    }
+    for (; x < n; ++x)
+      out[x] += contrast(px[x], px[x+1]);
+  }
+}
+
+__attribute__((target("sse2")))
+static void rows_sse2(const uint32_t* px, int stride, int w, int h,
+                      uint32_t* out) {
+  for (int y = 0; y < h-1; ++y, px += stride) {
+    __m128i acc = _mm_setzero_si128();
+    int x;
+    for (x = 0; x+4 <= w; x += 4) {
+      __m128i a = _mm_loadu_si128((const __m128i*)(px+x));
+      __m128i b = _mm_loadu_si128((const __m128i*)(px+x+stride));
+      acc = _mm_add_epi32(acc, contrast_sse2(a, b));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4e));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xb1));
+    uint32_t sum = _mm_cvtsi128_si32(acc);
+    for (; x < w; ++x)
+      sum += contrast(px[x], px[x+stride]);
+    out[y] = sum;
+  }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i contrast_avx2(__m256i a, __m256i b) {
+  const __m256i rgb = _mm256_set1_epi32(0x00ffffff);
+  const __m256i even = _mm256_set1_epi32(0x00ff00ff);
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i d = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+  d = _mm256_and_si256(d, rgb);
+  d = _mm256_add_epi16(_mm256_and_si256(d, even), _mm256_srli_epi16(d, 8));
+  return _mm256_madd_epi16(d, ones);
+}
+
+__attribute__((target("avx2")))
+static void cols_avx2(const uint32_t* px, int stride, int w, int h,
+                      uint32_t* out) {
+  int n = w-1, x;
+  memset(out, 0, n*sizeof(uint32_t));
+  for (int y = 0; y < h; ++y, px += stride) {
+    for (x = 0; x+8 <= n; x += 8) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)(px+x));
+      __m256i b = _mm256_loadu_si256((const __m256i*)(px+x+1));
+      __m256i acc = _mm256_loadu_si256((const __m256i*)(out+x));
+      acc = _mm256_add_epi32(acc, contrast_avx2(a, b));
+      _mm256_storeu_si256((__m256i*)(out+x), acc);
+    }
+    for (; x < n; ++x)
+      out[x] += contrast(px[x], px[x+1]);
+  }
+}
+
+__attribute__((target("avx2")))
+static void rows_avx2(const uint32_t* px, int stride, int w, int h,
+                      uint32_t* out) {
+  for (int y = 0; y < h-1; ++y, px += stride) {
+    __m256i acc = _mm256_setzero_si256();
+    int x;
+    for (x = 0; x+8 <= w; x += 8) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)(px+x));
+      __m256i b = _mm256_loadu_si256((const __m256i*)(px+x+stride));
+      acc = _mm256_add_epi32(acc, contrast_avx2(a, b));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                              _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    uint32_t sum = _mm_cvtsi128_si32(s);
+    for (; x < w; ++x)
+      sum += contrast(px[x], px[x+stride]);
+    out[y] = sum;
+  }
+}
+#endif /*KPM_SN_X86*/
+
+static kpm_sn_kernel_t cols_impl = NULL, rows_impl = NULL;
+
+/** Picks the fastest kernels supported by the CPU */
+static void select_impl(void) {
+#ifdef KPM_SN_X86
+  __builtin_cpu_init();
+  if (!kpm_sn_set_impl(KPM_SN_AVX2) || !kpm_sn_set_impl(KPM_SN_SSE2))
+    return;
+#endif
+  kpm_sn_set_impl(KPM_SN_SCALAR);
+}
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+static int shm_failed;
+
+static int on_shm_error(Display* dpy, XErrorEvent* ev) {
+  shm_failed = 1;
+  return 0;
+}
+
+/** Attaches a shm segment of sn->cap pixels, or leaves sn->use_shm at 0 */
+static void attach_shm(kpm_sn_t* sn) {
+  if (!XShmQueryExtension(sn->dpy))
+    return;
+  sn->shm.shmid = shmget(IPC_PRIVATE, sn->cap*sizeof(uint32_t),
+                         IPC_CREAT|0600);
+  if (sn->shm.shmid < 0)
+    return;
+  sn->shm.shmaddr = shmat(sn->shm.shmid, NULL, 0);
+  sn->shm.readOnly = False;
+  if (sn->shm.shmaddr != (char*)-1) {
+    // attaching fails on remote displays, which only shows as an X error
+    XSync(sn->dpy, False);
+    int (*old)(Display*, XErrorEvent*) = XSetErrorHandler(&on_shm_error);
+    shm_failed = 0;
+    XShmAttach(sn->dpy, &sn->shm);
+    XSync(sn->dpy, False);
+    XSetErrorHandler(old);
+    if (!shm_failed)
+      sn->use_shm = 1;
+    else
+      shmdt(sn->shm.shmaddr);
+  }
+  shmctl(sn->shm.shmid, IPC_RMID, NULL); // freed once everyone detaches
+}
+
+/**
+ * Reads the w x h pixels at (x, y) of screen and computes their horizontal
+ * (vertical_edges) or vertical edge profile into sn->prof.
+ *
+ * @return 0 if successful, non-zero if the pixels could not be read
+ */
+static int profile(kpm_sn_t* sn, int screen, int x, int y, int w, int h,
+                   int vertical_edges) {
+  Display* dpy = sn->dpy;
+  Visual* visual = DefaultVisual(dpy, screen);
+  XImage* img;
+  if ((visual->red_mask|visual->green_mask|visual->blue_mask) != 0xffffff)
+    return 1; // not 8-bit R, G and B on the low bytes of 32-bit pixels
+  if (sn->use_shm && (size_t)w*h <= sn->cap) {
+    img = XShmCreateImage(dpy, visual, DefaultDepth(dpy, screen), ZPixmap,
+                          sn->shm.shmaddr, &sn->shm, w, h);
+    if (img && !XShmGetImage(dpy, RootWindow(dpy, screen), img, x, y,
+                             AllPlanes)) {
+      img->data = NULL;
+      XDestroyImage(img);
+      img = NULL;
+    }
+  } else {
+    img = XGetImage(dpy, RootWindow(dpy, screen), x, y, w, h, AllPlanes,
+                    ZPixmap);
+  }
+  if (!img)
+    return 1;
+  int err = img->bits_per_pixel != 32;
+  if (!err) {
+    const uint32_t* px = (const uint32_t*)img->data;
+    int stride = img->bytes_per_line/4;
+    if (vertical_edges)
+      kpm_sn_cols(px, stride, w, h, sn->prof);
+    else
+      kpm_sn_rows(px, stride, w, h, sn->prof);
+  }
+  if (sn->use_shm && img->data == sn->shm.shmaddr)
+    img->data = NULL; // not owned by img
+  XDestroyImage(img);
+  return err;
+}
+
+/**
+ * Snaps *pos, on an axis going from begin to end (exclusive), to the nearest
+ * edge towards dir of the strip whose profile was computed into sn->prof.
+ * thickness is how many pixels were summed into each profile entry.
+ */
+static int snap_axis(kpm_sn_t* sn, int begin, int end, int thickness,
+                     int dir, int* pos) {
+  uint32_t min = KPM_SNAP_CONTRAST * (uint32_t)thickness;
+  int i = kpm_sn_find(sn->prof, end-begin-1, *pos-begin, dir, min);
+  if (i < 0)
+    return 0;
+  *pos = begin + i + (dir > 0);
+  return 1;
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+int kpm_sn_init(kpm_sn_t* sn, Display* dpy) {
+  size_t max = 0;
+  memset(sn, 0, sizeof(kpm_sn_t));
+  sn->dpy = dpy;
+  for (int screen = 0; screen < ScreenCount(dpy); ++screen) {
+    if ((size_t)DisplayWidth(dpy, screen) > max)
+      max = DisplayWidth(dpy, screen);
+    if ((size_t)DisplayHeight(dpy, screen) > max)
+      max = DisplayHeight(dpy, screen);
+  }
+  sn->prof_cap = max;
+  if (!(sn->prof = malloc(sn->prof_cap*sizeof(uint32_t))))
+    return KPM_ERR_SNAP;
+  sn->cap = max*(2*KPM_SNAP_BAND + 1);
+  attach_shm(sn);
+  if (!sn->use_shm)
+    fprintf(stderr, "MIT-SHM not available, snapping will use XGetImage.\n");
+  if (!cols_impl)
+    select_impl();
+  return KPM_SUCCESS;
+}
+
+void kpm_sn_destroy(kpm_sn_t* sn) {
+  if (sn->use_shm) {
+    XShmDetach(sn->dpy, &sn->shm);
+    XSync(sn->dpy, False);
+    shmdt(sn->shm.shmaddr);
+    sn->use_shm = 0;
+  }
+  free(sn->prof);
+  sn->prof = NULL;
+}
+
+int kpm_sn_snap(kpm_sn_t* sn, int screen, int left, int top,
+                unsigned int w, unsigned int h, int dir_x, int dir_y,
+                int* x, int* y) {
+  int right = left + (int)w, bottom = top + (int)h, n = 0;
+  if (*x < left || *x >= right || *y < top || *y >= bottom)
+    return 0;
+  if (w > sn->prof_cap || h > sn->prof_cap)
+    return 0;
+  // only the half of the area ahead is read
+  int x0 = dir_x < 0 ? left : *x, x1 = dir_x > 0 ? right : *x + 1;
+  int y0 = dir_y < 0 ? top : *y, y1 = dir_y > 0 ? bottom : *y + 1;
+  int band_top = *y - KPM_SNAP_BAND < top ? top : *y - KPM_SNAP_BAND;
+  int band_bottom = *y + KPM_SNAP_BAND + 1 > bottom ? bottom
+                  : *y + KPM_SNAP_BAND + 1;
+  int band_left = *x - KPM_SNAP_BAND < left ? left : *x - KPM_SNAP_BAND;
+  int band_right = *x + KPM_SNAP_BAND + 1 > right ? right
+                 : *x + KPM_SNAP_BAND + 1;
+  int new_x = *x, new_y = *y;
+  if (dir_x && x1 - x0 > 1
+      && !profile(sn, screen, x0, band_top, x1 - x0, band_bottom - band_top,
+                  1)) {
+    n += snap_axis(sn, x0, x1, band_bottom - band_top, dir_x, &new_x);
+  }
+  if (dir_y && y1 - y0 > 1
+      && !profile(sn, screen, band_left, y0, band_right - band_left, y1 - y0,
+                  0)) {
+    n += snap_axis(sn, y0, y1, band_right - band_left, dir_y, &new_y);
+  }
+  *x = new_x;
+  *y = new_y;
+  return n;
+}
+
+void kpm_sn_cols(const uint32_t* px, int stride, int w, int h,
+                 uint32_t* out) {
+  if (!cols_impl)
+    select_impl();
+  if (w > 1)
+    cols_impl(px, stride, w, h, out);
+}
+
+void kpm_sn_rows(const uint32_t* px, int stride, int w, int h,
+                 uint32_t* out) {
+  if (!rows_impl)
+    select_impl();
+  if (h > 1)
+    rows_impl(px, stride, w, h, out);
+}
+
+int kpm_sn_find(const uint32_t* prof, int n, int from, int dir,
+                uint32_t min) {
+  if (!dir)
+    return -1;
+  for (int i = from + dir*KPM_SNAP_MIN_DIST; i >= 0 && i < n; i += dir) {
+    if (prof[i] >= min && (i == 0 || prof[i-1] <= prof[i])
+        && (i == n-1 || prof[i+1] <= prof[i])) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int kpm_sn_set_impl(int impl) {
+  switch (impl) {
+    case KPM_SN_SCALAR:
+      cols_impl = &cols_scalar;
+      rows_impl = &rows_scalar;
+      return KPM_SUCCESS;
+#ifdef KPM_SN_X86
+    case KPM_SN_SSE2:
+      if (!__builtin_cpu_supports("sse2"))
+        return KPM_ERR_SNAP;
+      cols_impl = &cols_sse2;
+      rows_impl = &rows_sse2;
+      return KPM_SUCCESS;
+    case KPM_SN_AVX2:
+      if (!__builtin_cpu_supports("avx2"))
+        return KPM_ERR_SNAP;
+      cols_impl = &cols_avx2;
+      rows_impl = &rows_avx2;
+      return KPM_SUCCESS;
+#endif
+    default:
+      return KPM_ERR_SNAP;
+  }
+}
+
+const char* kpm_sn_impl_name(int impl) {
+  switch (impl) {
+    case KPM_SN_SCALAR: return "scalar";
+    case KPM_SN_SSE2:   return "sse2";
+    case KPM_SN_AVX2:   return "avx2";
+    default:            return "unknown";
+  }
+}
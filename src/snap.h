@@ -0,0 +1,104 @@
+#ifndef _KPMOUSE_SNAP_H_
+#define _KPMOUSE_SNAP_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include <stdint.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/** Kernel implementations, see kpm_sn_set_impl() */
+#define KPM_SN_SCALAR 0
+#define KPM_SN_SSE2   1
+#define KPM_SN_AVX2   2
+
+/**
+ * Finds edges on the screen near the pointer, so that a move can land
+ * exactly on a button or text field border instead of taking several linear
+ * steps to get there.
+ *
+ * Only two thin strips are read from the X server: a horizontal one through
+ * the pointer (for vertical edges) and a vertical one (for horizontal
+ * edges), both limited to the search area and 2*KPM_SNAP_BAND+1 pixels
+ * thick. They are read into a MIT-SHM segment if the server supports it.
+ */
+typedef struct kpm_sn_s {
+  Display* dpy;
+  /** Non-zero if shm is attached to the X server */
+  char use_shm;
+  XShmSegmentInfo shm;
+  /** Capture buffer, used without MIT-SHM */
+  uint32_t* buf;
+  /** Capacity of the capture buffer (in pixels) */
+  size_t cap;
+  /** Edge profile of a strip, one entry per pixel of its length */
+  uint32_t* prof;
+  /** Capacity of prof */
+  size_t prof_cap;
+} kpm_sn_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Allocates the capture buffers for the largest screen of dpy.
+ * @return 0 if successful, or an error code
+ */
+int kpm_sn_init(kpm_sn_t* sn, Display* dpy);
+
+/** Releases the capture buffers */
+void kpm_sn_destroy(kpm_sn_t* sn);
+
+/**
+ * Searches for the nearest edge from (x, y) on screen, towards dir_x and
+ * dir_y (each -1, 0 or 1), within the rectangle at (left, top) of size w
+ * by h. On each axis where an edge is found, *x or *y is moved onto it.
+ *
+ * @return the number of axes (0, 1 or 2) that snapped to an edge
+ */
+int kpm_sn_snap(kpm_sn_t* sn, int screen, int left, int top,
+                unsigned int w, unsigned int h, int dir_x, int dir_y,
+                int* x, int* y);
+
+/**
+ * Horizontal edge profile: out[i], for i < w-1, is the sum over the h rows
+ * of the contrast between pixels i and i+1 (the sum of the absolute
+ * differences of the R, G and B bytes of 32-bit pixels). stride is in
+ * pixels.
+ */
+void kpm_sn_cols(const uint32_t* px, int stride, int w, int h, uint32_t* out);
+
+/**
+ * Vertical edge profile: out[i], for i < h-1, is the sum over the w columns
+ * of the contrast between rows i and i+1.
+ */
+void kpm_sn_rows(const uint32_t* px, int stride, int w, int h, uint32_t* out);
+
+/**
+ * Index of the nearest local maximum of prof[0..n-1] that is at least min,
+ * starting KPM_SNAP_MIN_DIST entries from `from` and going towards dir.
+ *
+ * @return the index found or -1
+ */
+int kpm_sn_find(const uint32_t* prof, int n, int from, int dir, uint32_t min);
+
+/**
+ * Selects the kernel implementation used by kpm_sn_cols() and
+ * kpm_sn_rows(). By default, the fastest one supported by the CPU is used.
+ *
+ * @return 0 if impl is supported by this build and CPU, or an error code
+ */
+int kpm_sn_set_impl(int impl);
+
+/** Name of a KPM_SN_* implementation */
+const char* kpm_sn_impl_name(int impl);
+
+#endif /*_KPMOUSE_SNAP_H_*/
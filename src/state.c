@@ -1,12 +1,12 @@
 
 #include "state.h"
-#include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
-#include <xdo.h>
+#include <math.h>
 #include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
 
 // KPM_LOG_STEPS must fit in a char
 extern int ASSERT_KPM_LOG_STEPS_max[KPM_LOG_STEPS >= 256 ? -1 : 1];
@@ -16,59 +16,281 @@ extern int ASSERT_KPM_LOG_STEPS_min[KPM_LOG_STEPS <  0   ? -1 : 1];
 // KPM_LINEAR_STEPS cannot be <= 0
 extern int ASSERT_KPM_LINEAR_STEPS_min[KPM_LOG_STEPS <=  0  ? -1 : 1];
 
-#define MOVE_MOUSE(...) \
-  KPM_CHK2(KPM_ERR_XDO_MOVE_MOUSE, xdo_move_mouse, __VA_ARGS__)
+// KPM_ANIM_FPS cannot be < 0
+extern int ASSERT_KPM_ANIM_FPS_min[KPM_ANIM_FPS < 0 ? -1 : 1];
+
+/**
+ * Frame rate of the animated motion when KPM_ANIM_FPS is 0 and RandR does not
+ * report a refresh rate
+ */
+#define KPM_ANIM_FALLBACK_FPS 60
 
 
 ////////////////////////////////////
 // private functions
 ////////////////////////////////////
 
-static int kpm_st_reset2(kpm_st_t* st, int screen) {
-  KPM_RET2(KPM_ERR_XDO_VIEWPORT, xdo_get_viewport_dimensions,
-           st->xdo, &st->w, &st->h, screen)
-    st->log_steps = 0;
+/** Records a pointer move, injected by the next kpm_st_commit() */
+static void kpm_st_defer(kpm_st_t* st, int x, int y, int screen) {
+  st->pend = 1;
+  st->pend_x = x;
+  st->pend_y = y;
+  st->pend_screen = screen;
+}
+
+/**
+ * Makes the monitor of screen under the shadow pointer the movement window
+ * and recomputes the linear steps for its size.
+ */
+static void kpm_st_reset2(kpm_st_t* st, int screen) {
+  const kpm_mon_t* mon = kpm_mn_at(&st->mn, screen, st->ptr_x, st->ptr_y);
+  st->win_x = mon->x;
+  st->win_y = mon->y;
+  st->w = mon->w;
+  st->h = mon->h;
+  st->log_steps = 0;
+  unsigned int cells = 1; // per side of the last log window
+  for (int i = 0; i < st->max_log_steps; ++i)
+    cells *= st->grid;
+  st->step_x = st->w/cells/st->expected_linear_steps;
+  st->step_y = st->h/cells/st->expected_linear_steps;
+  st->step_x = st->step_x > 0 ? st->step_x : 1;
+  st->step_y = st->step_y > 0 ? st->step_y : 1;
+}
+
+/** Refreshes the shadow pointer from the X server, if it is stale. */
+static int kpm_st_sync_pointer(kpm_st_t* st) {
+  if (!st->ptr_stale)
+    return KPM_SUCCESS;
+  KPM_RET(kpm_st_commit, st); // else the server answers the old position
+  KPM_RET2(KPM_ERR_GET_MOUSE, kpm_be_query,
+           st->be, &st->ptr_x, &st->ptr_y, &st->ptr_screen);
+  // Without X, only kpmouse moves the pointer of its backend
+  st->ptr_stale = st->dpy && st->xi_opcode < 0;
   return KPM_SUCCESS;
 }
 
 static int kpm_st_get_screen(kpm_st_t* st) {
-  int x, y, s;
-  return KPM_CHK(xdo_get_mouse_location, st->xdo, &x, &y, &s) ? 0 : s;
+  return kpm_st_sync_pointer(st) ? 0 : st->ptr_screen;
+}
+
+/** Moves (*x, *y) onto the nearest monitor of screen, if it is off all */
+static void kpm_st_clamp(const kpm_st_t* st, int screen, int* x, int* y) {
+  const kpm_mon_t* mon = kpm_mn_at(&st->mn, screen, *x, *y);
+  int right = mon->x + (int)mon->w, bottom = mon->y + (int)mon->h;
+  *x = *x < mon->x ? mon->x : (*x >= right ? right-1 : *x);
+  *y = *y < mon->y ? mon->y : (*y >= bottom ? bottom-1 : *y);
+}
+
+/** Maps the fraction t of the animation time into a fraction of the path */
+static double kpm_ease(kpm_easing_t easing, double t) {
+  double u = 1 - t;
+  switch (easing) {
+  case KPM_EASE_OUT_QUAD:     return 1 - u*u;
+  case KPM_EASE_OUT_CUBIC:    return 1 - u*u*u;
+  case KPM_EASE_IN_OUT_CUBIC: return t < 0.5 ? 4*t*t*t : 1 - 4*u*u*u;
+  default:                    return t;
+  }
+}
+
+/**
+ * Queues a pointer move (or starts animating towards it) and records it on
+ * the shadow pointer, which is kept on the monitors of screen.
+ */
+static int kpm_st_warp(kpm_st_t* st, int x, int y, int screen,
+                       long int now_ms) {
+  kpm_st_clamp(st, screen, &x, &y);
+  if (st->anim_ms && screen == st->ptr_screen) {
+    // retarget: start from wherever the last frame left the pointer
+    if (!st->animating) {
+      st->anim_x = st->ptr_x;
+      st->anim_y = st->ptr_y;
+    }
+    st->anim_x0 = st->anim_x;
+    st->anim_y0 = st->anim_y;
+    st->anim_start_ms = now_ms;
+    st->animating = 1;
+  } else {
+    st->animating = 0;
+    kpm_st_defer(st, x, y, screen);
+  }
+  st->ptr_x = x;
+  st->ptr_y = y;
+  st->ptr_screen = screen;
+  return KPM_SUCCESS;
+}
+
+/** Stores the ids of XTest slave pointers into st->xtest_dev */
+static void kpm_st_find_xtest_devs(kpm_st_t* st) {
+  int n_devs = 0;
+  XIDeviceInfo* devs = XIQueryDevice(st->dpy, XIAllDevices, &n_devs);
+  st->n_xtest_devs = 0;
+  for (int i = 0; i < n_devs; ++i) {
+    if (devs[i].use != XISlavePointer || !strstr(devs[i].name, "XTEST"))
+      continue;
+    if (st->n_xtest_devs == KPM_MAX_XTEST_DEVS) {
+      fprintf(stderr, "Too many XTest pointers, motion of %s will be "
+              "treated as foreign.\n", devs[i].name);
+      continue;
+    }
+    st->xtest_dev[st->n_xtest_devs++] = devs[i].deviceid;
+  }
+  if (devs)
+    XIFreeDeviceInfo(devs);
+}
+
+/** Non-zero if device is one of st->xtest_dev */
+static int kpm_st_is_xtest(const kpm_st_t* st, int device) {
+  for (int i = 0; i < st->n_xtest_devs; ++i) {
+    if (st->xtest_dev[i] == device)
+      return 1;
+  }
+  return 0;
+}
+
+/**
+ * Non-zero if the raw motion of an XTest device is one of the moves injected
+ * by kpmouse: absolute XTest motion carries the screen coordinates of its
+ * target in the raw values. The matched move and the older ones (superseded
+ * or not reported) are forgotten.
+ */
+static int kpm_st_own_motion(kpm_st_t* st, const XIRawEvent* raw) {
+  double pos[2];
+  char has[2] = {0, 0};
+  const double* value = raw->raw_values;
+  for (int i = 0; i < raw->valuators.mask_len*8; ++i) {
+    if (!XIMaskIsSet(raw->valuators.mask, i))
+      continue;
+    if (i < 2) {
+      pos[i] = *value;
+      has[i] = 1;
+    }
+    ++value;
+  }
+  for (int i = 0; i < st->n_injected; ++i) {
+    if ((has[0] && pos[0] != st->injected[i][0])
+        || (has[1] && pos[1] != st->injected[i][1]))
+      continue;
+    st->n_injected -= i + 1;
+    memmove(st->injected, st->injected + i + 1,
+            st->n_injected*sizeof(st->injected[0]));
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Selects XI_RawMotion events on all root windows, so that motion caused by
+ * other devices marks the shadow pointer as stale. If XInput 2.2 is not
+ * available, st->xi_opcode is set to -1.
+ */
+static int kpm_st_track_pointer(kpm_st_t* st) {
+  Display* dpy = st->dpy;
+  int ev_base, err_base, major = 2, minor = 2;
+  st->xi_opcode = -1;
+  if (!dpy)
+    return KPM_SUCCESS;
+  if (!XQueryExtension(dpy, "XInputExtension",
+                       &st->xi_opcode, &ev_base, &err_base)
+      || XIQueryVersion(dpy, &major, &minor) != Success) {
+    fprintf(stderr, "XInput 2.2 not available, pointer position will be "
+            "queried on every move.\n");
+    st->xi_opcode = -1;
+    return KPM_SUCCESS;
+  }
+
+  // raw events of master devices carry the id of the originating slave
+  unsigned char raw_bits[XIMaskLen(XI_LASTEVENT)] = {0};
+  unsigned char hierarchy_bits[XIMaskLen(XI_LASTEVENT)] = {0};
+  XIEventMask masks[2] = {
+    {XIAllMasterDevices, sizeof(raw_bits), raw_bits},
+    {XIAllDevices, sizeof(hierarchy_bits), hierarchy_bits}
+  };
+  XISetMask(raw_bits, XI_RawMotion);
+  XISetMask(hierarchy_bits, XI_HierarchyChanged);
+  for (int screen = 0; screen < ScreenCount(dpy); ++screen) {
+    KPM_RET2(KPM_ERR_XI_SELECT, XISelectEvents,
+             dpy, RootWindow(dpy, screen), masks, 2);
+  }
+  kpm_st_find_xtest_devs(st);
+  return KPM_SUCCESS;
 }
 
 static void kpm_add_move(int* x, int* y, int step_x, int step_y,
-                         kpm_move_t move, char reverse) {
+                         kpm_move_t move) {
   assert(step_x >= 0);
   assert(step_y >= 0);
   assert(step_x != 0);
   assert(step_y != 0);
-  assert(!(move & ~0x7));
-  move &= 0x7; // ignore invalid bits
+  assert(move >= 0 && move <= KPM_CC);
 
-  int negative = reverse ? 1 : -1, positive = reverse ? -1 : 1;
-  if (move & 0x1) { //move over cross
+  if (move < 0 || move >= KPM_CC) { // center cell (or invalid): stay
+    step_x = step_y = 0;
+  } else if (move & 0x1) { //move over cross
     switch(move>>1) {
-    case 0: step_y *= negative; step_x = 0; break;
-    case 1: step_y *= positive; step_x = 0; break;
-    case 2: step_x *= negative; step_y = 0; break;
-    case 3: step_x *= positive; step_y = 0; break;
+    case 0: step_y = -step_y; step_x = 0; break;
+    case 1: step_x = 0; break;
+    case 2: step_x = -step_x; step_y = 0; break;
+    case 3: step_y = 0; break;
     }
   } else { // move to rectangle center
-    step_y *= (move & 4) ? positive : negative;
-    step_x *= (move & 2) ? positive : negative;
+    step_y *= (move & 4) ? 1 : -1;
+    step_x *= (move & 2) ? 1 : -1;
   }
 
-#ifndef NDEBUG
-  printf("kpm_add_move(%d, %d, %d, %d, %d, %d) -> (%d, %d)\n",
-         *x, *y, step_x, step_y, move, reverse, *x+step_x, *y+step_y);
-#endif /*NDEBUG*/
   *x += step_x;
   *y += step_y;
+  kpm_tr(KPM_TR_MOVE, move, *x, *y, 0);
+}
+
+/** Unit direction (-1, 0 or 1 on each axis) of a move */
+static void kpm_move_dir(kpm_move_t move, int* dir_x, int* dir_y) {
+  if (move == KPM_CC) {
+    *dir_x = *dir_y = 0;
+  } else if (move & 0x1) { //move over cross
+    *dir_x = (move>>1) < 2 ? 0 : ((move>>1) == 2 ? -1 : 1);
+    *dir_y = (move>>1) > 1 ? 0 : ((move>>1) == 0 ? -1 : 1);
+  } else {
+    *dir_x = (move & 2) ? 1 : -1;
+    *dir_y = (move & 4) ? 1 : -1;
+  }
+}
+
+/**
+ * Aims the pointer at the center of the movement window or, if the click
+ * history has a cluster of clicks inside it, at the cluster.
+ */
+static void kpm_st_aim(kpm_st_t* st, int screen) {
+  unsigned int w, h;
+  st->aim_x = st->log_x;
+  st->aim_y = st->log_y;
+  if (!st->hs || !st->log_steps || kpm_mn_screen_size(&st->mn, screen, &w, &h))
+    return;
+  kpm_hs_predict(st->hs, screen, w, h, st->log_x - (int)st->w/2,
+                 st->log_y - (int)st->h/2, st->w, st->h,
+                 KPM_HISTORY_MIN_CLICKS, &st->aim_x, &st->aim_y);
+}
+
+/**
+ * Distance from the center of a window of size to the center of the cell
+ * selected by a log step: a quarter of it with the 2x2 grid, a third with
+ * the 3x3 grid.
+ */
+static int kpm_st_cell_step(const kpm_st_t* st, unsigned int size) {
+  return size*(st->grid-1)/(2*st->grid);
+}
+
+/** Sets st->frame_ms from KPM_ANIM_FPS or the monitor refresh rate */
+static void kpm_st_frame_rate(kpm_st_t* st) {
+  unsigned int fps = KPM_ANIM_FPS ? KPM_ANIM_FPS : st->mn.refresh_hz;
+  fps = fps ? fps : KPM_ANIM_FALLBACK_FPS;
+  st->frame_ms = fps < 1000 ? 1000/fps : 1;
 }
 
-/** Sets st->move_ts and returns non-zero iff the move in st was not expired */
-static int kpm_set_move_ts(kpm_st_t* st) {
-  long int age = kpm__ms_elapsed_upd(&st->move_ts);
+/** Sets st->move_ms and returns non-zero iff the move in st was not expired */
+static int kpm_set_move_ts(kpm_st_t* st, long int now_ms) {
+  long int age = now_ms - st->move_ms;
+  st->move_ms = now_ms;
   return age < st->move_ttl_ms;
 }
 
@@ -77,76 +299,125 @@ static int kpm_set_move_ts(kpm_st_t* st) {
 // public functions
 ////////////////////////////////////
 
-int kpm_st_init(kpm_st_t* st) {
+int kpm_st_init(kpm_st_t* st, kpm_be_t* be) {
   memset(st, 0, sizeof(kpm_st_t));
-  st->xdo = xdo_new(NULL);
-  if (!st->xdo) {
-    fprintf(stderr, "xdo_new(NULL) failed");
-    return KPM_ERR_XDO_NEW;
-  }
-  st->max_log_steps = KPM_LOG_STEPS;
+  st->be = be;
+  st->dpy = be->dpy;
+  const char* grid = getenv("KPM_GRID");
+  st->grid = (grid ? atoi(grid) : KPM_GRID) == 3 ? 3 : 2;
+  st->max_log_steps = st->grid == 3 ? KPM_GRID3_LOG_STEPS : KPM_LOG_STEPS;
   st->expected_linear_steps = KPM_LINEAR_STEPS;
   st->move_ttl_ms = KPM_MOVE_TTL_MS;
-  KPM_RET2(KPM_ERR_GETTIME, clock_gettime, CLOCK_MONOTONIC, &st->move_ts);
+  st->ptr_stale = 1;
+  st->anim_ms = KPM_ANIM_MS;
+  st->easing = KPM_ANIM_EASING;
+  st->glide_tick_ms = KPM_GLIDE_TICK_MS;
+  st->glide_speed = KPM_GLIDE_SPEED;
+  st->glide_accel = KPM_GLIDE_ACCEL;
+  st->glide_accel_exp = KPM_GLIDE_ACCEL_EXP;
+  st->glide_max_speed = KPM_GLIDE_MAX_SPEED;
+  KPM_RET(kpm_st_track_pointer, st);
+  KPM_RET(kpm_mn_init, &st->mn, be);
+  kpm_st_frame_rate(st);
   KPM_RET(kpm_st_reset, st);
-  st->step_x = st->w/(1<<st->max_log_steps)/st->expected_linear_steps;
-  st->step_y = st->h/(1<<st->max_log_steps)/st->expected_linear_steps;
-#ifdef NDEBUG
-  printf("kpm_st_init(%p) {\n"
-         "  w = %d,\n"
-         "  h = %d,\n"
-         "  log_steps = %d,\n"
-         "  log_x = %d,\n"
-         "  log_y = %d,\n"
-         "  max_log_steps = %d,\n"
-         "  expected_linear_steps = %d,\n"
-         "  step_x = %d,\n"
-         "  step_y = %d\n"
-         "}\n",
-         st, st->w, st->h, st->log_steps,
-         st->log_x, st->log_y, st->max_log_steps,
-         st->expected_linear_steps, st->step_x, st->step_y);
-#endif /*NDEBUG*/
+  kpm_tr(KPM_TR_INIT, 0, st->w, st->h, st->max_log_steps);
   return KPM_SUCCESS;
 }
 
 void kpm_st_destroy(kpm_st_t* st) {
-  xdo_free(st->xdo);
-  st->xdo = NULL;
+  st->be = NULL;
+  st->dpy = NULL;
 }
 
 
 int kpm_st_reset(kpm_st_t* st) {
-  return kpm_st_reset2(st, kpm_st_get_screen(st));
+  kpm_st_reset2(st, kpm_st_get_screen(st));
+  return KPM_SUCCESS;
 }
 
 
-int kpm_st_move(kpm_st_t* st, kpm_move_t move) {
-  int x, y, screen;
-  KPM_RET2(KPM_ERR_XDO_GET_MOUSE, xdo_get_mouse_location,
-           st->xdo, &x, &y, &screen);
-  if (!kpm_set_move_ts(st))
+int kpm_st_move(kpm_st_t* st, kpm_move_t move, long int now_ms) {
+  KPM_RET(kpm_st_sync_pointer, st);
+  int x = st->ptr_x, y = st->ptr_y, screen = st->ptr_screen;
+  if (!kpm_set_move_ts(st, now_ms))
     st->log_steps = 0; //expired move
   if (st->log_steps == 0 && st->max_log_steps > 0) {
     kpm_st_reset2(st, screen);
-    x = st->w/2;
-    y = st->h/2;
+    x = st->win_x + st->w/2;
+    y = st->win_y + st->h/2;
   }
   if (st->log_steps < st->max_log_steps) {
-    kpm_add_move(&x, &y, st->w/4, st->h/4, move, 0);
+    if (st->log_steps) { // split the window, not around a predicted aim
+      x += st->log_x - st->aim_x;
+      y += st->log_y - st->aim_y;
+    }
+    kpm_st_win_t* win = &st->win_log[st->log_steps];
+    win->w = st->w;
+    win->h = st->h;
+    win->x = x;
+    win->y = y;
+    kpm_add_move(&x, &y, kpm_st_cell_step(st, st->w),
+                 kpm_st_cell_step(st, st->h), move);
     st->log_x = x;
     st->log_y = y;
     st->history[st->log_steps++] = move;
-    st->w /= 2;
-    st->h /= 2;
+    st->w /= st->grid;
+    st->h /= st->grid;
+    kpm_st_aim(st, screen);
+    x = st->aim_x;
+    y = st->aim_y;
   } else {
-    kpm_add_move(&x, &y, st->step_x, st->step_y, move, 0);
+    kpm_add_move(&x, &y, st->step_x, st->step_y, move);
   }
-  return MOVE_MOUSE(st->xdo, x, y, screen);
+  return kpm_st_warp(st, x, y, screen, now_ms);
+}
+
+int kpm_st_jump(kpm_st_t* st, kpm_move_t move, long int now_ms) {
+  int dir_x, dir_y;
+  KPM_RET(kpm_st_sync_pointer, st);
+  kpm_move_dir(move, &dir_x, &dir_y);
+  if (!dir_x && !dir_y)
+    return KPM_SUCCESS; // KPM_CC: no monitor in that direction
+  const kpm_mon_t* from = kpm_mn_at(&st->mn, st->ptr_screen,
+                                    st->ptr_x, st->ptr_y);
+  const kpm_mon_t* to = kpm_mn_next(&st->mn, from, dir_x, dir_y);
+  if (!to)
+    return KPM_SUCCESS;
+  st->log_steps = 0;
+  return kpm_st_warp(st, to->x + to->w/2, to->y + to->h/2, to->screen,
+                     now_ms);
 }
 
-int kpm_st_unmove(kpm_st_t* st) {
-  if (!kpm_set_move_ts(st))
+int kpm_st_snap(kpm_st_t* st, kpm_sn_t* sn, kpm_move_t move,
+                long int now_ms) {
+  int dir_x, dir_y;
+  if (!sn || move == KPM_CC)
+    return kpm_st_move(st, move, now_ms);
+  KPM_RET(kpm_st_sync_pointer, st);
+  int x = st->ptr_x, y = st->ptr_y, screen = st->ptr_screen;
+  const kpm_mon_t* mon = kpm_mn_at(&st->mn, screen, x, y);
+  int left = mon->x, top = mon->y;
+  int right = mon->x + (int)mon->w, bottom = mon->y + (int)mon->h;
+  if (st->log_steps && now_ms - st->move_ms < st->move_ttl_ms) {
+    // the movement window, centered on the pointer once linear
+    int half_w = st->w/2, half_h = st->h/2;
+    left = x - half_w > left ? x - half_w : left;
+    top = y - half_h > top ? y - half_h : top;
+    right = x + half_w + 1 < right ? x + half_w + 1 : right;
+    bottom = y + half_h + 1 < bottom ? y + half_h + 1 : bottom;
+  }
+  kpm_move_dir(move, &dir_x, &dir_y);
+  if (!kpm_sn_snap(sn, screen, left, top, right - left, bottom - top,
+                   dir_x, dir_y, &x, &y)) {
+    return kpm_st_move(st, move, now_ms);
+  }
+  if (!kpm_set_move_ts(st, now_ms))
+    st->log_steps = 0; //expired move
+  return kpm_st_warp(st, x, y, screen, now_ms);
+}
+
+int kpm_st_unmove(kpm_st_t* st, long int now_ms) {
+  if (!kpm_set_move_ts(st, now_ms))
     st->log_steps = 0; //expired move
   if (!st->log_steps)
     return KPM_SUCCESS;
@@ -154,14 +425,238 @@ int kpm_st_unmove(kpm_st_t* st) {
   int screen = kpm_st_get_screen(st);
   if (st->log_steps >= st->max_log_steps) { //undo all linear steps
     --st->log_steps;
-    return MOVE_MOUSE(st->xdo, st->log_x, st->log_y, screen);
+    return kpm_st_warp(st, st->aim_x, st->aim_y, screen, now_ms);
   } // else: undo a log step
 
-  kpm_add_move(&st->log_x, &st->log_y, st->w/2, st->h/2,
-               st->history[--st->log_steps], 1);
-  st->w *= 2;
-  st->h *= 2;
+  const kpm_st_win_t* win = &st->win_log[--st->log_steps];
+  st->w = win->w;
+  st->h = win->h;
+  st->log_x = win->x;
+  st->log_y = win->y;
+  kpm_tr(KPM_TR_MOVE, st->history[st->log_steps], st->log_x, st->log_y, 1);
+  kpm_st_aim(st, screen);
+
+  return kpm_st_warp(st, st->aim_x, st->aim_y, screen, now_ms);
+}
+
+void kpm_st_save(kpm_st_t* st) {
+  kpm_st_saved_t* s = &st->saved;
+  s->w = st->w;
+  s->h = st->h;
+  s->win_x = st->win_x;
+  s->win_y = st->win_y;
+  s->log_steps = st->log_steps;
+  s->log_x = st->log_x;
+  s->log_y = st->log_y;
+  s->aim_x = st->aim_x;
+  s->aim_y = st->aim_y;
+  memcpy(s->history, st->history, sizeof(s->history));
+  memcpy(s->win_log, st->win_log, sizeof(s->win_log));
+  s->step_x = st->step_x;
+  s->step_y = st->step_y;
+  s->move_ms = st->move_ms;
+  s->ptr_saved = !kpm_st_sync_pointer(st);
+  s->ptr_x = st->ptr_x;
+  s->ptr_y = st->ptr_y;
+  s->ptr_screen = st->ptr_screen;
+}
+
+int kpm_st_restore(kpm_st_t* st, long int now_ms) {
+  const kpm_st_saved_t* s = &st->saved;
+  st->w = s->w;
+  st->h = s->h;
+  st->win_x = s->win_x;
+  st->win_y = s->win_y;
+  st->log_steps = s->log_steps;
+  st->log_x = s->log_x;
+  st->log_y = s->log_y;
+  st->aim_x = s->aim_x;
+  st->aim_y = s->aim_y;
+  memcpy(st->history, s->history, sizeof(st->history));
+  memcpy(st->win_log, s->win_log, sizeof(st->win_log));
+  st->step_x = s->step_x;
+  st->step_y = s->step_y;
+  st->move_ms = s->move_ms;
+  if (!s->ptr_saved)
+    return KPM_SUCCESS; // better left alone than sent to a stale position
+  return kpm_st_warp(st, s->ptr_x, s->ptr_y, s->ptr_screen, now_ms);
+}
+
+int kpm_st_page(kpm_st_t* st, kpm_move_t move, long int now_ms) {
+  int dir_x, dir_y;
+  KPM_RET(kpm_st_sync_pointer, st);
+  if (!kpm_set_move_ts(st, now_ms) || !st->log_steps) {
+    st->log_steps = 0; //no movement window
+    return kpm_st_jump(st, move, now_ms);
+  }
+  kpm_move_dir(move, &dir_x, &dir_y);
+  int screen = st->ptr_screen, w = st->w, h = st->h;
+  const kpm_mon_t* mon = kpm_mn_at(&st->mn, screen, st->win_x, st->win_y);
+  int right = mon->x + (int)mon->w, bottom = mon->y + (int)mon->h;
+  if (st->log_steps >= st->max_log_steps) {
+    int x = st->ptr_x + dir_x*w, y = st->ptr_y + dir_y*h;
+    x = x < mon->x ? mon->x : (x >= right ? right-1 : x);
+    y = y < mon->y ? mon->y : (y >= bottom ? bottom-1 : y);
+    return kpm_st_warp(st, x, y, screen, now_ms);
+  }
+  // keep the whole window, [log_x - w/2, log_x - w/2 + w), in the monitor
+  int min_x = mon->x + w/2, max_x = right - w + w/2;
+  int min_y = mon->y + h/2, max_y = bottom - h + h/2;
+  int x = st->log_x + dir_x*w, y = st->log_y + dir_y*h;
+  st->log_x = x < min_x ? min_x : (x > max_x ? max_x : x);
+  st->log_y = y < min_y ? min_y : (y > max_y ? max_y : y);
+  kpm_st_aim(st, screen);
+  return kpm_st_warp(st, st->aim_x, st->aim_y, screen, now_ms);
+}
+
+int kpm_st_goto(kpm_st_t* st, int x, int y, int screen) {
+  st->animating = 0;
+  st->log_steps = 0;
+  kpm_st_clamp(st, screen, &x, &y);
+  kpm_st_defer(st, x, y, screen);
+  st->ptr_x = x;
+  st->ptr_y = y;
+  st->ptr_screen = screen;
+  return KPM_SUCCESS;
+}
+
+void kpm_st_click(kpm_st_t* st, kpm_button_t button) {
+  unsigned int w, h;
+  if (!st->hs || kpm_st_sync_pointer(st)
+      || kpm_mn_screen_size(&st->mn, st->ptr_screen, &w, &h)) {
+    return;
+  }
+  kpm_hs_add(st->hs, st->ptr_screen, button, st->ptr_x, st->ptr_y, w, h);
+}
+
+void kpm_st_expire(kpm_st_t* st) {
+  st->log_steps = 0;
+}
+
+int kpm_st_anim_step(kpm_st_t* st, long int now_ms) {
+  if (!st->animating)
+    return KPM_SUCCESS;
+  double t = (now_ms - st->anim_start_ms) / (double)st->anim_ms;
+  if (t >= 1)
+    return kpm_st_anim_finish(st);
+  double e = kpm_ease(st->easing, t < 0 ? 0 : t);
+  int x = st->anim_x0 + (int)((st->ptr_x - st->anim_x0)*e);
+  int y = st->anim_y0 + (int)((st->ptr_y - st->anim_y0)*e);
+  if (x == st->anim_x && y == st->anim_y)
+    return KPM_SUCCESS; // sub-pixel progress, nothing to inject
+  st->anim_x = x;
+  st->anim_y = y;
+  kpm_st_defer(st, x, y, st->ptr_screen);
+  return KPM_SUCCESS;
+}
+
+int kpm_st_anim_finish(kpm_st_t* st) {
+  if (!st->animating)
+    return KPM_SUCCESS;
+  st->animating = 0;
+  st->anim_x = st->ptr_x;
+  st->anim_y = st->ptr_y;
+  kpm_st_defer(st, st->ptr_x, st->ptr_y, st->ptr_screen);
+  return KPM_SUCCESS;
+}
+
+int kpm_st_glide_start(kpm_st_t* st, kpm_move_t move, long int now_ms) {
+  if (st->log_steps < st->max_log_steps || st->ptr_stale)
+    return 0;
+  st->gliding = 1;
+  st->glide_move = move;
+  st->glide_start_ms = st->glide_last_ms = now_ms;
+  st->glide_fx = st->glide_fy = 0;
+  return 1;
+}
+
+int kpm_st_glide_step(kpm_st_t* st, long int now_ms) {
+  if (!st->gliding)
+    return KPM_SUCCESS;
+  float t = (now_ms - st->glide_start_ms)/1000.0f;
+  float v = st->glide_speed + st->glide_accel*powf(t, st->glide_accel_exp);
+  if (v > st->glide_max_speed)
+    v = st->glide_max_speed;
+  float steps = v*(now_ms - st->glide_last_ms)/1000.0f;
+  st->glide_last_ms = now_ms;
+
+  int dir_x, dir_y;
+  kpm_move_dir(st->glide_move, &dir_x, &dir_y);
+  st->glide_fx += dir_x*steps*st->step_x;
+  st->glide_fy += dir_y*steps*st->step_y;
+  int dx = (int)st->glide_fx, dy = (int)st->glide_fy;
+  if (!dx && !dy)
+    return KPM_SUCCESS;
+  st->glide_fx -= dx;
+  st->glide_fy -= dy;
+
+  int x = st->ptr_x + dx, y = st->ptr_y + dy;
+  kpm_st_clamp(st, st->ptr_screen, &x, &y);
+  if (x == st->ptr_x && y == st->ptr_y)
+    return KPM_SUCCESS; // held against the monitor edge
+  st->animating = 0; // gliding is already smooth
+  kpm_st_defer(st, x, y, st->ptr_screen);
+  st->ptr_x = x;
+  st->ptr_y = y;
+  return KPM_SUCCESS;
+}
+
+void kpm_st_glide_stop(kpm_st_t* st, long int now_ms) {
+  if (!st->gliding)
+    return;
+  st->gliding = 0;
+  kpm_set_move_ts(st, now_ms);
+}
 
-  return MOVE_MOUSE(st->xdo, st->log_x, st->log_y, screen);
+int kpm_st_commit(kpm_st_t* st) {
+  if (!st->pend)
+    return KPM_SUCCESS;
+  st->pend = 0;
+  int err = KPM_CHK2(KPM_ERR_MOVE_MOUSE, kpm_be_move, st->be,
+                     st->pend_x, st->pend_y, st->pend_screen);
+  if (err) {
+    st->ptr_stale = 1;
+    return err;
+  }
+  if (st->n_injected == KPM_MAX_INJECTED) { // forget the oldest
+    memmove(st->injected, st->injected + 1,
+            --st->n_injected*sizeof(st->injected[0]));
+  }
+  st->injected[st->n_injected][0] = st->pend_x;
+  st->injected[st->n_injected++][1] = st->pend_y;
+  return KPM_SUCCESS;
+}
+
+int kpm_st_handle_event(kpm_st_t* st, XEvent* ev) {
+  if (kpm_mn_handle_event(&st->mn, ev)) {
+    kpm_st_frame_rate(st);
+    return 1;
+  }
+  XGenericEventCookie* cookie = &ev->xcookie;
+  if (ev->type != GenericEvent || cookie->extension != st->xi_opcode)
+    return 0;
+  if (cookie->evtype == XI_HierarchyChanged) {
+    kpm_st_find_xtest_devs(st);
+  } else if (cookie->evtype == XI_RawMotion) {
+    // the data may have been fetched already by a caller sharing ev
+    char must_fetch = !cookie->data;
+    if (must_fetch && !XGetEventData(st->dpy, cookie)) {
+      st->ptr_stale = 1;
+      return 1;
+    }
+    XIRawEvent* raw = cookie->data;
+    // raw events of master devices carry the master in deviceid
+    int foreign = !st->master || raw->deviceid == st->master;
+    // even when stale, so that injected only keeps moves still to come back
+    if (foreign && kpm_st_is_xtest(st, raw->sourceid))
+      foreign = !kpm_st_own_motion(st, raw);
+    if (foreign && !st->ptr_stale) {
+      st->ptr_stale = 1; // someone else took the pointer, stop fighting it
+      st->animating = st->gliding = 0;
+    }
+    if (must_fetch)
+      XFreeEventData(st->dpy, cookie);
+  }
+  return 1;
 }
 
@@ -4,13 +4,17 @@
 #include "config.h"
 #include "user_config.h"
 #include "errors.h"
+#include "backend.h"
+#include "monitors.h"
+#include "snap.h"
+#include "history.h"
 #include <time.h>
 
 ////////////////////////////////////////////
 // Third paty forward declarations
 ////////////////////////////////////////////
 
-typedef struct xdo xdo_t; //xdo.h
+typedef union _XEvent XEvent; //X11/Xlib.h
 
 ////////////////////////////////////////////
 // Types and Constants
@@ -51,6 +55,17 @@ typedef struct xdo xdo_t; //xdo.h
  *     ||         |          ||
  *     ++====================++
  *
+ * With a 3x3 grid (see kpm_st_t.grid), the same values name the outer cells
+ * and the center cell is KPM_CC (8):
+ *
+ *     ++======+======+======++
+ *     ||   0  |   1  |   2  ||
+ *     ||------+------+------||
+ *     ||   5  |   8  |   7  ||
+ *     ||------+------+------||
+ *     ||   4  |   3  |   6  ||
+ *     ++======+======+======++
+ *
  */
 typedef char kpm_move_t;
 
@@ -63,7 +78,8 @@ typedef char kpm_move_t;
 #define KPM_CD        3 ///< lower cross segment center
 #define KPM_CL        5 ///< left  cross segment center
 #define KPM_CR        7 ///< right cross segment center
-#define KPM_NULL_MOVE 8 ///< not a move value
+#define KPM_CC        8 ///< center cell (no displacement), for a 3x3 grid
+#define KPM_NULL_MOVE 9 ///< not a move value
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
 typedef char kpm_button_t;
@@ -75,14 +91,68 @@ typedef char kpm_button_t;
 #define KPM_NULL_BUTTON 3 ///< not a mouse button
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
+typedef char kpm_easing_t;
+
+/* vvvvvvvvvvvvvvvv Constants values for kpm_easing_t vvvvvvvvvvvvvvv */
+#define KPM_EASE_LINEAR       0 ///< constant speed
+#define KPM_EASE_OUT_QUAD     1 ///< decelerates towards the target
+#define KPM_EASE_OUT_CUBIC    2 ///< decelerates faster than KPM_EASE_OUT_QUAD
+#define KPM_EASE_IN_OUT_CUBIC 3 ///< accelerates, then decelerates
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/** A movement window, as it was before a log step split it */
+typedef struct kpm_st_win_s {
+  unsigned int w, h;
+  /** Center of the window */
+  int x, y;
+} kpm_st_win_t;
+
+/**
+ * Movement state saved by kpm_st_save(), so that a move done speculatively
+ * can be taken back exactly (unlike kpm_st_unmove(), which goes back to the
+ * last log step).
+ */
+typedef struct kpm_st_saved_s {
+  unsigned int w, h;
+  int win_x, win_y;
+  unsigned char log_steps;
+  int log_x, log_y, aim_x, aim_y;
+  kpm_move_t history[KPM_LOG_STEPS];
+  kpm_st_win_t win_log[KPM_LOG_STEPS];
+  short step_x, step_y;
+  long int move_ms;
+  int ptr_x, ptr_y, ptr_screen;
+  /** Zero if the pointer could not be synced, so it is not moved back */
+  char ptr_saved;
+} kpm_st_saved_t;
+
+/** How many XTest slave pointers are tracked in kpm_st_t.xtest_dev */
+#define KPM_MAX_XTEST_DEVS 4
+
+/** How many injected moves kpm_st_t.injected remembers */
+#define KPM_MAX_INJECTED 16
+
 /** State object */
 typedef struct kpm_st_s {
   /** Current width and height of window (to be split on next move) */
   unsigned int w, h;
 
+  /**
+   * Top-left corner of the movement window at the first log step: the
+   * monitor on which the movement started.
+   */
+  int win_x, win_y;
+
+  /**
+   * Cells per side into which a log step splits the movement window: 2 (four
+   * rectangles around a cross) or 3 (a 3x3 grid, whose center cell is
+   * KPM_CC). @see KPM_GRID
+   */
+  unsigned char grid;
+
   /**
    * How many logarithmic moves where done (each log step splits the movement
-   * window in four rectangles). After initialization or reset, w and h cover
+   * window in grid*grid cells). After initialization or reset, w and h cover
    * the whole screen and this field is zero. After some point (KPM_LOG_STEPS)
    * it stops incrementing and moves become linear (see step_x and step_y).
    */
@@ -96,12 +166,26 @@ typedef struct kpm_st_s {
    */
   int log_x, log_y;
 
+  /**
+   * Where the last log step placed the pointer: log_x and log_y, unless the
+   * click history (hs) has a cluster of clicks inside the movement window.
+   * The next log step still splits the movement window around log_x, log_y.
+   */
+  int aim_x, aim_y;
+
   /**
    * stack of kpm_move_t log steps performed. history[log_steps-1] is the most
    * recent move.
    */
   kpm_move_t history[KPM_LOG_STEPS];
 
+  /**
+   * The movement window that each log step of history split: win_log[i] is
+   * the window before history[i]. kpm_st_unmove() restores it as is, since
+   * multiplying the divided w and h back by grid would lose the remainders.
+   */
+  kpm_st_win_t win_log[KPM_LOG_STEPS];
+
   /**
    * Maximum number of logarithmic steps before movement becomes linear
    * @see KPM_LOG_STEPS
@@ -119,19 +203,127 @@ typedef struct kpm_st_s {
   /** Linear step size (after maximum log steps performed) */
   short step_x, step_y;
 
-  /** clock timestamp of last move (log or linear).  */
-  struct timespec move_ts;
+  /** Time (milliseconds) of the last move (log or linear) */
+  long int move_ms;
 
   /**
    * How may milliseconds a move survives inactivity. If current time is more
-   * than move_ttl_ms milliseconds from move_ts, then the move operation is
+   * than move_ttl_ms milliseconds from move_ms, then the move operation is
    * expired. Further kpm_st_move() operations will start a new move from
    * scratch.
    */
   unsigned int move_ttl_ms;
 
-  /** libxdo context */
-  xdo_t* xdo;
+  /**
+   * Shadow of the pointer position (ptr_x, ptr_y) and of its X screen
+   * (ptr_screen). It is updated after every move injected by kpmouse, so
+   * that kpm_st_move() needs no query to the X server.
+   */
+  int ptr_x, ptr_y, ptr_screen;
+
+  /**
+   * Non-zero if the shadow pointer may be out of date, since something other
+   * than kpmouse moved the pointer. The next operation that needs the pointer
+   * position will query the X server and clear this flag.
+   */
+  char ptr_stale;
+
+  /**
+   * Non-zero if a move to (pend_x, pend_y) of pend_screen is waiting for
+   * kpm_st_commit(). Moves are not injected as they are computed: all moves
+   * of a batch of events are injected as their net result, a single move.
+   */
+  char pend;
+  int pend_x, pend_y, pend_screen;
+
+  /**
+   * Major opcode of the XInputExtension, used to recognize the XI_RawMotion
+   * events that make the shadow pointer stale. If XInput2 is unavailable,
+   * this is -1 and the shadow pointer is always considered stale.
+   */
+  int xi_opcode;
+
+  /**
+   * Device ids of the XTest slave pointers. Other XTest clients (xdotool...)
+   * move the pointer through the same devices, so raw motion from them only
+   * leaves the shadow pointer fresh if it lands on one of injected.
+   */
+  int xtest_dev[KPM_MAX_XTEST_DEVS];
+  int n_xtest_devs;
+
+  /**
+   * Positions of the last moves injected by kpm_st_commit() whose raw motion
+   * did not come back yet, oldest first.
+   */
+  int injected[KPM_MAX_INJECTED][2];
+  int n_injected;
+
+  /**
+   * XInput2 master pointer moved by the backend, or 0 if unknown. If set,
+   * raw motion of other master pointers does not make the shadow pointer
+   * stale (see mpx.h).
+   */
+  int master;
+
+  /**
+   * Duration in milliseconds of the animated motion towards the target of a
+   * move. If zero, moves are not animated. @see KPM_ANIM_MS
+   */
+  unsigned int anim_ms;
+
+  /** Milliseconds between animation frames. @see KPM_ANIM_FPS */
+  unsigned int frame_ms;
+
+  /** Easing curve of animated motion. @see KPM_ANIM_EASING */
+  kpm_easing_t easing;
+
+  /**
+   * Non-zero while the pointer is moving from (anim_x0, anim_y0) towards the
+   * shadow pointer (ptr_x, ptr_y), which always holds the target.
+   */
+  char animating;
+
+  /** Position at which the current animation started */
+  int anim_x0, anim_y0;
+
+  /** Last position injected by the animation */
+  int anim_x, anim_y;
+
+  /** Time (milliseconds) at which the current animation started */
+  long int anim_start_ms;
+
+  /** Milliseconds between glide motions. @see KPM_GLIDE_TICK_MS */
+  unsigned int glide_tick_ms;
+
+  /** Glide speed curve parameters. @see KPM_GLIDE_SPEED */
+  float glide_speed, glide_accel, glide_accel_exp, glide_max_speed;
+
+  /** Non-zero while a held movement key makes the pointer glide */
+  char gliding;
+
+  /** Direction of the glide */
+  kpm_move_t glide_move;
+
+  /** Time (milliseconds) of the glide start and of its last tick */
+  long int glide_start_ms, glide_last_ms;
+
+  /** Sub-pixel displacement accumulated, but not yet injected */
+  float glide_fx, glide_fy;
+
+  /** Cached monitor geometry, the movement starts on one of them */
+  kpm_mn_t mn;
+
+  /** Click history that predicts log step targets, or NULL. Not owned */
+  kpm_hs_t* hs;
+
+  /** Backend used to inject pointer events, not owned by the state */
+  kpm_be_t* be;
+
+  /** X display of be */
+  Display* dpy;
+
+  /** Saved by kpm_st_save(), restored by kpm_st_restore() */
+  kpm_st_saved_t saved;
 } kpm_st_t;
 
 
@@ -141,27 +333,50 @@ typedef struct kpm_st_s {
 
 /**
  * Initializaes a kpm_st_t object. Calling kpm_st_reset() is not necessary.
+ * Pointer events will be injected through be, whose ownership is not
+ * transfered.
  *
  * @return 0 if successful, or an error code
  */
-int kpm_st_init(kpm_st_t* state);
+int kpm_st_init(kpm_st_t* state, kpm_be_t* be);
 
 /** Releases all resouces held by state */
 void kpm_st_destroy(kpm_st_t* state);
 
 /**
- * Reset the state back to the whole active mouse screen
+ * Reset the state back to the whole monitor under the pointer
  *
  * @return 0 if successful, else an KMP_ERR_ code.
  */
 int kpm_st_reset(kpm_st_t* state);
 
 /**
- * Do a move operation on state at the given direction (move).
+ * Do a move operation on state at the given direction (move). now_ms is the
+ * time of the move, in the clock of the caller (usually kpm_lp_now()), which
+ * is also used by kpm_st_unmove(), animations and glides.
  *
  * @return 0 if successful, else an KMP_ERR_ code.
  */
-int kpm_st_move(kpm_st_t* state, kpm_move_t move);
+int kpm_st_move(kpm_st_t* state, kpm_move_t move, long int now_ms);
+
+/**
+ * Moves the pointer to the center of the nearest monitor in the direction
+ * of move from the monitor under the pointer, where the next kpm_st_move()
+ * will start from scratch. Has no effect if there is no such monitor.
+ *
+ * @return 0 if successful, else an KMP_ERR_ code.
+ */
+int kpm_st_jump(kpm_st_t* state, kpm_move_t move, long int now_ms);
+
+/**
+ * Moves the pointer onto the nearest edge (see kpm_sn_snap()) in the move
+ * direction, within the movement window (the monitor, if no move was done).
+ * Without edges (or without sn), this is the same as kpm_st_move().
+ *
+ * @return 0 if successful, else an KMP_ERR_ code.
+ */
+int kpm_st_snap(kpm_st_t* state, kpm_sn_t* sn, kpm_move_t move,
+                long int now_ms);
 
 /**
  * Restores the state to what it was before the last logarithmic operation (or
@@ -170,7 +385,104 @@ int kpm_st_move(kpm_st_t* state, kpm_move_t move);
  *
  * @return 0 if successful, else an KMP_ERR_ code.
  */
-int kpm_st_unmove(kpm_st_t* state);
+int kpm_st_unmove(kpm_st_t* state, long int now_ms);
+
+/**
+ * Saves the movement state and the shadow pointer, first refreshed from the
+ * server if it is stale, into state->saved.
+ */
+void kpm_st_save(kpm_st_t* state);
+
+/**
+ * Takes back everything done since the last kpm_st_save(): the movement
+ * state is restored and the pointer moved back.
+ *
+ * @return 0 if successful, else an KMP_ERR_ code.
+ */
+int kpm_st_restore(kpm_st_t* state, long int now_ms);
+
+/**
+ * Moves the movement window by its own size in the direction of move (a
+ * cross move pages vertically or horizontally, a corner move diagonally),
+ * without leaving the monitor. The log step count is kept, so the next move
+ * splits the new window. In linear mode the pointer moves by the size of the
+ * last log window. Without a movement (or once it expired), the window is the
+ * whole monitor, so this is kpm_st_jump().
+ *
+ * @return 0 if successful, else an KMP_ERR_ code.
+ */
+int kpm_st_page(kpm_st_t* state, kpm_move_t move, long int now_ms);
+
+/**
+ * Moves the pointer to (x, y) of screen at once, without animation, and
+ * terminates the movement: the next kpm_st_move() starts from scratch.
+ *
+ * @return 0 if successful, else an KMP_ERR_ code.
+ */
+int kpm_st_goto(kpm_st_t* state, int x, int y, int screen);
+
+/**
+ * Counts a click of button at the pointer position in the click history
+ * (hs), if there is one.
+ */
+void kpm_st_click(kpm_st_t* state, kpm_button_t button);
+
+/**
+ * Expires the current move, if any. The next kpm_st_move() will start from
+ * scratch. Called when move_ttl_ms milliseconds elapse without moves.
+ */
+void kpm_st_expire(kpm_st_t* state);
+
+/**
+ * Injects the next frame of the current animation, for the time now_ms. When
+ * the animation ends, st->animating becomes zero.
+ *
+ * @return 0 if successful, else an KMP_ERR_ code.
+ */
+int kpm_st_anim_step(kpm_st_t* state, long int now_ms);
+
+/**
+ * Ends the current animation (if any) by moving the pointer to its target.
+ *
+ * @return 0 if successful, else an KMP_ERR_ code.
+ */
+int kpm_st_anim_finish(kpm_st_t* state);
+
+/**
+ * Injects the pending pointer move, if any. Must be called before injecting
+ * a button (so it lands on the pointer target) and before flushing the
+ * backend.
+ *
+ * @return 0 if successful, else an KMP_ERR_ code.
+ */
+int kpm_st_commit(kpm_st_t* state);
+
+/**
+ * Starts gliding towards move (a held movement key). Has no effect, and
+ * returns zero, unless movement is already linear.
+ *
+ * @return non-zero if the glide started.
+ */
+int kpm_st_glide_start(kpm_st_t* state, kpm_move_t move, long int now_ms);
+
+/**
+ * Advances the glide to the time now_ms, injecting at most one motion.
+ *
+ * @return 0 if successful, else an KMP_ERR_ code.
+ */
+int kpm_st_glide_step(kpm_st_t* state, long int now_ms);
+
+/** Stops the glide, if any. The move TTL counts from now_ms. */
+void kpm_st_glide_stop(kpm_st_t* state, long int now_ms);
+
+/**
+ * Feed an X event to the state. XInput2 events are used to keep track of
+ * pointer motion not caused by kpmouse (see kpm_st_t.ptr_stale) and RandR
+ * events to refresh the monitor geometry.
+ *
+ * @return non-zero if the event was consumed by the state, 0 otherwise.
+ */
+int kpm_st_handle_event(kpm_st_t* state, XEvent* ev);
 
 
 #endif /*_KPMOUSE_STATE_H_*/
@@ -0,0 +1,146 @@
+#define _DEFAULT_SOURCE // syscall()
+#include "status.h"
+#include "errors.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+/** Seqlock write of the single writer, see kpm_sp_page_t */
+static void write_status(kpm_sp_page_t* page, const kpm_sp_status_t* status) {
+  uint32_t seq = page->seq;
+  __atomic_store_n(&page->seq, seq+1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE); // odd seq before the new status
+  memcpy(&page->status, status, sizeof(kpm_sp_status_t));
+  // seq_cst: the store must not pass the load of waiters (see kpm_sp_wait())
+  __atomic_store_n(&page->seq, seq+2, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&page->waiters, __ATOMIC_SEQ_CST))
+    syscall(SYS_futex, &page->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+const char* kpm_sp_path(char* buf, int size) {
+  const char *env = getenv("KPM_STATUS"), *dir = getenv("XDG_RUNTIME_DIR");
+  if (env)
+    return *env ? env : NULL;
+  if (!dir || !*dir)
+    return NULL;
+  return snprintf(buf, size, "%s/kpmouse.status", dir) < size ? buf : NULL;
+}
+
+int kpm_sp_init(kpm_sp_t* sp, const char* path) {
+  memset(sp, 0, sizeof(kpm_sp_t));
+  if (snprintf(sp->path, sizeof(sp->path), "%s", path)
+      >= (int)sizeof(sp->path)) {
+    fprintf(stderr, "Status page path too long: %s\n", path);
+    return KPM_ERR_STATUS;
+  }
+  int fd = open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0600);
+  if (fd < 0 && errno == ENOENT) {
+    kpm__make_parents(path);
+    fd = open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0600);
+  }
+  if (fd < 0 || ftruncate(fd, sizeof(kpm_sp_page_t))) {
+    perror(path);
+    if (fd >= 0)
+      close(fd);
+    return KPM_ERR_STATUS;
+  }
+  void* addr = mmap(NULL, sizeof(kpm_sp_page_t), PROT_READ|PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  close(fd); // the mapping keeps the file
+  if (addr == MAP_FAILED) {
+    perror(path);
+    return KPM_ERR_STATUS;
+  }
+  sp->page = addr;
+  kpm_sp_page_t* page = sp->page;
+  if (memcmp(page->magic, KPM_SP_MAGIC, sizeof(page->magic))
+      || page->size != sizeof(kpm_sp_page_t) || (page->seq & 1)) {
+    memset(page, 0, sizeof(kpm_sp_page_t));
+    memcpy(page->magic, KPM_SP_MAGIC, sizeof(page->magic));
+    page->size = sizeof(kpm_sp_page_t);
+  } // else: keep seq growing, for readers of a previous kpmouse
+  page->pid = getpid();
+  sp->last.mode = 0xff; // publish the first status
+  return KPM_SUCCESS;
+}
+
+void kpm_sp_destroy(kpm_sp_t* sp) {
+  if (!sp->page)
+    return;
+  kpm_sp_status_t status = sp->last;
+  status.mode = KPM_SP_EXITED;
+  write_status(sp->page, &status);
+  munmap(sp->page, sizeof(kpm_sp_page_t));
+  unlink(sp->path);
+  sp->page = NULL;
+}
+
+void kpm_sp_publish(kpm_sp_t* sp, const kpm_sp_status_t* status) {
+  if (!memcmp(&sp->last, status, sizeof(kpm_sp_status_t)))
+    return; // no wake ups for readers without changes
+  memcpy(&sp->last, status, sizeof(kpm_sp_status_t));
+  write_status(sp->page, status);
+}
+
+kpm_sp_page_t* kpm_sp_open(const char* path) {
+  int fd = open(path, O_RDWR|O_CLOEXEC); // writable, to register as waiter
+  if (fd < 0)
+    return NULL;
+  void* addr = mmap(NULL, sizeof(kpm_sp_page_t), PROT_READ|PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return NULL;
+  kpm_sp_page_t* page = addr;
+  if (memcmp(page->magic, KPM_SP_MAGIC, sizeof(page->magic))
+      || page->size != sizeof(kpm_sp_page_t)) {
+    munmap(addr, sizeof(kpm_sp_page_t));
+    return NULL;
+  }
+  return page;
+}
+
+void kpm_sp_close(kpm_sp_page_t* page) {
+  munmap(page, sizeof(kpm_sp_page_t));
+}
+
+uint32_t kpm_sp_read(const kpm_sp_page_t* page, kpm_sp_status_t* status) {
+  for (;;) {
+    uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue; // being written, takes nanoseconds
+    memcpy(status, &page->status, sizeof(kpm_sp_status_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE); // the copy before the re-check
+    if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+      return seq;
+  }
+}
+
+int kpm_sp_wait(kpm_sp_page_t* page, uint32_t seq, int timeout_ms) {
+  struct timespec timeout = {timeout_ms/1000, (timeout_ms%1000)*1000000L};
+  __atomic_fetch_add(&page->waiters, 1, __ATOMIC_SEQ_CST);
+  // the kernel sleeps only if seq still holds, so no wake up is lost
+  if (__atomic_load_n(&page->seq, __ATOMIC_SEQ_CST) == seq) {
+    syscall(SYS_futex, &page->seq, FUTEX_WAIT, seq,
+            timeout_ms < 0 ? NULL : &timeout, NULL, 0);
+  }
+  __atomic_fetch_sub(&page->waiters, 1, __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE) != seq;
+}
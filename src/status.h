@@ -0,0 +1,128 @@
+#ifndef _KPMOUSE_STATUS_H_
+#define _KPMOUSE_STATUS_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include <stdint.h>
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+#define KPM_SP_MAGIC "kpmstt1"
+
+/* vvvvvvvvvvvvvvvvvvvvvvvvv Movement modes vvvvvvvvvvvvvvvvvvvvvvvvv */
+#define KPM_SP_IDLE   0 ///< no movement, the next step starts from scratch
+#define KPM_SP_LOG    1 ///< logarithmic steps
+#define KPM_SP_LINEAR 2 ///< linear steps (or gliding)
+#define KPM_SP_EXITED 3 ///< kpmouse exited, the page will not change anymore
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/** What kpmouse is doing, as shown by status bars */
+typedef struct kpm_sp_status_s {
+  /** KPM_SP_ movement mode */
+  uint8_t mode;
+  uint8_t log_steps, max_log_steps;
+  /** Cells per side of a log step (see kpm_st_t.grid) */
+  uint8_t grid;
+  /** kpm_button_t held by a mouse button key, or KPM_NULL_BUTTON */
+  uint8_t button;
+  /** Non-zero if button was held long enough to stay down */
+  uint8_t long_press;
+  uint8_t gliding;
+  /** Non-zero while recording a macro */
+  uint8_t recording;
+  /** Pointer position, as last injected by kpmouse */
+  int32_t ptr_x, ptr_y, ptr_screen;
+  /** Movement window: top-left corner and size. Valid unless KPM_SP_IDLE */
+  int32_t win_x, win_y, win_w, win_h;
+  /**
+   * CLOCK_MONOTONIC milliseconds at which the movement expires (see
+   * KPM_MOVE_TTL_MS), or 0 if it does not expire.
+   */
+  int64_t expire_ms;
+} kpm_sp_status_t;
+
+/**
+ * Layout of the status page. kpmouse is its only writer and protects status
+ * with a seqlock: seq is odd while status is being written, and grows by 2
+ * with every change. Readers copy status and retry if seq was odd or changed
+ * meanwhile (see kpm_sp_read()), so they never block kpmouse.
+ *
+ * seq is also a futex word: readers that want to wait for a change register
+ * in waiters and sleep on seq (see kpm_sp_wait()). kpmouse only makes the
+ * wake up system call when there are waiters.
+ */
+typedef struct kpm_sp_page_s {
+  char magic[8];
+  uint32_t size;
+  uint32_t pid;
+  uint32_t seq;
+  uint32_t waiters;
+  kpm_sp_status_t status;
+} kpm_sp_page_t;
+
+/** Writer of the status page */
+typedef struct kpm_sp_s {
+  kpm_sp_page_t* page;
+  /** Last status written, changes are published only if status differs */
+  kpm_sp_status_t last;
+  char path[1024];
+} kpm_sp_t;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/**
+ * Path of the status page: the KPM_STATUS environment variable, or
+ * $XDG_RUNTIME_DIR/kpmouse.status. The returned pointer is either buf or
+ * getenv() memory.
+ *
+ * @return the path, or NULL if there is no status page (KPM_STATUS is empty
+ *         or there is no XDG_RUNTIME_DIR)
+ */
+const char* kpm_sp_path(char* buf, int size);
+
+/**
+ * Creates (or takes over) the status page at path and maps it.
+ * @return 0 if successful, or KPM_ERR_STATUS
+ */
+int kpm_sp_init(kpm_sp_t* sp, const char* path);
+
+/** Publishes KPM_SP_EXITED, waking the readers, and removes the page */
+void kpm_sp_destroy(kpm_sp_t* sp);
+
+/**
+ * Publishes status, if it differs from the last one, and wakes up waiting
+ * readers.
+ */
+void kpm_sp_publish(kpm_sp_t* sp, const kpm_sp_status_t* status);
+
+/**
+ * Maps the status page at path for reading.
+ * @return the page, or NULL if it does not exist or is not a status page
+ */
+kpm_sp_page_t* kpm_sp_open(const char* path);
+
+/** Unmaps a page returned by kpm_sp_open() */
+void kpm_sp_close(kpm_sp_page_t* page);
+
+/**
+ * Copies a consistent snapshot of the status. Lock-free: retries while
+ * kpmouse is writing.
+ * @return the sequence number of the snapshot, for kpm_sp_wait()
+ */
+uint32_t kpm_sp_read(const kpm_sp_page_t* page, kpm_sp_status_t* status);
+
+/**
+ * Blocks until the sequence number moves past seq or timeout_ms elapses
+ * (timeout_ms < 0 waits forever).
+ * @return non-zero if the status changed
+ */
+int kpm_sp_wait(kpm_sp_page_t* page, uint32_t seq, int timeout_ms);
+
+#endif /*_KPMOUSE_STATUS_H_*/
@@ -0,0 +1,109 @@
+#include "trace.h"
+#include "errors.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+kpm_tr_t kpm_tr_g;
+
+static char g_path[1024];
+
+////////////////////////////////////
+// private functions
+////////////////////////////////////
+
+/** write() all of buf, retrying on short writes */
+static int write_all(int fd, const void* buf, size_t len) {
+  const char* p = buf;
+  while (len) {
+    ssize_t n = write(fd, p, len);
+    if (n <= 0)
+      return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static void on_crash(int sig) {
+  static const char msg[] = "kpmouse crashed, trace dumped to ";
+  if (!kpm_tr_dump() && !write_all(2, msg, sizeof(msg)-1)) {
+    write_all(2, g_path, strlen(g_path));
+    write_all(2, "\n", 1);
+  }
+  raise(sig); // SA_RESETHAND restored the default action
+}
+
+////////////////////////////////////
+// public functions
+////////////////////////////////////
+
+void kpm_tr_init(void) {
+  static const int sigs[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+  struct sigaction sa;
+  const char *env = getenv("KPM_TRACE"), *dir = getenv("XDG_RUNTIME_DIR");
+  if (env && *env)
+    snprintf(g_path, sizeof(g_path), "%s", env);
+  else if (dir && *dir) // private to the user, unlike /tmp
+    snprintf(g_path, sizeof(g_path), "%s/kpmouse-%d.trace", dir,
+             (int)getpid());
+  else
+    snprintf(g_path, sizeof(g_path), "/tmp/kpmouse-%d.trace", (int)getpid());
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = &on_crash;
+  sa.sa_flags = SA_RESETHAND;
+  sigemptyset(&sa.sa_mask);
+  for (size_t i = 0; i < sizeof(sigs)/sizeof(sigs[0]); ++i)
+    sigaction(sigs[i], &sa, NULL);
+}
+
+int kpm_tr_dump(void) {
+  uint64_t head = __atomic_load_n(&kpm_tr_g.head, __ATOMIC_ACQUIRE);
+  uint64_t first = head > KPM_TR_SIZE ? head - KPM_TR_SIZE : 0;
+  size_t begin = first & (KPM_TR_SIZE-1), n = head - first;
+  kpm_tr_file_t hdr;
+  if (!*g_path)
+    return KPM_ERR_TRACE;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, KPM_TR_MAGIC, sizeof(hdr.magic));
+  hdr.rec_size = sizeof(kpm_tr_rec_t);
+  hdr.n = n;
+  hdr.head = head;
+  // Never write through a file planted by someone else (e.g., a symlink in
+  // /tmp): replace only our own previous dump (the sticky bit of /tmp keeps
+  // us from removing other users' files) and create the file anew
+  if (unlink(g_path) && errno != ENOENT)
+    return KPM_ERR_TRACE;
+  int fd = open(g_path, O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_CLOEXEC, 0600);
+  if (fd < 0)
+    return KPM_ERR_TRACE;
+  // the ring wraps at most once: [begin, end of ring) then [0, rest)
+  size_t tail = n < KPM_TR_SIZE - begin ? n : KPM_TR_SIZE - begin;
+  int err = write_all(fd, &hdr, sizeof(hdr))
+         || write_all(fd, &kpm_tr_g.rec[begin], tail*sizeof(kpm_tr_rec_t))
+         || write_all(fd, kpm_tr_g.rec, (n-tail)*sizeof(kpm_tr_rec_t));
+  close(fd);
+  return err ? KPM_ERR_TRACE : KPM_SUCCESS;
+}
+
+const char* kpm_tr_path(void) {
+  return g_path;
+}
+
+const char* kpm_tr_type_name(int type) {
+  switch (type) {
+    case KPM_TR_NONE:   return "none";
+    case KPM_TR_KEY:    return "key";
+    case KPM_TR_MOVE:   return "move";
+    case KPM_TR_WARP:   return "warp";
+    case KPM_TR_BUTTON: return "button";
+    case KPM_TR_ERROR:  return "error";
+    case KPM_TR_INIT:   return "init";
+    case KPM_TR_CHORD:  return "chord";
+    default:            return "?";
+  }
+}
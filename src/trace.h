@@ -0,0 +1,111 @@
+#ifndef _KPMOUSE_TRACE_H_
+#define _KPMOUSE_TRACE_H_
+
+////////////////////////////////////////////
+// Includes
+////////////////////////////////////////////
+
+#include "config.h"
+#include <stdint.h>
+#include <time.h>
+
+////////////////////////////////////////////
+// Types and Constants
+////////////////////////////////////////////
+
+/** Number of records kept by the ring, must be a power of 2 */
+#define KPM_TR_SIZE 8192
+
+/** First bytes of a dump file */
+#define KPM_TR_MAGIC "kpmtrc1"
+
+/* vvvvvvvvvvvvvvvvvvvvvvvvvv Record types vvvvvvvvvvvvvvvvvvvvvvvvvv */
+#define KPM_TR_NONE    0 ///< slot never written
+#define KPM_TR_KEY     1 ///< code: keycode, x: press, y: modifiers
+#define KPM_TR_MOVE    2 ///< code: kpm_move_t, x,y: target, arg: reverse
+#define KPM_TR_WARP    3 ///< code: screen, x,y: pointer sent to the backend
+#define KPM_TR_BUTTON  4 ///< code: X button, x: down
+#define KPM_TR_ERROR   5 ///< arg: error code, x: source line
+#define KPM_TR_INIT    6 ///< x,y: screen size, arg: max_log_steps
+#define KPM_TR_CHORD   7 ///< code: KPM_CH_ result, x,y: KeyCodes
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/**
+ * A trace record. The meaning of code, x, y and arg depends on type.
+ */
+typedef struct kpm_tr_rec_s {
+  /** CLOCK_MONOTONIC, in nanoseconds */
+  int64_t ns;
+  int32_t x, y;
+  /** Low 32 bits of the sequence number, tells dumped records apart */
+  uint32_t seq;
+  uint8_t type;
+  uint8_t code;
+  uint16_t arg;
+} kpm_tr_rec_t;
+
+/**
+ * Fixed-size ring of the last KPM_TR_SIZE records. Writers claim a slot with
+ * an atomic increment of head and never block, old records are overwritten.
+ */
+typedef struct kpm_tr_s {
+  uint64_t head;
+  kpm_tr_rec_t rec[KPM_TR_SIZE];
+} kpm_tr_t;
+
+/** Header of a dump file, followed by the records, oldest first */
+typedef struct kpm_tr_file_s {
+  char magic[8];
+  uint32_t rec_size;
+  uint32_t n;
+  /** Sequence number of the next record, when dumped */
+  uint64_t head;
+} kpm_tr_file_t;
+
+/** The process-wide ring */
+extern kpm_tr_t kpm_tr_g;
+
+////////////////////////////////////////////
+// Functions
+////////////////////////////////////////////
+
+/** Appends a record to the ring. Safe from any thread. */
+static inline void kpm_tr(int type, int code, int x, int y, int arg) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now); // vDSO, no syscall
+  uint64_t seq = __atomic_fetch_add(&kpm_tr_g.head, 1, __ATOMIC_RELAXED);
+  kpm_tr_rec_t* r = &kpm_tr_g.rec[seq & (KPM_TR_SIZE-1)];
+  r->ns = now.tv_sec*1000000000LL + now.tv_nsec;
+  r->x = x;
+  r->y = y;
+  r->seq = (uint32_t)seq;
+  r->type = type;
+  r->code = code;
+  r->arg = arg;
+}
+
+/**
+ * Sets the file written by kpm_tr_dump(): the KPM_TRACE environment variable
+ * or $XDG_RUNTIME_DIR/kpmouse-<pid>.trace (/tmp/kpmouse-<pid>.trace without
+ * XDG_RUNTIME_DIR), and installs handlers that dump the ring on SIGSEGV,
+ * SIGBUS, SIGFPE, SIGILL and SIGABRT before dying.
+ */
+void kpm_tr_init(void);
+
+/**
+ * Writes the ring to the file set by kpm_tr_init(), replacing a previous
+ * dump. The file is always created anew, never opened through a symlink or
+ * an existing file of another user. Only uses async signal safe calls, so it
+ * can run from a signal handler.
+ *
+ * @return 0 if successful, or KPM_ERR_TRACE
+ */
+int kpm_tr_dump(void);
+
+/** Path of the dump file, as set by kpm_tr_init() */
+const char* kpm_tr_path(void);
+
+/** Name of a KPM_TR_ record type */
+const char* kpm_tr_type_name(int type);
+
+#endif /*_KPMOUSE_TRACE_H_*/
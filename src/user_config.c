@@ -1,5 +1,15 @@
 #include "user_config.h"
+#include "state.h"
 #include <X11/Xutil.h>
+#include <linux/input-event-codes.h>
+
+// evdev codes are plain numbers to keep linux headers out of user_config.h
+extern int ASSERT_KPM_UNDO_EVDEV[KPM_UNDO_EVDEV == KEY_KP0 ? 1 : -1];
+extern int ASSERT_KPM_CENTER_EVDEV[KPM_CENTER_EVDEV == KEY_KP5 ? 1 : -1];
+extern int ASSERT_KPM_GRID_BUTTON_EVDEV[KPM_GRID_BUTTON_EVDEV == KEY_KPPLUS
+                                        ? 1 : -1];
+extern int ASSERT_KPM_GRID3_LOG_STEPS[KPM_GRID3_LOG_STEPS <= KPM_LOG_STEPS
+                                      ? 1 : -1];
 
 KeySym kpm_move_sym[8] = {
   XK_KP_Home,      //KPM_TL
@@ -21,3 +31,30 @@ KeySym kpm_button_sym[6] = {
   0               // right
 };
 
+
+unsigned short kpm_move_evdev[8] = {
+  KEY_KP7, //KPM_TL
+  KEY_KP8, //KPM_CU
+  KEY_KP9, //KPM_TR
+  KEY_KP2, //KPM_CD
+  KEY_KP1, //KPM_BL
+  KEY_KP4, //KPM_CL
+  KEY_KP3, //KPM_BR
+  KEY_KP6  //KPM_CR
+};
+
+unsigned short kpm_button_evdev[6] = {
+  KEY_KPSLASH,    // left
+  KEY_KPASTERISK, // middle
+  KEY_KPMINUS,    // right
+  KEY_KP5,        // left
+  0,              // middle
+  0               // right
+};
+
+unsigned char kpm_page_chords[KPM_PAGE_CHORDS][3] = {
+  {KPM_TL, KPM_TR, KPM_CU}, // 7+9: page up
+  {KPM_BL, KPM_BR, KPM_CD}, // 1+3: page down
+  {KPM_TL, KPM_BL, KPM_CL}, // 7+1: page left
+  {KPM_TR, KPM_BR, KPM_CR}  // 9+3: page right
+};
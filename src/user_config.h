@@ -11,6 +11,14 @@
 // Types and Constants
 ////////////////////////////////////////////
 
+/**
+ * Backend used to inject pointer events: "xtest" (XTest requests written
+ * directly over XCB) or "xdo" (libxdo). Prefixing with "async-" injects from
+ * a separate thread (see kpm_be_async_new()). Can be overridden at runtime
+ * with the KPM_BACKEND environment variable.
+ */
+#define KPM_DEFAULT_BACKEND "xtest"
+
 /**
  * How many steps should be done in logarithmic mode (splitting the movement
  * window into four rectangles) before movement becomes linear (advancing a
@@ -18,6 +26,21 @@
  */
 #define KPM_LOG_STEPS 4
 
+/**
+ * Cells per side into which each logarithmic step splits the movement
+ * window: 2 (four rectangles, 8 targets around the cross) or 3 (a 3x3 grid
+ * of 9 cells, the 5 key selecting the center one). A 3x3 grid shrinks the
+ * window to a third per step, so it needs fewer steps to reach a target.
+ * The KPM_GRID environment variable overrides this.
+ */
+#define KPM_GRID 2
+
+/**
+ * KPM_LOG_STEPS for a 3x3 grid. Three steps of a third end on a finer window
+ * (1/27) than four halvings (1/16). Must not exceed KPM_LOG_STEPS.
+ */
+#define KPM_GRID3_LOG_STEPS 3
+
 /**
  * Once after KPM_LOG_STEPS logarithmic movements, movement becomes linear. The
  * horizontal and vertical steps (in pixels) is determined by divding the width
@@ -41,6 +64,169 @@
  */
 #define KPM_LONG_PRESS_MS 300
 
+/**
+ * If non-zero, the pointer glides to the target of each move during
+ * KPM_ANIM_MS milliseconds, instead of jumping to it. Useful for applications
+ * that react to intermediate motion (hover menus, drawing canvases).
+ */
+#define KPM_ANIM_MS 0
+
+/**
+ * Frames per second of the animated motion (see KPM_ANIM_MS). Each frame
+ * injects a single motion event through the selected backend. If 0, the
+ * highest refresh rate of the active monitors (from RandR) is used, or 60
+ * when RandR does not report one.
+ */
+#define KPM_ANIM_FPS 0
+
+/**
+ * Easing curve of the animated motion. One of: KPM_EASE_LINEAR,
+ * KPM_EASE_OUT_QUAD, KPM_EASE_OUT_CUBIC and KPM_EASE_IN_OUT_CUBIC.
+ */
+#define KPM_ANIM_EASING KPM_EASE_OUT_CUBIC
+
+/**
+ * If non-zero, the current movement window, the cross that splits it and the
+ * targets of the next move are shown on a click-through overlay. Can be
+ * overridden at runtime with the KPM_OVERLAY environment variable (0 or 1).
+ */
+#define KPM_OVERLAY 0
+
+/**
+ * Overlay color, as 0xAARRGGBB. The alpha channel is only used if a
+ * compositing manager is running.
+ */
+#define KPM_OVERLAY_COLOR 0xb0ff5000
+
+/** Thickness of the overlay lines and size of the target markers (pixels) */
+#define KPM_OVERLAY_LINE 2
+#define KPM_OVERLAY_MARK 8
+
+/**
+ * Holding a movement key in linear mode (after KPM_LOG_STEPS) makes the
+ * pointer glide continuously instead of stepping on each keyboard autorepeat.
+ * Every KPM_GLIDE_TICK_MS milliseconds a single motion is injected, regardless
+ * of how fast the autorepeat is.
+ */
+#define KPM_GLIDE_TICK_MS 8
+
+/**
+ * Glide speed, in linear steps (see KPM_LINEAR_STEPS) per second, after the
+ * key has been held for t seconds:
+ *
+ *     min(KPM_GLIDE_SPEED + KPM_GLIDE_ACCEL * t^KPM_GLIDE_ACCEL_EXP,
+ *         KPM_GLIDE_MAX_SPEED)
+ */
+#define KPM_GLIDE_SPEED      6
+#define KPM_GLIDE_ACCEL      12
+#define KPM_GLIDE_ACCEL_EXP  2
+#define KPM_GLIDE_MAX_SPEED  60
+
+/**
+ * Movement starts on the monitor under the pointer. Pressing a movement key
+ * while holding (all of) this modifier mask jumps to the center of the next
+ * monitor in that direction instead. 0 disables monitor jumps. The default
+ * is the Super (Windows) key, so that Ctrl, Alt and Shift clicks keep
+ * working.
+ */
+#define KPM_MONITOR_MOD Mod4Mask
+
+/**
+ * If non-zero, kpmouse listens on a Unix domain socket (see control.h and
+ * tools/kpm_ctl.c) through which other programs can move the pointer and
+ * click. The socket is $XDG_RUNTIME_DIR/kpmouse.sock, or the KPM_SOCKET
+ * environment variable, which disables it if empty.
+ */
+#define KPM_CONTROL 1
+
+/**
+ * If non-zero, kpmouse publishes its status (movement mode, log steps,
+ * pressed button, time left before the movement expires...) in a shared
+ * memory page that status bars can read without system calls (see status.h
+ * and tools/kpm_status.c). The page is $XDG_RUNTIME_DIR/kpmouse.status, or
+ * the KPM_STATUS environment variable, which disables it if empty.
+ */
+#define KPM_STATUS 1
+
+/**
+ * If non-zero, clicks are counted, per X screen and button, in a click
+ * history file (see history.h, the KPM_HISTORY environment variable names
+ * another file, or disables it if empty). A log step then places the pointer
+ * on the densest cluster of at least KPM_HISTORY_MIN_CLICKS past clicks
+ * inside the new movement window, rather than on its center.
+ */
+#define KPM_HISTORY 1
+#define KPM_HISTORY_MIN_CLICKS 3
+
+/**
+ * Once a screen and button have this many clicks in the history, all their
+ * counts are halved, so that the file has a fixed size and old habits fade.
+ * Must not exceed 65535.
+ */
+#define KPM_HISTORY_MAX_CLICKS 50000
+
+/**
+ * Pressing a movement key while holding this modifier mask snaps the pointer
+ * to the nearest edge (e.g., of a button or text field) in that direction
+ * within the movement window, instead of stepping. If there is no edge, it
+ * is a regular step. 0 disables snapping. The default is Super+Shift, which
+ * takes precedence over KPM_MONITOR_MOD (Super) as it includes it.
+ */
+#define KPM_SNAP_MOD (Mod4Mask|ShiftMask)
+
+/**
+ * Snapping looks for edges crossing a strip of 2*KPM_SNAP_BAND+1 pixels
+ * centered on the pointer. An edge must have an average contrast (sum of R,
+ * G and B differences, 0-765) of KPM_SNAP_CONTRAST over the strip and be at
+ * least KPM_SNAP_MIN_DIST pixels away, so that repeated snaps move on to
+ * the next edge.
+ */
+#define KPM_SNAP_BAND      8
+#define KPM_SNAP_CONTRAST  60
+#define KPM_SNAP_MIN_DIST  3
+
+/**
+ * Pressing the second key of a chord while the first is held, less than
+ * KPM_CHORD_MS milliseconds after the first press, does the chord instead of
+ * both keys. The first key is not delayed: it acts at once and is undone if
+ * the chord completes. 0 disables chords, which is the default since fast
+ * typists routinely roll from one key into the next within that time. Can be
+ * overridden at runtime with the KPM_CHORD_MS environment variable.
+ */
+#define KPM_CHORD_MS 0
+
+/**
+ * If non-zero, pressing a mouse button key as a chord after a movement key
+ * drags: the button goes down where the pointer was, and the move is done
+ * with the button held until the button key is released.
+ */
+#define KPM_CHORD_DRAG 1
+
+/** Number of entries in kpm_page_chords */
+#define KPM_PAGE_CHORDS 4
+
+/**
+ * Chords of two movement keys that move the pointer by a full movement
+ * window: {first kpm_move_t, second kpm_move_t, direction kpm_move_t}. The
+ * keys can be pressed in any order. Without a movement, the window is the
+ * whole monitor and the pointer jumps to the next monitor.
+ */
+extern unsigned char kpm_page_chords[KPM_PAGE_CHORDS][3];
+
+/**
+ * If non-zero, chords of the undo key record and play macros: undo+middle
+ * button starts (or cancels) recording the pointer moves and buttons,
+ * undo+movement key stores the recording under that key, or plays the macro
+ * stored there when not recording.
+ */
+#define KPM_MACROS 1
+
+/**
+ * Milliseconds between the steps of a played macro. With 0, the whole macro
+ * is injected in a single batch.
+ */
+#define KPM_MACRO_PACE_MS 0
+
 /**
  * Array with a KeySym (see X11/keysymdef.h) for each kpm_move_t constant
  */
@@ -57,11 +243,46 @@ extern KeySym kpm_move_sym[8];
  */
 extern KeySym kpm_button_sym[6];
 
+/**
+ * Same as kpm_move_sym, but with evdev key codes (see
+ * linux/input-event-codes.h), used when reading an evdev device without X.
+ */
+extern unsigned short kpm_move_evdev[8];
+
+/** Same as kpm_button_sym, but with evdev key codes. 0 means unbound. */
+extern unsigned short kpm_button_evdev[6];
+
 /**
  * This key causes the last ste to be undone (if in linear movement, this
  * returns to the position after the last log step).
  */
 #define KPM_UNDO_SYM XK_KP_Insert
 
+/** evdev key code of KPM_UNDO_SYM. Must match KEY_KP0 */
+#define KPM_UNDO_EVDEV 82
+
+/**
+ * With a 3x3 grid (KPM_GRID), this key selects the center cell. A mouse
+ * button bound to it in kpm_button_sym moves to KPM_GRID_BUTTON_SYM.
+ */
+#define KPM_CENTER_SYM      XK_KP_Begin
+#define KPM_GRID_BUTTON_SYM XK_KP_Add
+
+/** evdev key codes of KPM_CENTER_SYM and KPM_GRID_BUTTON_SYM */
+#define KPM_CENTER_EVDEV      76 // KEY_KP5
+#define KPM_GRID_BUTTON_EVDEV 78 // KEY_KPPLUS
+
+/** Width and height of the pointer area of the uinput backend */
+#define KPM_UINPUT_WIDTH  1920
+#define KPM_UINPUT_HEIGHT 1080
+
+/**
+ * If non-zero, the uinput backend emits absolute pointer events (ABS_X and
+ * ABS_Y, like a tablet). Else it emits relative motion (REL_X and REL_Y, like
+ * a mouse), which is not subject to calibration but can drift if the consumer
+ * applies pointer acceleration.
+ */
+#define KPM_UINPUT_ABSOLUTE 1
+
 #endif /*_KPMOUSE_USERCONFIG_H_*/
 
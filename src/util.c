@@ -1,6 +1,9 @@
 #include "util.h"
 #include "errors.h"
 #include "limits.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 
 long int kpm__ms_elapsed(const struct timespec* ts) {
   struct timespec copy = *ts;
@@ -19,3 +22,43 @@ long int kpm__ms_elapsed_upd(struct timespec* ts) {
   *ts = now;
   return age;
 }
+
+long int kpm__us_elapsed(const struct timespec* ts) {
+  struct timespec now;
+  if (KPM_CHK(clock_gettime, CLOCK_MONOTONIC, &now))
+    return INT_MAX;
+  return (now.tv_sec - ts->tv_sec)*1000000L
+       + (now.tv_nsec - ts->tv_nsec)/1000L;
+}
+
+long int kpm__now_ms(void) {
+  struct timespec now;
+  if (KPM_CHK(clock_gettime, CLOCK_MONOTONIC, &now))
+    return 0;
+  return now.tv_sec*1000L + now.tv_nsec/1000000L;
+}
+
+long long kpm__now_ns(void) {
+  struct timespec now;
+  if (KPM_CHK(clock_gettime, CLOCK_MONOTONIC, &now))
+    return 0;
+  return now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+long long kpm__x_time_ns(unsigned long server_ms) {
+  long int now_ms = kpm__now_ms();
+  unsigned int age_ms = (unsigned int)now_ms - (unsigned int)server_ms;
+  if (age_ms > 10000)
+    return 0; // not from our clock (e.g., a remote server)
+  return (now_ms - age_ms)*1000000LL;
+}
+
+void kpm__make_parents(const char* path) {
+  char dir[1024];
+  snprintf(dir, sizeof(dir), "%s", path);
+  for (char* p = strchr(dir+1, '/'); p; p = strchr(p+1, '/')) {
+    *p = '\0';
+    mkdir(dir, 0700); // EEXIST is fine, other errors show up on open()
+    *p = '/';
+  }
+}
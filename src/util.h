@@ -24,5 +24,32 @@ long int kpm__ms_elapsed(const struct timespec* ts);
 /** Similar to kpm__ms_elapsed(), but will update ts. */
 long int kpm__ms_elapsed_upd(struct timespec* ts);
 
+/**
+ * How many microseconds elapsed since the given ts was taken from
+ * CLOCK_MONOTONIC.
+ *
+ * @return non-negative number of elapsed microseconds.
+ */
+long int kpm__us_elapsed(const struct timespec* ts);
+
+/** Current CLOCK_MONOTONIC time in milliseconds. */
+long int kpm__now_ms(void);
+
+/** Current CLOCK_MONOTONIC time in nanoseconds. */
+long long kpm__now_ns(void);
+
+/**
+ * Converts a X server timestamp into CLOCK_MONOTONIC nanoseconds. The X.org
+ * server takes its timestamps from CLOCK_MONOTONIC milliseconds, truncated to
+ * 32 bits. Returns 0 if the timestamp does not look like that.
+ */
+long long kpm__x_time_ns(unsigned long server_ms);
+
+/**
+ * Creates the missing parent directories of path (like mkdir -p), with mode
+ * 0700. Failures are left for the caller to notice when opening path.
+ */
+void kpm__make_parents(const char* path);
+
 #endif /*_KPMOUSE_UTIL_H_*/
 
@@ -0,0 +1,539 @@
+/*
+ * Unit tests of the kpmouse modules that need no display: the chord
+ * automaton, the config file parser, the status page seqlock, the latency
+ * recorder, the click history quadtree, the ring of the async backend, the
+ * undo of log steps, the detection of foreign pointer motion and the evdev
+ * reader (over a pipe). Files are created in a fresh directory under $TMPDIR
+ * (or /tmp), removed at the end.
+ *
+ * Usage: kpm_unit
+ * Prints every failed check and exits with 1 if any failed.
+ */
+#include "../src/config.h"
+#include "../src/backend.h"
+#include "../src/chord.h"
+#include "../src/evdev.h"
+#include "../src/history.h"
+#include "../src/keymap.h"
+#include "../src/latency.h"
+#include "../src/state.h"
+#include "../src/status.h"
+#include <X11/extensions/XInput2.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int g_failed;
+static char g_dir[256];
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static void check(int ok, const char* cond, const char* file, int line) {
+  if (!ok) {
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, cond);
+    ++g_failed;
+  }
+}
+
+/** Path of the file name in the test directory */
+static const char* path_of(const char* name) {
+  static char path[512];
+  snprintf(path, sizeof(path), "%s/%s", g_dir, name);
+  return path;
+}
+
+static void write_file(const char* path, const char* text) {
+  FILE* out = fopen(path, "w");
+  if (out) {
+    fputs(text, out);
+    fclose(out);
+  }
+  CHECK(out != NULL);
+}
+
+////////////////////////////////////
+// chord automaton (chord.h)
+////////////////////////////////////
+
+static void test_chord(void) {
+  kpm_ch_t ch;
+  kpm_action_t tl = KPM_ACT_MOVE + KPM_TL, left = KPM_ACT_BUTTON + KPM_L;
+  kpm_ch_init(&ch, 60);
+
+  // drag: a button pressed while a move is held, in the window
+  CHECK(kpm_ch_feed(&ch, 10, tl, 1, 0) == KPM_CH_ARM);
+  CHECK(kpm_ch_feed(&ch, 10, tl, 1, 30) == KPM_CH_PASS); // autorepeat
+  CHECK(kpm_ch_feed(&ch, 11, left, 1, 40) == KPM_CH_DRAG);
+  CHECK(ch.chord_code[0] == 10 && ch.chord_code[1] == 11);
+  CHECK(ch.chord_action[0] == tl && ch.chord_action[1] == left);
+  CHECK(kpm_ch_feed(&ch, 11, left, 0, 50) == KPM_CH_PASS); // drags go on
+  CHECK(kpm_ch_feed(&ch, 10, tl, 0, 60) == KPM_CH_PASS);
+
+  // too late: both keys are handled as usual
+  CHECK(kpm_ch_feed(&ch, 10, tl, 1, 1000) == KPM_CH_ARM);
+  CHECK(kpm_ch_feed(&ch, 11, left, 1, 1060) == KPM_CH_PASS);
+  CHECK(kpm_ch_feed(&ch, 11, left, 0, 1070) == KPM_CH_PASS);
+  CHECK(kpm_ch_feed(&ch, 10, tl, 0, 1080) == KPM_CH_PASS);
+
+  // the first key released before the second one: no chord
+  CHECK(kpm_ch_feed(&ch, 10, tl, 1, 2000) == KPM_CH_ARM);
+  CHECK(kpm_ch_feed(&ch, 10, tl, 0, 2010) == KPM_CH_PASS);
+  CHECK(kpm_ch_feed(&ch, 11, left, 1, 2020) == KPM_CH_PASS);
+  CHECK(kpm_ch_feed(&ch, 11, left, 0, 2030) == KPM_CH_PASS);
+
+  // chords other than drags eat their keys until released
+  kpm_action_t tr = KPM_ACT_MOVE + KPM_TR;
+  CHECK(kpm_ch_feed(&ch, 10, tl, 1, 3000) == KPM_CH_ARM);
+  CHECK(kpm_ch_feed(&ch, 12, tr, 1, 3010) == KPM_CH_PAGE + KPM_CU);
+  CHECK(kpm_ch_feed(&ch, 12, tr, 1, 3020) == KPM_CH_EAT);
+  CHECK(kpm_ch_feed(&ch, 12, tr, 0, 3030) == KPM_CH_EAT);
+  CHECK(kpm_ch_feed(&ch, 10, tl, 0, 3040) == KPM_CH_EAT);
+  CHECK(kpm_ch_feed(&ch, 10, tl, 1, 3050) != KPM_CH_EAT);
+  CHECK(kpm_ch_feed(&ch, 10, tl, 0, 3060) == KPM_CH_PASS);
+
+  if (KPM_MACROS) { // so do macro chords
+    kpm_action_t undo = KPM_ACT_UNDO, cr = KPM_ACT_MOVE + KPM_CR;
+    CHECK(kpm_ch_feed(&ch, 12, undo, 1, 4000) == KPM_CH_ARM);
+    CHECK(kpm_ch_feed(&ch, 13, cr, 1, 4010) == KPM_CH_MACRO + KPM_CR);
+    CHECK(kpm_ch_feed(&ch, 13, cr, 1, 4020) == KPM_CH_EAT);
+    CHECK(kpm_ch_feed(&ch, 13, cr, 0, 4030) == KPM_CH_EAT);
+    CHECK(kpm_ch_feed(&ch, 12, undo, 0, 4040) == KPM_CH_EAT);
+    CHECK(kpm_ch_feed(&ch, 12, undo, 1, 4050) != KPM_CH_EAT);
+  }
+
+  // keys without an action never take part in chords
+  kpm_ch_init(&ch, 60);
+  CHECK(kpm_ch_feed(&ch, 10, KPM_ACT_NONE, 1, 0) == KPM_CH_PASS);
+  CHECK(kpm_ch_feed(&ch, 11, left, 1, 10) == KPM_CH_PASS);
+
+  // a zero window disables chords
+  kpm_ch_init(&ch, 0);
+  CHECK(kpm_ch_feed(&ch, 10, tl, 1, 0) == KPM_CH_PASS);
+  CHECK(kpm_ch_feed(&ch, 11, left, 1, 10) == KPM_CH_PASS);
+}
+
+////////////////////////////////////
+// config file parser (keymap.h)
+////////////////////////////////////
+
+static void test_keymap(void) {
+  static kpm_km_t km;
+  const char* path = path_of("keys.conf");
+
+  kpm_km_defaults(&km, 1, 2);
+  CHECK(!kpm_km_load(&km, path)); // no file: the defaults stay
+  CHECK(km.n_binds > 0);
+
+  write_file(path, "# comment\n"
+                   "move-tl keycode:79 keycode:80\n"
+                   "\n"
+                   "button-left   keycode:90\n"
+                   "undo keycode:91 KP_Insert\n");
+  CHECK(!kpm_km_load(&km, path));
+  CHECK(km.n_binds == 5);
+  kpm_km_build(&km, NULL); // KeySyms are ignored without a display
+  CHECK(km.action[79] == KPM_ACT_MOVE + KPM_TL);
+  CHECK(km.action[80] == KPM_ACT_MOVE + KPM_TL);
+  CHECK(km.action[90] == KPM_ACT_BUTTON + KPM_L);
+  CHECK(km.action[91] == KPM_ACT_UNDO);
+  CHECK(km.action[81] == KPM_ACT_NONE);
+  KeyCode codes[256];
+  CHECK(kpm_km_codes(&km, codes) == 4);
+
+  // errors leave the bindings unchanged
+  const char* bad[] = {"jump-tl keycode:79\n", "undo keycode:300\n",
+                       "undo NoSuchKeySym\n"};
+  for (int i = 0; i < (int)(sizeof(bad)/sizeof(*bad)); ++i) {
+    write_file(path, bad[i]);
+    CHECK(kpm_km_load(&km, path) != 0);
+    CHECK(km.n_binds == 5);
+  }
+  unlink(path);
+}
+
+////////////////////////////////////
+// status page seqlock (status.h)
+////////////////////////////////////
+
+typedef struct {
+  kpm_sp_t* sp;
+  int n;
+} writer_t;
+
+/** Publishes n statuses whose fields all hold the same counter */
+static void* run_writer(void* data) {
+  writer_t* w = data;
+  kpm_sp_status_t s;
+  memset(&s, 0, sizeof(s));
+  for (int i = 1; i <= w->n; ++i) {
+    s.ptr_x = s.ptr_y = s.win_x = s.win_y = s.win_w = s.win_h = i;
+    s.expire_ms = i;
+    kpm_sp_publish(w->sp, &s);
+  }
+  return NULL;
+}
+
+static void test_status(void) {
+  kpm_sp_t sp;
+  kpm_sp_status_t s, r;
+  const char* path = path_of("status");
+  CHECK(!kpm_sp_init(&sp, path));
+  kpm_sp_page_t* page = kpm_sp_open(path);
+  CHECK(page != NULL);
+  if (!page)
+    return;
+
+  memset(&s, 0, sizeof(s));
+  s.mode = KPM_SP_LOG;
+  s.ptr_x = 42;
+  kpm_sp_publish(&sp, &s);
+  uint32_t seq = kpm_sp_read(page, &r);
+  CHECK(!(seq & 1));
+  CHECK(!memcmp(&s, &r, sizeof(s)));
+  kpm_sp_publish(&sp, &s); // unchanged: nothing is written
+  CHECK(!kpm_sp_wait(page, seq, 10));
+  s.ptr_x = 43;
+  kpm_sp_publish(&sp, &s);
+  CHECK(kpm_sp_wait(page, seq, 10));
+
+  // readers never see a torn status while a writer runs
+  memset(&s, 0, sizeof(s));
+  kpm_sp_publish(&sp, &s); // consistent from the start
+  writer_t w = {&sp, 200000};
+  pthread_t thread;
+  int torn = 0, reads = 0;
+  CHECK(!pthread_create(&thread, NULL, &run_writer, &w));
+  do {
+    kpm_sp_read(page, &r);
+    torn += r.ptr_x != r.ptr_y || r.ptr_x != r.win_x || r.ptr_x != r.win_y
+            || r.ptr_x != r.win_w || r.ptr_x != r.win_h
+            || r.ptr_x != r.expire_ms;
+    ++reads;
+  } while (r.ptr_x != w.n);
+  pthread_join(thread, NULL);
+  CHECK(!torn);
+  CHECK(reads > 0);
+
+  kpm_sp_destroy(&sp);
+  kpm_sp_read(page, &r);
+  CHECK(r.mode == KPM_SP_EXITED);
+  kpm_sp_close(page);
+  CHECK(access(path, F_OK)); // removed on destroy
+}
+
+////////////////////////////////////
+// latency recorder (latency.h)
+////////////////////////////////////
+
+/** Number of values recorded for stage, over all action types */
+static uint64_t lat_count(const kpm_lat_t* lat, int stage) {
+  uint64_t n = 0;
+  for (int i = 0; i < KPM_LAT_N_ACTIONS; ++i)
+    n += lat->hist[i][stage].count;
+  return n;
+}
+
+static void test_latency(void) {
+  kpm_lat_t lat;
+  kpm_lat_init(&lat);
+  // an event that triggered no action is not recorded
+  kpm_lat_begin(&lat, 0);
+  kpm_lat_computed(&lat);
+  kpm_lat_flushed(&lat);
+  CHECK(lat_count(&lat, KPM_LAT_DISPATCH) == 0);
+  // nor is an unknown action type
+  kpm_lat_begin(&lat, 0);
+  kpm_lat_dispatch(&lat, KPM_LAT_N_ACTIONS);
+  kpm_lat_computed(&lat);
+  kpm_lat_begin(&lat, 0);
+  kpm_lat_dispatch(&lat, -1);
+  kpm_lat_computed(&lat);
+  kpm_lat_flushed(&lat);
+  CHECK(lat_count(&lat, KPM_LAT_DISPATCH) == 0);
+
+  kpm_lat_begin(&lat, 0);
+  kpm_lat_dispatch(&lat, KPM_LAT_UNDO);
+  kpm_lat_computed(&lat);
+  kpm_lat_flushed(&lat);
+  CHECK(lat.hist[KPM_LAT_UNDO][KPM_LAT_DISPATCH].count == 1);
+  CHECK(lat.hist[KPM_LAT_UNDO][KPM_LAT_INJECT].count == 1);
+  CHECK(lat.hist[KPM_LAT_UNDO][KPM_LAT_TOTAL].count == 0); // no input time
+  CHECK(lat_count(&lat, KPM_LAT_DISPATCH) == 1);
+}
+
+////////////////////////////////////
+// click history quadtree (history.h)
+////////////////////////////////////
+
+static void test_history(void) {
+  kpm_hs_t hs;
+  int x, y;
+  const char* path = path_of("clicks");
+  CHECK(!kpm_hs_init(&hs, path));
+  if (!hs.file)
+    return;
+  for (int i = 0; i < 10; ++i)
+    kpm_hs_add(&hs, 0, 0, 300, 200, 1000, 1000);
+  kpm_hs_add(&hs, 0, 1, 800, 800, 1000, 1000);
+
+  CHECK(kpm_hs_predict(&hs, 0, 1000, 1000, 0, 0, 1000, 1000, 5, &x, &y));
+  CHECK(abs(x - 300) <= 8 && abs(y - 200) <= 8); // within a finest cell
+  // sizes are relative: the same spot on a screen twice as large
+  CHECK(kpm_hs_predict(&hs, 0, 2000, 2000, 0, 0, 2000, 2000, 5, &x, &y));
+  CHECK(abs(x - 600) <= 16 && abs(y - 400) <= 16);
+  // too few clicks inside the rectangle, or none at all
+  CHECK(!kpm_hs_predict(&hs, 0, 1000, 1000, 500, 500, 500, 500, 5, &x, &y));
+  CHECK(kpm_hs_predict(&hs, 0, 1000, 1000, 500, 500, 500, 500, 1, &x, &y));
+  CHECK(!kpm_hs_predict(&hs, 1, 1000, 1000, 0, 0, 1000, 1000, 1, &x, &y));
+  kpm_hs_destroy(&hs);
+
+  // counts survive a restart
+  CHECK(!kpm_hs_init(&hs, path));
+  CHECK(kpm_hs_predict(&hs, 0, 1000, 1000, 0, 0, 1000, 1000, 10, &x, &y));
+  kpm_hs_destroy(&hs);
+  unlink(path);
+}
+
+////////////////////////////////////
+// ring of the async backend (kpm_be_async_new())
+////////////////////////////////////
+
+typedef struct {
+  int n_moves, n_buttons, last_x, out_of_order;
+} injected_t;
+
+static void on_injected(void* data, const kpm_be_act_t* act) {
+  injected_t* in = data;
+  if (!act->button) {
+    in->out_of_order += act->x < in->last_x;
+    in->last_x = act->x;
+    ++in->n_moves;
+  } else {
+    // buttons alternate down and up, each right after the move to i*2+1
+    in->out_of_order += act->down != (in->n_buttons % 2 == 0);
+    in->out_of_order += in->last_x != in->n_buttons*2 + 1;
+    ++in->n_buttons;
+  }
+}
+
+static void test_async(void) {
+  injected_t in = {0, 0, -1, 0};
+  kpm_be_t* inner = kpm_be_trace_new(100000, 100, &on_injected, &in);
+  kpm_be_t* fg = kpm_be_trace_new(100000, 100, NULL, NULL);
+  kpm_be_t* be = inner && fg ? kpm_be_async_new(inner, fg, NULL) : NULL;
+  CHECK(be != NULL);
+  if (!be)
+    return;
+  // far more than the ring holds, with and without flushes in between
+  const int n = 5000;
+  for (int i = 0; i < n; ++i) {
+    CHECK(!kpm_be_move(be, i*2, 0, 0));
+    CHECK(!kpm_be_move(be, i*2 + 1, 0, 0));
+    CHECK(!kpm_be_button(be, 1, i % 2 == 0));
+    if (i % 3 == 0)
+      CHECK(!kpm_be_flush(be));
+  }
+  CHECK(!kpm_be_move(be, n*2, 0, 0));
+  CHECK(!kpm_be_flush(be));
+  kpm_be_destroy(be); // drains the ring
+  CHECK(in.n_buttons == n); // buttons are never dropped
+  CHECK(in.n_moves >= n && in.n_moves <= 2*n + 1); // superseded moves are
+  CHECK(in.last_x == n*2); // the last move always lands
+  CHECK(!in.out_of_order);
+}
+
+////////////////////////////////////
+// undo of log steps (kpm_st_unmove())
+////////////////////////////////////
+
+static void test_unmove(void) {
+  kpm_st_t st;
+  unsigned int w[3], h[3];
+  int x[3], y[3];
+  // odd sizes, which the grid does not divide
+  kpm_be_t* be = kpm_be_trace_new(1023, 767, NULL, NULL);
+  CHECK(be != NULL);
+  if (!be)
+    return;
+  unsetenv("KPM_GRID");
+  CHECK(!kpm_st_init(&st, be));
+  const kpm_move_t moves[3] = {KPM_BR, KPM_CL, KPM_TR};
+  for (int i = 0; i < 3; ++i) {
+    CHECK(!kpm_st_move(&st, moves[i], i));
+    w[i] = st.w;
+    h[i] = st.h;
+    x[i] = st.log_x;
+    y[i] = st.log_y;
+  }
+  for (int i = 2; i > 0; --i) {
+    CHECK(!kpm_st_unmove(&st, 10 - i));
+    CHECK(st.w == w[i-1] && st.h == h[i-1]);
+    CHECK(st.log_x == x[i-1] && st.log_y == y[i-1]);
+  }
+  CHECK(!kpm_st_unmove(&st, 10));
+  CHECK(st.w == 1023 && st.h == 767 && !st.log_steps);
+  CHECK(st.log_x == 511 && st.log_y == 383);
+  kpm_st_destroy(&st);
+  kpm_be_destroy(be);
+}
+
+////////////////////////////////////
+// foreign pointer motion (kpm_st_handle_event())
+////////////////////////////////////
+
+/** Feeds st a raw motion of device to (x, y) */
+static void feed_motion(kpm_st_t* st, int device, double x, double y) {
+  unsigned char mask[1] = {0x3}; // valuators 0 and 1
+  double values[2] = {x, y};
+  XIRawEvent raw;
+  XEvent ev;
+  memset(&raw, 0, sizeof(raw));
+  raw.deviceid = 2;
+  raw.sourceid = device;
+  raw.valuators.mask_len = sizeof(mask);
+  raw.valuators.mask = mask;
+  raw.raw_values = values;
+  memset(&ev, 0, sizeof(ev));
+  ev.xcookie.type = GenericEvent;
+  ev.xcookie.extension = st->xi_opcode;
+  ev.xcookie.evtype = XI_RawMotion;
+  ev.xcookie.data = &raw; // already fetched
+  CHECK(kpm_st_handle_event(st, &ev));
+}
+
+static void test_foreign_motion(void) {
+  kpm_st_t st;
+  kpm_be_t* be = kpm_be_trace_new(1000, 1000, NULL, NULL);
+  CHECK(be != NULL);
+  if (!be)
+    return;
+  CHECK(!kpm_st_init(&st, be));
+  // as if XInput2 reported motion, with an XTest slave pointer 5
+  st.xi_opcode = 131;
+  st.xtest_dev[0] = 5;
+  st.n_xtest_devs = 1;
+  CHECK(!kpm_st_move(&st, KPM_TL, 0) && !kpm_st_commit(&st));
+  CHECK(!kpm_st_move(&st, KPM_BR, 10) && !kpm_st_commit(&st));
+  int x = st.ptr_x, y = st.ptr_y;
+  // the first move was superseded, only the second comes back
+  feed_motion(&st, 5, x, y);
+  CHECK(!st.ptr_stale && !st.n_injected);
+  // another XTest client moves the pointer
+  feed_motion(&st, 5, x + 1, y);
+  CHECK(st.ptr_stale);
+  CHECK(!kpm_st_move(&st, KPM_TL, 20) && !st.ptr_stale);
+  // as does a physical mouse
+  feed_motion(&st, 7, x, y);
+  CHECK(st.ptr_stale);
+  kpm_st_destroy(&st);
+  kpm_be_destroy(be);
+}
+
+////////////////////////////////////
+// evdev reader over a pipe (evdev.h)
+////////////////////////////////////
+
+typedef struct {
+  int n_moves, n_downs, n_ups;
+} actions_t;
+
+static void on_action(void* data, const kpm_be_act_t* act) {
+  actions_t* a = data;
+  if (!act->button)
+    ++a->n_moves;
+  else if (act->down)
+    ++a->n_downs;
+  else
+    ++a->n_ups;
+}
+
+static void write_events(int fd, const struct input_event* evs, int n) {
+  CHECK(write(fd, evs, n*sizeof(*evs)) == (ssize_t)(n*sizeof(*evs)));
+}
+
+static void test_evdev(void) {
+  actions_t a = {0, 0, 0};
+  kpm_lp_t lp;
+  kpm_st_t st;
+  kpm_el_t el;
+  kpm_ev_t ev;
+  int fds[2];
+  setenv("KPM_CONFIG", "", 1); // built-in bindings
+  setenv("KPM_MACROS", "", 1);
+  kpm_be_t* be = kpm_be_trace_new(1000, 1000, &on_action, &a);
+  CHECK(be != NULL);
+  if (!be || kpm_lp_init(&lp) || pipe(fds))
+    return;
+  CHECK(!kpm_st_init(&st, be) && !kpm_el_init(&el, &st, &lp, NULL));
+  CHECK(!kpm_ev_init(&ev, &el, fds[0]));
+  CHECK(!ev.grabbed); // a pipe is not a device
+
+  struct input_event evs[4];
+  memset(evs, 0, sizeof(evs));
+  evs[0].type = EV_KEY;
+  evs[0].code = KEY_KPSLASH; // left button
+  evs[0].value = 1;
+  evs[1].type = EV_SYN;
+  evs[1].code = SYN_REPORT;
+  // a record split across two reads
+  CHECK(write(fds[1], evs, 10) == 10);
+  CHECK(!kpm_lp_step(&lp));
+  CHECK(a.n_downs == 0);
+  CHECK(write(fds[1], (char*)evs + 10, 2*sizeof(*evs) - 10)
+        == (ssize_t)(2*sizeof(*evs) - 10));
+  CHECK(!kpm_lp_step(&lp));
+  CHECK(a.n_downs == 1 && a.n_ups == 0);
+
+  // events are dropped, the release of the button key among them: the
+  // events up to SYN_REPORT are ignored, and the key is released on resync
+  int n_moves = a.n_moves;
+  evs[0].type = EV_SYN;
+  evs[0].code = SYN_DROPPED;
+  evs[1].type = EV_KEY;
+  evs[1].code = KEY_KP7; // a move that must not happen
+  evs[1].value = 1;
+  evs[2].type = EV_KEY;
+  evs[2].code = KEY_KP7;
+  evs[2].value = 0;
+  evs[3].type = EV_SYN;
+  evs[3].code = SYN_REPORT;
+  write_events(fds[1], evs, 4);
+  CHECK(!kpm_lp_step(&lp));
+  CHECK(a.n_ups == 1);
+  CHECK(a.n_moves == n_moves);
+  CHECK(!ev.dropped && !ev.n_partial);
+
+  kpm_ev_destroy(&ev);
+  kpm_el_destroy(&el);
+  kpm_st_destroy(&st);
+  kpm_be_destroy(be);
+  kpm_lp_destroy(&lp);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+int main(int argc, char** argv) {
+  const char* tmp = getenv("TMPDIR");
+  snprintf(g_dir, sizeof(g_dir), "%s/kpm_unit.XXXXXX", tmp ? tmp : "/tmp");
+  if (!mkdtemp(g_dir)) {
+    perror(g_dir);
+    return 1;
+  }
+  test_chord();
+  test_keymap();
+  test_status();
+  test_latency();
+  test_history();
+  test_async();
+  test_unmove();
+  test_foreign_motion();
+  test_evdev();
+  rmdir(g_dir);
+  if (g_failed)
+    fprintf(stderr, "%d checks failed\n", g_failed);
+  else
+    printf("kpm_unit: all checks passed\n");
+  return g_failed ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+#!/bin/sh
+# Runs the unit tests and replays every trace in tests/traces, comparing the
+# hash of the injected actions with the "# hash:" line of the trace. Traces
+# may also have "# env:" (environment variables) and "# args:" (kpm_replay
+# options) lines.
+#
+# Usage: tests/run.sh
+#
+# After a change that is meant to alter the actions of a trace, run
+# "build/kpm_replay -v" on it to check the new actions, then update its hash.
+set -u
+
+KPM_REPLAY=${KPM_REPLAY:-build/kpm_replay}
+KPM_UNIT=${KPM_UNIT:-build/kpm_unit}
+
+TMP=$(mktemp -d)
+trap 'rm -fr "$TMP"' EXIT INT TERM
+
+# Nothing may depend on (nor write to) the files of the user running tests
+export HOME="$TMP/home"
+mkdir "$HOME"
+unset XDG_CONFIG_HOME XDG_DATA_HOME KPM_CONFIG KPM_MACROS KPM_HISTORY KPM_GRID \
+      KPM_CHORD_MS
+
+FAILED=0
+if "$KPM_UNIT"; then
+  echo "ok   unit tests"
+else
+  echo "FAIL unit tests"
+  FAILED=1
+fi
+
+for TRACE in tests/traces/*.trace; do
+  ENV=$(sed -n 's/^# env: *//p' "$TRACE")
+  ARGS=$(sed -n 's/^# args: *//p' "$TRACE")
+  WANT=$(sed -n 's/^# hash: *//p' "$TRACE")
+  GOT=$(env $ENV "$KPM_REPLAY" $ARGS "$TRACE" 2>/dev/null \
+        | sed -n 's/^hash //p')
+  if [ -n "$GOT" ] && [ "$GOT" = "$WANT" ]; then
+    echo "ok   $TRACE"
+  else
+    echo "FAIL $TRACE: hash ${GOT:-none}, expected $WANT"
+    FAILED=1
+  fi
+done
+
+# Fuzzing stores and plays macros, which must not be saved anywhere
+"$KPM_REPLAY" -k 60 -f 1:100000 >/dev/null 2>&1
+if [ -z "$(ls -A "$HOME")" ]; then
+  echo "ok   fuzzing writes no files"
+else
+  echo "FAIL fuzzing wrote files:"
+  find "$HOME" -type f
+  FAILED=1
+fi
+
+exit $FAILED
@@ -0,0 +1,135 @@
+/*
+ * Sends commands to a running kpmouse through its control socket (see
+ * src/control.h). All commands are sent as a single batch, which kpmouse
+ * applies with a single flush, and the replies are read back.
+ *
+ * Usage: kpm_ctl [-s SOCKET] COMMAND...
+ *   -s SOCKET  control socket (default: as kpmouse, see kpm_ct_path())
+ * Commands:
+ *   move-tl, move-cu, move-tr, move-cd, move-bl, move-cl, move-br, move-cr,
+ *   move-cc (center cell)
+ *   undo, reset, nop
+ *   click-BUTTON, down-BUTTON, up-BUTTON  (BUTTON: left, middle or right)
+ *
+ * Exits with 0 if all commands succeeded.
+ */
+#include "../src/config.h"
+#include "../src/control.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/** Command names, indexed by the kpm_move_t they take */
+static const char* MOVE_NAMES[KPM_NULL_MOVE] = {
+  "move-tl", "move-cu", "move-tr", "move-cd",
+  "move-bl", "move-cl", "move-br", "move-cr", "move-cc"
+};
+static const char* BUTTON_NAMES[KPM_NULL_BUTTON] = {"left", "middle", "right"};
+
+/** Encodes a command into out. Returns its length, or 0 if unknown */
+static int encode(const char* name, unsigned char* out) {
+  static const struct { const char* prefix; unsigned char op; } BUTTON_OPS[] = {
+    {"click-", KPM_CT_CLICK}, {"down-", KPM_CT_DOWN}, {"up-", KPM_CT_UP}
+  };
+  for (int i = 0; i < KPM_NULL_MOVE; ++i) {
+    if (!strcmp(name, MOVE_NAMES[i])) {
+      out[0] = KPM_CT_MOVE;
+      out[1] = i;
+      return 2;
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    size_t len = strlen(BUTTON_OPS[i].prefix);
+    if (strncmp(name, BUTTON_OPS[i].prefix, len))
+      continue;
+    for (int b = 0; b < KPM_NULL_BUTTON; ++b) {
+      if (!strcmp(name + len, BUTTON_NAMES[b])) {
+        out[0] = BUTTON_OPS[i].op;
+        out[1] = b;
+        return 2;
+      }
+    }
+  }
+  out[0] = !strcmp(name, "undo") ? KPM_CT_UNMOVE
+         : !strcmp(name, "reset") ? KPM_CT_RESET
+         : !strcmp(name, "nop") ? KPM_CT_NOP : 0xff;
+  return out[0] == 0xff ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  char buf[108];
+  const char* path = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:")) != -1) {
+    if (opt != 's')
+      goto usage;
+    path = optarg;
+  }
+  if (optind == argc)
+    goto usage;
+  if (!path && !(path = kpm_ct_path(buf, sizeof(buf)))) {
+    fprintf(stderr, "No control socket, set KPM_SOCKET or use -s\n");
+    return 1;
+  }
+
+  int n_cmds = argc - optind;
+  unsigned char* cmds = malloc(2*n_cmds);
+  unsigned char* replies = malloc(n_cmds);
+  size_t len = 0;
+  if (!cmds || !replies) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  for (int i = optind; i < argc; ++i) {
+    int n = encode(argv[i], cmds + len);
+    if (!n) {
+      fprintf(stderr, "Unknown command: %s\n", argv[i]);
+      goto usage;
+    }
+    len += n;
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+    perror(path);
+    return 1;
+  }
+  for (size_t sent = 0; sent < len; ) {
+    ssize_t n = write(fd, cmds + sent, len - sent);
+    if (n <= 0) {
+      perror("write");
+      return 1;
+    }
+    sent += n;
+  }
+  int failed = 0;
+  for (int got = 0; got < n_cmds; ) {
+    ssize_t n = read(fd, replies + got, n_cmds - got);
+    if (n <= 0) {
+      fprintf(stderr, "kpmouse closed the connection\n");
+      return 1;
+    }
+    got += n;
+  }
+  for (int i = 0; i < n_cmds; ++i) {
+    if (replies[i]) {
+      fprintf(stderr, "%s failed with error %d\n", argv[optind+i], replies[i]);
+      failed = 1;
+    }
+  }
+  close(fd);
+  free(cmds);
+  free(replies);
+  return failed;
+
+usage:
+  fprintf(stderr, "Usage: %s [-s SOCKET] COMMAND...\n", argv[0]);
+  return 1;
+}
@@ -0,0 +1,253 @@
+/*
+ * Replays key traces through the kpmouse state machine without any display.
+ * Timers (TTL, long press, animation, glide) run on a virtual clock driven by
+ * the trace timestamps, thus a replay is deterministic: the same trace always
+ * yields the same actions and the same hash.
+ *
+ * A trace is a text file with one key event per line:
+ *
+ *     <milliseconds> <keycode> <p|r>
+ *
+ * KeyCodes are X KeyCodes (evdev codes plus 8), bound as in the kpm_*_evdev
+ * tables of user_config.c or, with -c, by keycode: entries of a config file
+ * (see keymap.h). Lines starting with # are ignored. kpmouse records
+ * traces in this format if the KPM_RECORD environment variable names a file.
+ *
+ * Replays never read the config file nor the macros of the user, and never
+ * save macros, so they do not depend on (nor change) the machine they run on.
+ *
+ * Usage: kpm_replay [-v] [-c CONFIG] [-k MS] [-r REPEAT] [-s WxH]
+ *                   [-f SEED:COUNT] [-b MS] [TRACE]
+ *   -v            print every action
+ *   -c CONFIG     key bindings file (default: the built-in bindings)
+ *   -k MS         chord window (default KPM_CHORD_MS, see user_config.h)
+ *   -b MS         handle events less than MS apart as one batch, with a
+ *                 single flush, as kpmouse does with events queued while it
+ *                 was busy (default 0: a flush per event)
+ *   -r REPEAT     replay the trace REPEAT times (for profiling)
+ *   -s WxH        screen size (default KPM_UINPUT_WIDTH x KPM_UINPUT_HEIGHT)
+ *   -f SEED:COUNT replay COUNT random events instead of a trace (fuzzing)
+ * Without TRACE (nor -f), the trace is read from stdin.
+ */
+#include "../src/config.h"
+#include "../src/state.h"
+#include "../src/event_loop.h"
+#include "../src/loop.h"
+#include "../src/util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/** After the last event, timers run for this long (virtual time) */
+#define SETTLE_MS (KPM_MOVE_TTL_MS + KPM_LONG_PRESS_MS)
+
+typedef struct rec_s {
+  long int ms;
+  KeyCode code;
+  char press;
+} rec_t;
+
+typedef struct replay_s {
+  kpm_lp_t lp;
+  kpm_st_t st;
+  kpm_el_t el;
+  kpm_be_t* be;
+  /** If not NULL, every action is printed here */
+  FILE* verbose;
+  /** Events less than batch_ms apart share a flush */
+  long int batch_ms;
+  unsigned long long n_moves, n_buttons;
+  /** FNV-1a hash of all actions and their times */
+  uint64_t hash;
+} replay_t;
+
+static void hash_add(replay_t* r, uint64_t value) {
+  r->hash = (r->hash ^ value) * 0x100000001b3ULL;
+}
+
+static void on_action(void* data, const kpm_be_act_t* act) {
+  replay_t* r = data;
+  long int now = kpm_lp_now(&r->lp);
+  hash_add(r, now);
+  hash_add(r, act->button);
+  hash_add(r, ((uint64_t)(uint32_t)act->x << 32) | (uint32_t)act->y);
+  hash_add(r, act->down);
+  if (act->button)
+    ++r->n_buttons;
+  else
+    ++r->n_moves;
+  if (!r->verbose)
+    return;
+  if (act->button) {
+    fprintf(r->verbose, "%ld button %d %s\n", now, act->button,
+            act->down ? "down" : "up");
+  } else {
+    fprintf(r->verbose, "%ld move %d %d\n", now, act->x, act->y);
+  }
+}
+
+/** Parses a trace. Returns the number of records, or -1 on errors */
+static long parse_trace(FILE* in, rec_t** recs) {
+  size_t n = 0, cap = 1024;
+  char line[128];
+  long int line_no = 0, last = -1;
+  *recs = malloc(cap*sizeof(rec_t));
+  while (*recs && fgets(line, sizeof(line), in)) {
+    char* p = line;
+    ++line_no;
+    while (*p == ' ' || *p == '\t')
+      ++p;
+    if (*p == '#' || *p == '\n' || !*p)
+      continue;
+    char *start = p, *end;
+    long int ms = strtol(start, &end, 10);
+    unsigned long code = strtoul(end, &p, 10);
+    while (*p == ' ' || *p == '\t')
+      ++p;
+    if (end == start || p == end || code < 8 || code > 255
+        || (*p != 'p' && *p != 'r')) {
+      fprintf(stderr, "Bad trace line %ld: %s", line_no, line);
+      return -1;
+    }
+    if (ms < last) {
+      fprintf(stderr, "Trace line %ld goes back in time\n", line_no);
+      return -1;
+    }
+    if (n == cap)
+      *recs = realloc(*recs, (cap *= 2)*sizeof(rec_t));
+    if (!*recs)
+      break;
+    rec_t rec = {last = ms, code, *p == 'p'};
+    (*recs)[n++] = rec;
+  }
+  if (!*recs) {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+  return n;
+}
+
+/** Random events over the KeyCodes handled by el (xorshift64*) */
+static long fuzz_trace(const kpm_el_t* el, uint64_t seed, long n,
+                       rec_t** recs) {
+  KeyCode codes[256];
+  int n_codes = kpm_km_codes(&el->km, codes);
+  if (!n_codes) {
+    fprintf(stderr, "No bound KeyCodes to fuzz\n");
+    return -1;
+  }
+  if (!(*recs = malloc(n*sizeof(rec_t)))) {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+  uint64_t x = seed ? seed : 1;
+  long int ms = 0;
+  for (long i = 0; i < n; ++i) {
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    uint64_t rnd = x * 0x2545f4914f6cdd1dULL;
+    // mostly fast typing, sometimes pauses beyond the TTL and long press
+    ms += (rnd >> 40) % 16 ? (rnd >> 8) % 64 : (rnd >> 8) % (2*SETTLE_MS);
+    rec_t rec = {ms, codes[(rnd >> 32) % n_codes], rnd & 1};
+    (*recs)[i] = rec;
+  }
+  return n;
+}
+
+static int replay(replay_t* r, const rec_t* recs, long n, long int offset) {
+  for (long i = 0; i < n; ++i) {
+    KPM_RET(kpm_lp_advance, &r->lp, recs[i].ms + offset);
+    KPM_RET(kpm_el_key, &r->el, recs[i].code, recs[i].press, 0);
+    if (i+1 == n || recs[i+1].ms - recs[i].ms >= r->batch_ms)
+      KPM_RET(kpm_el_flush, &r->el);
+  }
+  return KPM_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+  static replay_t r;
+  unsigned int w = KPM_UINPUT_WIDTH, h = KPM_UINPUT_HEIGHT;
+  unsigned long long seed = 0;
+  const char* config = "";
+  const char* chord_ms = "";
+  long n_fuzz = 0, repeat = 1, n;
+  rec_t* recs = NULL;
+  int opt, err;
+
+  while ((opt = getopt(argc, argv, "vc:k:r:s:f:b:")) != -1) {
+    switch (opt) {
+      case 'v': r.verbose = stdout; break;
+      case 'c': config = optarg; break;
+      case 'k': chord_ms = optarg; break;
+      case 'r': repeat = atol(optarg); break;
+      case 'b': r.batch_ms = atol(optarg); break;
+      case 's':
+        if (sscanf(optarg, "%ux%u", &w, &h) != 2 || !w || !h)
+          goto usage;
+        break;
+      case 'f':
+        if (sscanf(optarg, "%llu:%ld", &seed, &n_fuzz) != 2 || n_fuzz <= 0)
+          goto usage;
+        break;
+      default:
+        goto usage;
+    }
+  }
+
+  r.hash = 0xcbf29ce484222325ULL;
+  kpm_lp_init_virtual(&r.lp, 0);
+  if (!(r.be = kpm_be_trace_new(w, h, &on_action, &r)))
+    return KPM_ERR_BACKEND_NEW;
+  // empty values disable the config file and the macro directory
+  setenv("KPM_CONFIG", config, 1);
+  setenv("KPM_MACROS", "", 1);
+  setenv("KPM_CHORD_MS", chord_ms, 1);
+  KPM_RET(kpm_st_init, &r.st, r.be);
+  KPM_RET(kpm_el_init, &r.el, &r.st, &r.lp, NULL);
+
+  if (n_fuzz) {
+    n = fuzz_trace(&r.el, seed, n_fuzz, &recs);
+  } else {
+    FILE* in = optind < argc ? fopen(argv[optind], "r") : stdin;
+    if (!in) {
+      perror(argv[optind]);
+      return 1;
+    }
+    n = parse_trace(in, &recs);
+    if (in != stdin)
+      fclose(in);
+  }
+  if (n < 0)
+    return 1;
+
+  long int span = n ? recs[n-1].ms - recs[0].ms + SETTLE_MS : 0;
+  long int offset = n ? -recs[0].ms : 0;
+  long long start = kpm__now_ns();
+  for (long i = 0; i < repeat; ++i, offset += span) {
+    if ((err = KPM_CHK(replay, &r, recs, n, offset)))
+      return err;
+  }
+  KPM_RET(kpm_lp_advance, &r.lp, kpm_lp_now(&r.lp) + SETTLE_MS);
+  long long elapsed = kpm__now_ns() - start;
+
+  printf("events %ld\nmoves %llu\nbuttons %llu\npointer %d %d\n"
+         "hash %016llx\n", n*repeat, r.n_moves, r.n_buttons, r.st.ptr_x,
+         r.st.ptr_y, (unsigned long long)r.hash);
+  fprintf(stderr, "%ld events in %.3f ms (%.2f M events/s)\n", n*repeat,
+          elapsed/1e6, elapsed ? n*repeat*1e3/elapsed : 0);
+
+  kpm_el_destroy(&r.el);
+  kpm_st_destroy(&r.st);
+  kpm_be_destroy(r.be);
+  kpm_lp_destroy(&r.lp);
+  free(recs);
+  return 0;
+
+usage:
+  fprintf(stderr, "Usage: %s [-v] [-c CONFIG] [-k MS] [-r REPEAT] [-s WxH] "
+          "[-f SEED:COUNT] [-b MS] [TRACE]\n", argv[0]);
+  return 1;
+}
@@ -0,0 +1,76 @@
+/*
+ * Prints the status published by kpmouse in its status page (see
+ * src/status.h), as one line of KEY=VALUE fields: mode (idle, log, linear or
+ * exited), steps (log steps done/maximum), grid, button (held mouse button),
+ * ptr (X,Y@SCREEN), window (WxH+X+Y), ttl (milliseconds left before the
+ * movement expires) and recording (a macro). With -f, a line is printed on
+ * every change, sleeping in between without any polling, until kpmouse
+ * exits.
+ *
+ * Usage: kpm_status [-f] [-s PAGE]
+ *   -f       follow changes
+ *   -s PAGE  status page (default: as kpmouse, see kpm_sp_path())
+ */
+#include "../src/config.h"
+#include "../src/status.h"
+#include "../src/util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char* MODE_NAMES[] = {"idle", "log", "linear", "exited"};
+static const char* BUTTON_NAMES[] = {"left", "middle", "right", "none"};
+
+static void print(const kpm_sp_status_t* s) {
+  long int ttl = s->expire_ms ? s->expire_ms - kpm__now_ms() : 0;
+  printf("mode=%s steps=%u/%u grid=%u button=%s%s ptr=%d,%d@%d "
+         "window=%dx%d%+d%+d ttl=%ld recording=%u\n",
+         s->mode < 4 ? MODE_NAMES[s->mode] : "?", s->log_steps,
+         s->max_log_steps, s->grid,
+         s->button < 4 ? BUTTON_NAMES[s->button] : "?",
+         s->long_press ? "(held)" : "", s->ptr_x, s->ptr_y, s->ptr_screen,
+         s->win_w, s->win_h, s->win_x, s->win_y, ttl > 0 ? ttl : 0,
+         s->recording);
+  fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+  char path_buf[1024];
+  const char* path = NULL;
+  int follow = 0, opt;
+  while ((opt = getopt(argc, argv, "fs:")) != -1) {
+    if (opt == 'f')
+      follow = 1;
+    else if (opt == 's')
+      path = optarg;
+    else
+      goto usage;
+  }
+  if (optind != argc)
+    goto usage;
+  if (!path && !(path = kpm_sp_path(path_buf, sizeof(path_buf)))) {
+    fprintf(stderr, "No status page (set KPM_STATUS or XDG_RUNTIME_DIR)\n");
+    return 1;
+  }
+  kpm_sp_page_t* page = kpm_sp_open(path);
+  if (!page) {
+    fprintf(stderr, "%s: not a kpmouse status page\n", path);
+    return 1;
+  }
+  kpm_sp_status_t status;
+  uint32_t seq = kpm_sp_read(page, &status);
+  print(&status);
+  while (follow && status.mode != KPM_SP_EXITED) {
+    if (kpm_sp_wait(page, seq, -1)) {
+      seq = kpm_sp_read(page, &status);
+      print(&status);
+    }
+  }
+  kpm_sp_close(page);
+  return 0;
+
+usage:
+  fprintf(stderr, "Usage: %s [-f] [-s PAGE]\n", argv[0]);
+  return 1;
+}
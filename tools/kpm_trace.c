@@ -0,0 +1,87 @@
+/*
+ * Decodes a trace ring dump written by kpmouse (see src/trace.h) into one
+ * text line per record, oldest first:
+ *
+ *   <ms since first record> <seq> <type> <fields...>
+ *
+ * Records that were being written when the ring was dumped (their sequence
+ * number does not match their position) are reported as torn and skipped.
+ *
+ * Usage: kpm_trace FILE
+ */
+#include "../src/config.h"
+#include "../src/trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* MOVE_NAMES[] = {"tl", "cu", "tr", "cd",
+                                   "bl", "cl", "br", "cr", "cc"};
+
+static void print(const kpm_tr_rec_t* r, int64_t t0) {
+  printf("%10.3f %8u %-6s ", (r->ns - t0)/1e6, r->seq,
+         kpm_tr_type_name(r->type));
+  switch (r->type) {
+    case KPM_TR_KEY:
+      printf("keycode=%u %s mods=0x%x\n", r->code,
+             r->x ? "press" : "release", (unsigned)r->y);
+      break;
+    case KPM_TR_MOVE:
+      printf("%s%s -> (%d, %d)\n", r->arg ? "undo " : "",
+             r->code < 9 ? MOVE_NAMES[r->code] : "?", r->x, r->y);
+      break;
+    case KPM_TR_WARP:
+      printf("(%d, %d) screen=%u\n", r->x, r->y, r->code);
+      break;
+    case KPM_TR_BUTTON:
+      printf("%u %s\n", r->code, r->x ? "down" : "up");
+      break;
+    case KPM_TR_ERROR:
+      printf("code=%u line=%d\n", r->arg, r->x);
+      break;
+    case KPM_TR_CHORD:
+      printf("0x%02x keycodes=%d+%d\n", r->code, r->x, r->y);
+      break;
+    case KPM_TR_INIT:
+      printf("screen=%dx%d max_log_steps=%u\n", r->x, r->y, r->arg);
+      break;
+    default:
+      printf("code=%u x=%d y=%d arg=%u\n", r->code, r->x, r->y, r->arg);
+  }
+}
+
+int main(int argc, char** argv) {
+  kpm_tr_file_t hdr;
+  kpm_tr_rec_t r;
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s FILE\n", argv[0]);
+    return 1;
+  }
+  FILE* in = fopen(argv[1], "rb");
+  if (!in) {
+    perror(argv[1]);
+    return 1;
+  }
+  if (fread(&hdr, sizeof(hdr), 1, in) != 1
+      || memcmp(hdr.magic, KPM_TR_MAGIC, sizeof(hdr.magic))
+      || hdr.rec_size != sizeof(kpm_tr_rec_t)) {
+    fprintf(stderr, "%s: not a kpmouse trace dump\n", argv[1]);
+    fclose(in);
+    return 1;
+  }
+  uint32_t seq = (uint32_t)(hdr.head - hdr.n), torn = 0, n = 0;
+  int64_t t0 = 0;
+  for (; n < hdr.n && fread(&r, sizeof(r), 1, in) == 1; ++n, ++seq) {
+    if (r.seq != seq || r.type == KPM_TR_NONE) {
+      ++torn;
+      continue;
+    }
+    if (!t0)
+      t0 = r.ns;
+    print(&r, t0);
+  }
+  fprintf(stderr, "%u records, %u torn, %llu written since start\n", n,
+          torn, (unsigned long long)hdr.head);
+  fclose(in);
+  return n == hdr.n ? 0 : 1;
+}